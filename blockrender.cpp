@@ -0,0 +1,310 @@
+/*
+ This file is part of Virtual Robot's Pine Synthesizer. 
+
+Copyright <2022> <Brian Gunnison>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+software and associated documentation files (the "Software"), to deal in the Software 
+without restriction, including without limitation the rights to use, copy, modify, 
+merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+permit persons to whom the Software is furnished to do so, subject to the following 
+conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "daisy_pod.h"
+#include "daisysp.h"
+
+#include "utilities.h"
+#include "voice.h"
+#include "filter.h"
+#include "midimap.h"
+#include "cyclecounter.h"
+#include "profiler.h"
+#include "blockrender.h"
+
+using namespace daisy;
+using namespace daisysp;
+
+
+void BlockRenderer::Init(Voices *v, Filters *f, CCMIDIMap *cc, float SR, size_t blockSize)
+{
+	voices = v;
+	filters = f;
+	ccmap = cc;
+	
+	queue.Init();
+	hasNext = false;
+	profiler = NULL;
+	
+	latency = blockSize;
+	
+	CycleCounterInit();
+	samplesPerCycle = SR / CyclesPerSecond();
+	
+	sampleClock = 0;
+	blockClock = 0;
+	blockCycle = CycleCount();
+	
+	quiet = 0;
+	silenceSamples = SILENCE_MS * SR / 1000;
+	silent = false;
+	
+	counters.applied = 0;
+	counters.late = 0;
+	counters.splits = 0;
+	counters.silent = 0;
+}
+
+
+uint32_t BlockRenderer::Now()
+{
+	uint32_t clock;
+	uint32_t cycle;
+	
+	// the audio callback may start a block between the two reads, read again until they agree
+	do
+	{
+		clock = blockClock;
+		cycle = blockCycle;
+	} while (clock != blockClock);
+	
+	uint32_t elapsed = (uint32_t)((CycleCount() - cycle) * samplesPerCycle);
+	
+	// the next block plays this at offset elapsed, a stalled callback must not push it further
+	if (elapsed >= latency)
+	{
+		elapsed = latency - 1;
+	}
+	
+	return clock + elapsed;
+}
+
+
+bool BlockRenderer::Post(SynthEvent &e)
+{
+	return Post(e, Now());
+}
+
+
+bool BlockRenderer::Post(SynthEvent &e, uint32_t timestamp)
+{
+	e.timestamp = timestamp;
+	return queue.Push(e);
+}
+
+
+void BlockRenderer::Apply(const SynthEvent &e)
+{
+	switch (e.type)
+	{
+	case SYNTH_EVENT_NOTE_ON:
+		{
+			NoteOnEvent p;
+			p.channel = e.channel;
+			p.note = e.data0;
+			p.velocity = e.data1;
+			voices->NoteOn(&p);
+		}
+		break;
+		
+	case SYNTH_EVENT_NOTE_OFF:
+		{
+			NoteOffEvent p;
+			p.channel = e.channel;
+			p.note = e.data0;
+			p.velocity = e.data1;
+			voices->NoteOff(&p);
+		}
+		break;
+		
+	case SYNTH_EVENT_CC:
+		ccmap->Change(e.data0, e.data1);
+		break;
+		
+	default:
+		break;
+	}
+	
+	counters.applied++;
+}
+
+
+void BlockRenderer::ApplyEvents()
+{
+	if (hasNext)
+	{
+		Apply(next);
+		hasNext = false;
+	}
+	
+	while (queue.Pop(next))
+	{
+		Apply(next);
+	}
+}
+
+
+void BlockRenderer::Render(float *out, size_t frames)
+{
+	uint32_t cycle = CycleCount();
+	uint32_t start = sampleClock;
+	size_t done = 0;
+	
+	// a voice change takes effect between blocks, the blocks it takes are muted while the old
+	// filter rings out and the events wait for the new engine
+	uint32_t s = profiler ? profiler->Start() : 0;
+	bool switching = voices->BeginBlock();
+	if (switching)
+	{
+		if (profiler)
+		{
+			profiler->Add(PROF_SWITCH, s);
+			s = profiler->Start();
+		}
+		
+		for (size_t i = 0; i < frames; i++)
+		{
+			out[i] = 0.0;
+		}
+		filters->ProcessBlock(out, frames);
+		done = frames;
+		
+		if (profiler)
+		{
+			profiler->Add(PROF_FILTER, s);
+		}
+	}
+	
+	while (done < frames)
+	{
+		size_t end = frames;
+		uint32_t t = profiler ? profiler->Start() : 0;
+		
+		// apply everything due by this sample, stop at the first event due later in the block
+		while (hasNext || queue.Pop(next))
+		{
+			hasNext = true;
+			
+			int32_t offset = (int32_t)(next.timestamp + latency - start);
+			if (offset > (int32_t)done)
+			{
+				if (offset < (int32_t)frames)
+				{
+					end = offset;
+				}
+				break;
+			}
+			
+			if (offset < 0)
+			{
+				counters.late++;
+			}
+			
+			Apply(next);
+			hasNext = false;
+		}
+		
+		if (done > 0)
+		{
+			counters.splits++;
+		}
+		
+		if (profiler)
+		{
+			profiler->Add(PROF_EVENTS, t);
+			t = profiler->Start();
+		}
+		
+		voices->ProcessBlock(out + done, end - done);
+		
+		if (profiler)
+		{
+			profiler->Add(PROF_VOICE + voices->GetSelector(), t);
+			t = profiler->Start();
+		}
+		
+		filters->ProcessBlock(out + done, end - done);
+		
+		if (profiler)
+		{
+			profiler->Add(PROF_FILTER, t);
+		}
+		
+		done = end;
+	}
+	
+	// the filter may ring on after the last slot goes idle, silence is the output itself
+	float peak = 0.0;
+	for (size_t s = 0; s < frames; s++)
+	{
+		peak = fmaxf(peak, fabsf(out[s]));
+	}
+	
+	if (peak < SILENCE_PEAK && voices->IsIdle())
+	{
+		if (quiet < silenceSamples)
+		{
+			quiet += frames;
+		}
+	}
+	else
+	{
+		quiet = 0;
+	}
+	silent = quiet >= silenceSamples;
+	
+	sampleClock = start + frames;
+	
+	// Now() in the main loop measures from the start of this render
+	blockCycle = cycle;
+	blockClock = start;
+}
+
+
+void BlockRenderer::Skip(float *out, size_t frames)
+{
+	uint32_t cycle = CycleCount();
+	uint32_t start = sampleClock;
+	
+	counters.silent++;
+	
+	// every slot is idle, nothing is rendered, only phases and noise seeds move on so the next
+	// note starts as it would have without the bypass. A voice change still lands, the new engine
+	// starts idle
+	if (!voices->BeginBlock())
+	{
+		voices->SkipBlock(frames);
+	}
+	for (size_t s = 0; s < frames; s++)
+	{
+		out[s] = 0.0;
+	}
+	
+	sampleClock = start + frames;
+	
+	blockCycle = cycle;
+	blockClock = start;
+}
+
+
+void BlockRenderer::LogCounters()
+{
+	const SPSCQueue<SynthEvent, SYNTH_EVENT_QUEUE_SIZE>::Counters &q = queue.GetCounters();
+	
+	log("Event queue depth: %u max: %u of %u pushed: %u overflows: %u", 
+		queue.Depth(), 
+		q.maxDepth, 
+		SYNTH_EVENT_QUEUE_SIZE, 
+		q.pushed, 
+		q.overflows);
+	log("Events late: %u splits: %u silent: %u", counters.late, counters.splits, counters.silent);
+}
@@ -0,0 +1,120 @@
+/*
+ This file is part of Virtual Robot's Pine Synthesizer. 
+
+Copyright <2022> <Brian Gunnison>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+software and associated documentation files (the "Software"), to deal in the Software 
+without restriction, including without limitation the rights to use, copy, modify, 
+merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+permit persons to whom the Software is furnished to do so, subject to the following 
+conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include "daisy_pod.h"
+#include "voice.h"
+#include "filter.h"
+#include "midimap.h"
+#include "eventqueue.h"
+#include "profiler.h"
+
+using namespace daisy;
+
+#define SYNTH_EVENT_QUEUE_SIZE 64
+
+// every voice slot idle (below SLOT_IDLE_PEAK, see voice.h) and the filter output below this peak
+// for SILENCE_MS and the renderer is silent, the audio callback zero fills until the next event
+#define SILENCE_PEAK	1.0e-3f	// -60 dB, above the Svf's own limit cycle of about -70 dB
+#define SILENCE_MS		100
+
+
+// Renders voice and filter a block at a time and applies queued events on the exact sample they are due.
+// Events are stamped with the sample clock when the main loop posts them and played one block later,
+// at the same offset into the block, so the latency is a constant block instead of 0 to 1 block of jitter.
+// Post() is the main loop (producer) side, Render() the audio callback (consumer) side.
+class BlockRenderer
+{
+public:
+	typedef struct
+	{
+		uint32_t applied;	// events played
+		uint32_t late;		// events that were due before the block they were played in
+		uint32_t splits;	// extra block segments rendered to land events on their sample
+		uint32_t silent;	// blocks skipped while silent
+	}Counters;
+	
+	void Init(Voices *v, Filters *f, CCMIDIMap *cc, float SR, size_t blockSize);
+	
+	// main loop, stamps the event with Now() and queues it, false if the queue overflowed.
+	// The stamp is when the main loop gets to the event, not when its MIDI bytes came in: libDaisy's
+	// MidiEvent carries no time, so a pass of the main loop (controls, logging) is still jitter
+	bool Post(SynthEvent &e);
+	
+	// queues an event with a given timestamp, for offline rendering where there is no clock
+	bool Post(SynthEvent &e, uint32_t timestamp);
+	
+	// times the event, voice engine and filter stages of Render(), NULL turns it off
+	void SetProfiler(Profiler *p) { profiler = p; }
+	
+	// audio callback, renders frames mono samples into out applying events as they fall due
+	void Render(float *out, size_t frames);
+	
+	// audio callback, applies every waiting event now, for the per sample fallback path
+	void ApplyEvents();
+	
+	// audio callback, true while nothing sounds and no event is waiting, Skip() then stands in for Render()
+	bool Silent() { return silent && !hasNext && queue.Depth() == 0; }
+	
+	// audio callback, moves the clock over a block of silence and zero fills out. Neither the voices
+	// nor the filter run, the voices only move their phases and noise seeds on (Voices::SkipBlock)
+	void Skip(float *out, size_t frames);
+	
+	// main loop, sample clock now estimated from the start of the last rendered block
+	uint32_t Now();
+	
+	uint32_t GetSampleClock() { return sampleClock; }
+	uint32_t GetQueueDepth() { return queue.Depth(); }
+	const SPSCQueue<SynthEvent, SYNTH_EVENT_QUEUE_SIZE>::Counters &GetQueueCounters() { return queue.GetCounters(); }
+	const Counters &GetCounters() { return counters; }
+	
+	// main loop, the event queue's and the renderer's counters
+	void LogCounters();
+	
+private:
+	Voices *voices;
+	Filters *filters;
+	CCMIDIMap *ccmap;
+	Profiler *profiler;
+	
+	SPSCQueue<SynthEvent, SYNTH_EVENT_QUEUE_SIZE> queue;
+	SynthEvent next;	// popped but not yet due
+	bool hasNext;
+	
+	uint32_t latency;	// samples from stamp to play, one block
+	float samplesPerCycle;
+	
+	uint32_t sampleClock;	// sample clock at the start of the next block, audio side
+	
+	uint32_t quiet;			// samples rendered with the voice idle and the output below SILENCE_PEAK
+	uint32_t silenceSamples;	// SILENCE_MS
+	bool silent;
+	
+	// the last rendered block, written by the audio callback for Now()
+	volatile uint32_t blockClock;	// sample clock at its start
+	volatile uint32_t blockCycle;	// cycle counter when its render started
+	
+	Counters counters;
+	
+	void Apply(const SynthEvent &e);
+};
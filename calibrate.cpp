@@ -0,0 +1,228 @@
+/*
+ This file is part of Virtual Robot's Pine Synthesizer. 
+
+Copyright <2022> <Brian Gunnison>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+software and associated documentation files (the "Software"), to deal in the Software 
+without restriction, including without limitation the rights to use, copy, modify, 
+merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+permit persons to whom the Software is furnished to do so, subject to the following 
+conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "daisy_pod.h"
+#include "daisysp.h"
+
+#include "utilities.h"
+#include "voice.h"
+#include "filter.h"
+#include "cyclecounter.h"
+#include "calibrate.h"
+
+using namespace daisy;
+using namespace daisysp;
+
+
+// keeps the optimiser from dropping the filtered samples
+static volatile float sink;
+
+#define VOICE_NAME(type, engine, slots, member, name, r, g, b, shortName, cost) shortName,
+static const char *voiceNames[NUM_VOICES] = { VOICE_ENGINES(VOICE_NAME) };
+#undef VOICE_NAME
+
+// the slots each engine is built with, the most the governor can put in service
+#define VOICE_SLOTS(type, engine, slots, ...) slots,
+static const uint8_t voiceSlots[NUM_VOICES] = { VOICE_ENGINES(VOICE_SLOTS) };
+#undef VOICE_SLOTS
+
+// the filter in Filters::FILTER_TYPE order, no filter costs nothing
+static const int8_t filterCost[NUM_FILTERS] = 
+{
+	-1,
+	CostCalibrator::COST_SVF,
+	CostCalibrator::COST_MOOG
+};
+
+
+void CostCalibrator::Init(Voices *v, float SR)
+{
+	voices = v;
+	sampleRate = SR;
+	
+	CycleCounterInit();
+	budget = CyclesPerSecond() / sampleRate;
+	
+	for (uint8_t i = 0; i < NUM_COSTS; i++)
+	{
+		cost[i] = 0.0;
+	}
+	
+	for (uint8_t v = 0; v < NUM_VOICES; v++)
+	{
+		for (uint8_t f = 0; f < NUM_FILTERS; f++)
+		{
+			safe[v][f] = voiceSlots[v];
+		}
+	}
+}
+
+
+const char *CostCalibrator::GetName(uint8_t item)
+{
+#define VOICE_ENGINE_NAME(type, engine, ...) #engine,
+	const char *names[NUM_COSTS] = { VOICE_ENGINES(VOICE_ENGINE_NAME) "NoiseVoice biquad", "SVFilter", "MoogFilter" };
+#undef VOICE_ENGINE_NAME
+	
+	if (item >= NUM_COSTS)
+	{
+		return "?";
+	}
+	
+	return names[item];
+}
+
+
+template<typename F>
+float CostCalibrator::MeasureFilter(F &filter)
+{
+	float buf[MAX_BLOCK_SIZE];
+	float out = 0.0;
+	uint32_t cycles = 0;
+	
+	filter.Init(sampleRate);
+	filter.SetFreq(2000);
+	filter.SetRes(0.5);
+	
+	for (uint32_t s = 0; s < CALIBRATE_SAMPLES; s += MAX_BLOCK_SIZE)
+	{
+		for (size_t i = 0; i < MAX_BLOCK_SIZE; i++)
+		{
+			buf[i] = ((s + i) & 64) ? 0.5f : -0.5f;
+		}
+		
+		uint32_t start = CycleCount();
+		filter.ProcessBlock(buf, MAX_BLOCK_SIZE);
+		cycles += CycleCount() - start;
+		
+		out += buf[0];
+	}
+	
+	sink = out;
+	return (float)cycles / CALIBRATE_SAMPLES;
+}
+
+
+// cycles per sample of one sounding slot or of a filter
+float CostCalibrator::Measure(uint8_t item)
+{
+	// voice CC function 4 picks the noise voice's filters, below 64 the Svfs
+	if (item < NUM_VOICES)
+	{
+		return voices->Measure(item, item == Voices::NOISE_VOICE ? 0 : -1, CALIBRATE_SAMPLES);
+	}
+	
+	switch (item)
+	{
+	case COST_NOISE_BIQUAD:
+		return voices->Measure(Voices::NOISE_VOICE, 127, CALIBRATE_SAMPLES);
+		
+	case COST_SVF:
+		{
+			SVFilter filter;
+			return MeasureFilter(filter);
+		}
+		
+	case COST_MOOG:
+		{
+			MoogFilter filter;
+			return MeasureFilter(filter);
+		}
+		
+	default:
+		break;
+	}
+	
+	return 0.0;
+}
+
+
+void CostCalibrator::Run()
+{
+	for (uint8_t i = 0; i < NUM_COSTS; i++)
+	{
+		cost[i] = Measure(i);
+	}
+	
+	float usable = budget * CALIBRATE_HEADROOM;
+	
+	for (uint8_t v = 0; v < NUM_VOICES; v++)
+	{
+		float slot = cost[v];
+		
+		// CC 4 may switch the noise voice to either set of filters
+		if (v == Voices::NOISE_VOICE && cost[COST_NOISE_BIQUAD] > slot)
+		{
+			slot = cost[COST_NOISE_BIQUAD];
+		}
+		
+		for (uint8_t f = 0; f < NUM_FILTERS; f++)
+		{
+			float filter = 0.0;
+			if (filterCost[f] >= 0)
+			{
+				filter = cost[filterCost[f]];
+			}
+			
+			float n = 1.0;
+			if (slot > 0.0f)
+			{
+				n = (usable - filter) / slot;
+			}
+			
+			if (n < 1.0f)
+			{
+				n = 1.0;
+			}
+			
+			if (n > voiceSlots[v])
+			{
+				n = voiceSlots[v];
+			}
+			
+			safe[v][f] = (uint8_t)n;
+		}
+	}
+}
+
+
+void CostCalibrator::Log(void (*print)(const char *format, ...))
+{
+	float nsPerCycle = 1e9f / CyclesPerSecond();
+	
+	print("Calibration: %u cycles per sample, %u%% usable", (uint32_t)budget, (uint32_t)(CALIBRATE_HEADROOM * 100));
+	
+	for (uint8_t i = 0; i < NUM_COSTS; i++)
+	{
+		print("%s: %u.%02u cycles/sample, %u ns/sample", 
+			GetName(i), 
+			(uint32_t)cost[i], 
+			(uint32_t)(cost[i] * 100) % 100, 
+			(uint32_t)(cost[i] * nsPerCycle));
+	}
+	
+	print("Safe polyphony:\tnone\tsvf\tmoog");
+	for (uint8_t v = 0; v < NUM_VOICES; v++)
+	{
+		print("%s:\t%d\t%d\t%d", voiceNames[v], safe[v][Filters::NO_FILTER], safe[v][Filters::SV_FILTER], safe[v][Filters::MOOG_FILTER]);
+	}
+}
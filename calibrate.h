@@ -0,0 +1,87 @@
+/*
+ This file is part of Virtual Robot's Pine Synthesizer. 
+
+Copyright <2022> <Brian Gunnison>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+software and associated documentation files (the "Software"), to deal in the Software 
+without restriction, including without limitation the rights to use, copy, modify, 
+merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+permit persons to whom the Software is furnished to do so, subject to the following 
+conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include "daisy_pod.h"
+#include "daisysp.h"
+
+#include "utilities.h"
+#include "voice.h"
+#include "filter.h"
+
+using namespace daisy;
+using namespace daisysp;
+
+#define CALIBRATE_SAMPLES	4800	// samples each engine and filter runs for, 0.1 sec of audio
+#define CALIBRATE_HEADROOM	0.80f	// share of a sample's cycle budget the voice and filter may use
+
+
+// Benchmarks every voice engine and filter at boot, in cycles per sample, and derives the safe
+// polyphony of each voice and filter combination so the limits follow DaisySP and compiler changes.
+// The engines are the ones that play, built in the voice arena and rendered through their ProcessBlock().
+// Builds for the seed and for the host, see cyclecounter.h.
+class CostCalibrator
+{
+public:
+	typedef enum
+	{
+		// one slot of each voice in Voices::VOICE_TYPE order, the noise voice with its Svfs
+#define VOICE_COST_ITEM(type, engine, slots, member, name, r, g, b, shortName, cost) COST_##cost,
+		VOICE_ENGINES(VOICE_COST_ITEM)
+#undef VOICE_COST_ITEM
+		COST_NOISE_BIQUAD,	// one noise voice slot with its biquads (voice CC function 4)
+		COST_SVF,		// SVFilter, the state variable filter
+		COST_MOOG,		// MoogFilter, the moog filter
+		NUM_COSTS
+	}COST_ITEM;
+	
+	// voices lends its arena to the engines being timed, call before audio starts
+	void Init(Voices *v, float SR);
+	
+	// runs every item for CALIBRATE_SAMPLES, takes a few msec on the seed
+	void Run();
+	
+	float GetCost(uint8_t item) { return cost[item]; } // cycles per sample
+	float GetBudget() { return budget; } // cycles per sample the audio rate allows
+	const char *GetName(uint8_t item);
+	
+	// voice is a Voices::VOICE_TYPE, filter a Filters::FILTER_TYPE
+	uint8_t GetSafePolyphony(uint8_t voice, uint8_t filter) { return safe[voice][filter]; }
+	
+	// the costs and the safe polyphony table. print is log() on the seed, a host tool passes its
+	// own line printer (pine_bench --calibrate)
+	void Log(void (*print)(const char *format, ...) = log);
+	
+private:
+	Voices *voices;
+	float sampleRate;
+	float budget;
+	float cost[NUM_COSTS];
+	uint8_t safe[NUM_VOICES][NUM_FILTERS];
+	
+	float Measure(uint8_t item);
+	
+	// a filter's ProcessBlock() over a square wave, on the stack
+	template<typename F>
+	float MeasureFilter(F &filter);
+};
@@ -22,6 +22,7 @@ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
 SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 #include <stdint.h>
+#include <atomic>
 #include "daisy_pod.h"
 #include "voice.h"
 #include "filter.h"
@@ -89,6 +90,22 @@ void ControlMap::Init(DaisyPod *phw, Voices *pvoices, Filters *pfilts, float *pg
 	button2 = 0;
 	
 	knobsChanged = false;
+	
+	next.seq = 0;
+	next.voiceSteps = 0;
+	next.filterSteps = 0;
+	next.voice = voices->GetSelector();
+	next.page = 0;
+	next.live = false;
+	next.pot[0] = 0.0;
+	next.pot[1] = 0.0;
+	snapshot[0] = next;
+	snapshot[1] = next;
+	front = 0;
+	
+	appliedSeq = 0;
+	appliedVoiceSteps = 0;
+	appliedFilterSteps = 0;
 
 	SetLEDs(RED_ON, RED_ON);
 	log("Control map init");		
@@ -128,11 +145,11 @@ void ControlMap::Control()
 	switch (button1)
 	{
 	case 0:
-		voices->Select(selector);
+		next.voiceSteps += selector;
 		break;
 		
 	case 1:
-		filters->Select(selector);
+		next.filterSteps += selector;
 		break;
 		
 	case 2:
@@ -181,6 +198,8 @@ void ControlMap::Control()
 	}
 
 	
+	next.page = button2;
+	
 	if (knobsChanged)
 	{
 		// allow knob changes only if a knob was turned significantly so we don't jump to the previous knob setting
@@ -190,31 +209,112 @@ void ControlMap::Control()
 		}
 		else
 		{
+			next.live = false;
+			Publish();
 			return;
 		}
 	}
 	
+	next.live = true;
+	
+	// the voice selection changes in the audio callback, it may lag the encoder by a snapshot
+	next.voice = voices->GetSelector();
 
 	switch (button2)
 	{
 	case 0:
-		*gainL = gainLeftPot.Process();
-		*gainR = gainRightPot.Process();
+		next.pot[0] = gainLeftPot.Process();
+		next.pot[1] = gainRightPot.Process();
 		break;
 		
 	case 1:
-		filters->ProcessFreq();
-		filters->ProcessRes();
+		next.pot[0] = filters->ReadFreq();
+		next.pot[1] = filters->ReadRes();
 		break;
 		
 	case 3:
-		voices->ProcessParm0();
-		voices->ProcessParm1();
+		next.pot[0] = voices->ReadParm(next.voice, 0);
+		next.pot[1] = voices->ReadParm(next.voice, 1);
 		break;
 		
 	case 4:
-		voices->ProcessParm2();
-		voices->ProcessParm3();
+		next.pot[0] = voices->ReadParm(next.voice, 2);
+		next.pot[1] = voices->ReadParm(next.voice, 3);
+		break;
+		
+	default:
+		break;
+	}
+	
+	Publish();
+}
+
+
+void ControlMap::Publish()
+{
+	// the audio callback preempts the control task, never the other way round, so it
+	// always sees a whole snapshot
+	next.seq++;
+	uint8_t back = front ^ 1;
+	snapshot[back] = next;
+	std::atomic_signal_fence(std::memory_order_release);
+	front = back;
+}
+
+
+void ControlMap::Apply()
+{
+	const ControlSnapshot &s = snapshot[front];
+	
+	if (s.seq == appliedSeq)
+	{
+		return;
+	}
+	
+	appliedSeq = s.seq;
+	
+	// one step at a time, Select() wraps by one
+	while (appliedVoiceSteps != s.voiceSteps)
+	{
+		int8_t step = (int8_t)(s.voiceSteps - appliedVoiceSteps) > 0 ? 1 : -1;
+		voices->Select(step);
+		appliedVoiceSteps += step;
+	}
+	
+	while (appliedFilterSteps != s.filterSteps)
+	{
+		int8_t step = (int8_t)(s.filterSteps - appliedFilterSteps) > 0 ? 1 : -1;
+		filters->Select(step);
+		appliedFilterSteps += step;
+	}
+	
+	if (!s.live)
+	{
+		return;
+	}
+	
+	switch (s.page)
+	{
+	case 0:
+		*gainL = s.pot[0];
+		*gainR = s.pot[1];
+		break;
+		
+	case 1:
+		filters->ApplyFreq(s.pot[0]);
+		filters->ApplyRes(s.pot[1]);
+		break;
+		
+	case 3:
+	case 4:
+		// read for a voice that has since been switched away from
+		if (s.voice != voices->GetSelector())
+		{
+			break;
+		}
+		
+		voices->ApplyParm(s.page == 3 ? 0 : 2, s.pot[0]);
+		voices->ApplyParm(s.page == 3 ? 1 : 3, s.pot[1]);
 		break;
 		
 	default:
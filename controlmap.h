@@ -29,15 +29,34 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 
 
+// what the control task hands the audio callback, published whole through a double buffer
+typedef struct
+{
+	uint32_t seq;			// bumped every publish, the audio side applies a snapshot once
+	uint8_t voiceSteps;		// running sum of encoder steps while selecting voices
+	uint8_t filterSteps;	// running sum of encoder steps while selecting filters
+	uint8_t voice;			// voice the parameters were read for
+	uint8_t page;			// button 2 setting, what the pots drive
+	bool live;				// the pots have moved since the page changed
+	float pot[2];			// the page's two parameters mapped to their ranges
+}ControlSnapshot;
+
+
 // control map - maps the pod knobs to voice or filter parms based on selector knob
+// Control() runs in the control task and only reads the pod, Apply() runs in the audio callback
+// and is the only place voice, filter and gain settings change
 class ControlMap
 {
 public:
 	
 	void Init(DaisyPod *hw, Voices *voice, Filters *filt, float *gl, float *gr);
 	
+	// control task, after the pod controls are processed
 	void Control();
 	
+	// audio callback, applies the latest snapshot if it has not been applied yet
+	void Apply();
+	
 	
 private:
 	
@@ -56,9 +75,15 @@ private:
 	float knob1LastValue;
 	float knob2LastValue;
 
-
-		
-
+	// the audio side only reads snapshot[front], the control task fills the other and flips front
+	ControlSnapshot snapshot[2];
+	volatile uint8_t front;
+	ControlSnapshot next;	// control task's working copy
 	
+	// audio side
+	uint32_t appliedSeq;
+	uint8_t appliedVoiceSteps;
+	uint8_t appliedFilterSteps;
 	
+	void Publish();
 };
@@ -0,0 +1,88 @@
+/*
+ This file is part of Virtual Robot's Pine Synthesizer. 
+
+Copyright <2022> <Brian Gunnison>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+software and associated documentation files (the "Software"), to deal in the Software 
+without restriction, including without limitation the rights to use, copy, modify, 
+merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+permit persons to whom the Software is furnished to do so, subject to the following 
+conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <stdint.h>
+
+// A free running cycle counter for timing DSP code.
+// On the seed it is the Cortex-M7 DWT counter (CPU clocks), on a host build the x86 time stamp
+// counter or, elsewhere, std::chrono nanoseconds. Differences of CycleCount() are valid across wrap.
+
+#if defined(CORE_CM7)
+
+inline void CycleCounterInit()
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->LAR = 0xC5ACCE55; // the M7 DWT is locked after reset
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+inline uint32_t CycleCount() { return DWT->CYCCNT; }
+
+inline float CyclesPerSecond() { return (float)SystemCoreClock; }
+
+#else
+
+#include <chrono>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+
+inline uint32_t CycleCount() { return (uint32_t)__rdtsc(); }
+
+// the TSC rate is not exposed, measure it against the steady clock once
+inline float &CycleCounterRate()
+{
+	static float rate = 0.0;
+	return rate;
+}
+
+inline void CycleCounterInit()
+{
+	auto start = std::chrono::steady_clock::now();
+	uint64_t c0 = __rdtsc();
+	while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(20))
+	{
+	}
+	uint64_t c1 = __rdtsc();
+	double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	CycleCounterRate() = (float)((c1 - c0) / ns * 1e9);
+}
+
+inline float CyclesPerSecond() { return CycleCounterRate(); }
+
+#else
+
+inline void CycleCounterInit() {}
+
+inline uint32_t CycleCount()
+{
+	return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline float CyclesPerSecond() { return 1e9f; }
+
+#endif
+
+#endif
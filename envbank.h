@@ -0,0 +1,311 @@
+/*
+ This file is part of Virtual Robot's Pine Synthesizer. 
+
+Copyright <2022> <Brian Gunnison>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+software and associated documentation files (the "Software"), to deal in the Software 
+without restriction, including without limitation the rights to use, copy, modify, 
+merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+permit persons to whom the Software is furnished to do so, subject to the following 
+conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+#include "daisysp.h"
+#include "fastmath.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+using namespace daisysp;
+
+// The ADSR of every slot as structure of arrays, advanced together a block at a time.
+// The segment each slot is in is looked at once per block: the block is rendered with every
+// lane's coefficients fixed, the lane loop has no branches and vectorises, and only a lane
+// whose envelope crossed a segment end in the block (at most one or two per note) is rendered
+// again a sample at a time. AVX2 runs 8 slots at a time and SSE2 4 on a host build, the
+// Cortex-M7 an FPU loop unrolled over 4 slots. Sample for sample the same as DaisySP's Adsr,
+// whose segments (ADSR_SEG_*) it uses, with FAST_MATH 0, the coefficients come from FastExp and
+// FastLog otherwise. The engines set one attack, decay, sustain and release for every slot.
+template<uint8_t N>
+class EnvelopeBank
+{
+public:
+	// as SawBank::LANES (oscbank.h), the spare lanes stay idle
+	static constexpr uint8_t LANES = (N + 7) & ~7;
+	
+	void Init(float SR)
+	{
+		sampleRate = SR; // an int as in Adsr
+		attackTime = -1.0f;
+		decayTime = -1.0f;
+		releaseTime = -1.0f;
+		sustain = 0.7f;
+		
+		for (uint8_t i = 0; i < LANES; i++)
+		{
+			x[i] = 0.0f;
+			mode[i] = ADSR_SEG_IDLE;
+			gate[i] = false;
+		}
+		
+		SetAttackTime(0.1f);
+		SetDecayTime(0.1f);
+		SetReleaseTime(0.1f);
+	}
+	
+	void SetAttackTime(float t)
+	{
+		if (t == attackTime)
+		{
+			return;
+		}
+		
+		// Adsr with an attack shape of 0
+		attackTime = t;
+		attackTarget = 1.01f;
+		attackD0 = t > 0.0f ? 1.0f - MathExp(MathLog(1.0f - (1.0f / attackTarget)) / (t * sampleRate)) : 1.0f;
+	}
+	
+	void SetDecayTime(float t) { SetTimeConstant(t, decayTime, decayD0); }
+	void SetReleaseTime(float t) { SetTimeConstant(t, releaseTime, releaseD0); }
+	void SetSustainLevel(float s) { sustain = (s <= 0.0f) ? -0.01f : s > 1.0f ? 1.0f : s; }
+	
+	// back to attack from the level it is at
+	void Retrigger(uint8_t i) { mode[i] = ADSR_SEG_ATTACK; }
+	
+	bool IsRunning(uint8_t i) { return mode[i] != ADSR_SEG_IDLE; }
+	
+	// the gate of slot i for the next Render(), an edge starts attack or release as Adsr::Process does
+	void SetGate(uint8_t i, bool g)
+	{
+		if (g && !gate[i])
+		{
+			mode[i] = ADSR_SEG_ATTACK;
+		}
+		else if (!g && gate[i])
+		{
+			mode[i] = ADSR_SEG_RELEASE;
+		}
+		gate[i] = g;
+	}
+	
+	// one sample of slot i, Adsr::Process(g)
+	float Process(uint8_t i, bool g)
+	{
+		SetGate(i, g);
+		return Step(i);
+	}
+	
+	// n samples of every slot's gain into out, sample major: out[s * LANES + i] is slot i at sample s
+	void Render(float *out, size_t n)
+	{
+		float start[LANES];
+		
+		// an idle lane has d0 0 and level 0, so it renders 0 without a branch
+		for (uint8_t i = 0; i < LANES; i++)
+		{
+			Coefficients(i, d0[i], target[i]);
+			start[i] = x[i];
+		}
+		
+		RenderLanes(out, n);
+		
+		for (uint8_t i = 0; i < LANES; i++)
+		{
+			// each segment moves one way, so only the last sample can show it ended in the block
+			bool ended = (mode[i] == ADSR_SEG_ATTACK && x[i] > 1.0f) || 
+						 ((mode[i] == ADSR_SEG_DECAY || mode[i] == ADSR_SEG_RELEASE) && x[i] < 0.0f);
+			
+			if (ended)
+			{
+				x[i] = start[i];
+				for (size_t s = 0; s < n; s++)
+				{
+					out[s * LANES + i] = Step(i);
+				}
+			}
+		}
+	}
+	
+private:
+	alignas(32) float x[LANES];
+	alignas(32) float d0[LANES]; // the segment's coefficient and target, fixed over a Render()
+	alignas(32) float target[LANES];
+	uint8_t mode[LANES];
+	bool gate[LANES];
+	
+	int sampleRate;
+	float attackTime, decayTime, releaseTime;
+	float attackD0, decayD0, releaseD0;
+	float attackTarget;
+	float sustain;
+	
+	void SetTimeConstant(float t, float &time, float &coeff)
+	{
+		if (t == time)
+		{
+			return;
+		}
+		
+		time = t;
+		coeff = t > 0.0f ? 1.0f - MathExp(MathLog(1. / M_E) / (t * sampleRate)) : 1.0f;
+	}
+	
+	void Coefficients(uint8_t i, float &coeff, float &to)
+	{
+		switch (mode[i])
+		{
+		case ADSR_SEG_ATTACK:
+			coeff = attackD0;
+			to = attackTarget;
+			break;
+			
+		case ADSR_SEG_DECAY:
+			coeff = decayD0;
+			to = sustain;
+			break;
+			
+		case ADSR_SEG_RELEASE:
+			coeff = releaseD0;
+			to = -0.01f;
+			break;
+			
+		default:
+			coeff = 0.0f;
+			to = 0.0f;
+			break;
+		}
+	}
+	
+	// every lane n samples on with its d0 and target, x left at the last sample
+	void RenderLanes(float *out, size_t n);
+	
+	// Adsr::Process after the gate
+	float Step(uint8_t i)
+	{
+		float coeff, to;
+		Coefficients(i, coeff, to);
+		
+		switch (mode[i])
+		{
+		case ADSR_SEG_ATTACK:
+			x[i] += coeff * (to - x[i]);
+			if (x[i] > 1.0f)
+			{
+				x[i] = 1.0f;
+				mode[i] = ADSR_SEG_DECAY;
+			}
+			return x[i];
+			
+		case ADSR_SEG_DECAY:
+		case ADSR_SEG_RELEASE:
+			x[i] += coeff * (to - x[i]);
+			if (x[i] < 0.0f)
+			{
+				x[i] = 0.0f;
+				mode[i] = ADSR_SEG_IDLE;
+			}
+			return x[i];
+			
+		default:
+			return 0.0f;
+		}
+	}
+};
+
+
+#if defined(__AVX2__)
+
+template<uint8_t N>
+void EnvelopeBank<N>::RenderLanes(float *out, size_t n)
+{
+	for (uint8_t l = 0; l < LANES; l += 8)
+	{
+		__m256 level = _mm256_load_ps(x + l);
+		__m256 c = _mm256_load_ps(d0 + l);
+		__m256 to = _mm256_load_ps(target + l);
+		
+		for (size_t s = 0; s < n; s++)
+		{
+			// mul then add as Adsr, a fused multiply add would round differently
+			level = _mm256_add_ps(level, _mm256_mul_ps(c, _mm256_sub_ps(to, level)));
+			_mm256_storeu_ps(out + s * LANES + l, level);
+		}
+		
+		_mm256_store_ps(x + l, level);
+	}
+}
+
+#elif defined(__SSE2__)
+
+template<uint8_t N>
+void EnvelopeBank<N>::RenderLanes(float *out, size_t n)
+{
+	for (uint8_t l = 0; l < LANES; l += 4)
+	{
+		__m128 level = _mm_load_ps(x + l);
+		__m128 c = _mm_load_ps(d0 + l);
+		__m128 to = _mm_load_ps(target + l);
+		
+		for (size_t s = 0; s < n; s++)
+		{
+			level = _mm_add_ps(level, _mm_mul_ps(c, _mm_sub_ps(to, level)));
+			_mm_storeu_ps(out + s * LANES + l, level);
+		}
+		
+		_mm_store_ps(x + l, level);
+	}
+}
+
+#else
+
+template<uint8_t N>
+void EnvelopeBank<N>::RenderLanes(float *out, size_t n)
+{
+	// 4 envelopes at a time, as SawBank's scalar Render()
+	for (uint8_t l = 0; l < LANES; l += 4)
+	{
+		float level[4], c[4], to[4];
+		
+		for (uint8_t k = 0; k < 4; k++)
+		{
+			level[k] = x[l + k];
+			c[k] = d0[l + k];
+			to[k] = target[l + k];
+		}
+		
+		for (size_t s = 0; s < n; s++)
+		{
+#pragma GCC unroll 4
+			for (uint8_t k = 0; k < 4; k++)
+			{
+				level[k] += c[k] * (to[k] - level[k]);
+				out[s * LANES + l + k] = level[k];
+			}
+		}
+		
+		for (uint8_t k = 0; k < 4; k++)
+		{
+			x[l + k] = level[k];
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,128 @@
+/*
+ This file is part of Virtual Robot's Pine Synthesizer. 
+
+Copyright <2022> <Brian Gunnison>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+software and associated documentation files (the "Software"), to deal in the Software 
+without restriction, including without limitation the rights to use, copy, modify, 
+merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+permit persons to whom the Software is furnished to do so, subject to the following 
+conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+// what the main loop sends the audio callback, everything that touches synthesis state
+typedef enum
+{
+	SYNTH_EVENT_NOTE_ON,
+	SYNTH_EVENT_NOTE_OFF,
+	SYNTH_EVENT_CC
+}SYNTH_EVENT_TYPE;
+
+// a mapped MIDI message, small enough to copy by value through the queue
+typedef struct
+{
+	uint32_t timestamp;	// sample clock on arrival, see BlockRenderer
+	uint8_t type;		// SYNTH_EVENT_TYPE
+	uint8_t channel;
+	uint8_t data0;		// note or CC number
+	uint8_t data1;		// velocity or CC value
+}SynthEvent;
+
+
+// Wait-free single producer, single consumer ring. One context may only Push, the other only Pop.
+// N must be a power of two, one slot is never used so a full ring holds N - 1 items.
+// The counters are written by the producer only, the consumer may read them for logging.
+template <typename T, size_t N>
+class SPSCQueue
+{
+	static_assert((N & (N - 1)) == 0, "SPSCQueue size must be a power of two");
+	
+public:
+	typedef struct
+	{
+		uint32_t pushed;	// items accepted
+		uint32_t overflows;	// items dropped because the ring was full
+		uint32_t maxDepth;	// most items waiting at once
+	}Counters;
+	
+	void Init()
+	{
+		head.store(0, std::memory_order_relaxed);
+		tail.store(0, std::memory_order_relaxed);
+		counters.pushed = 0;
+		counters.overflows = 0;
+		counters.maxDepth = 0;
+	}
+	
+	// producer side, false and counted as an overflow if the ring is full
+	bool Push(const T &item)
+	{
+		uint32_t h = head.load(std::memory_order_relaxed);
+		uint32_t t = tail.load(std::memory_order_acquire);
+		
+		if (((h + 1) & (N - 1)) == t)
+		{
+			counters.overflows++;
+			return false;
+		}
+		
+		buffer[h] = item;
+		head.store((h + 1) & (N - 1), std::memory_order_release);
+		
+		counters.pushed++;
+		uint32_t depth = ((h + 1) - t) & (N - 1);
+		if (depth > counters.maxDepth)
+		{
+			counters.maxDepth = depth;
+		}
+		
+		return true;
+	}
+	
+	// consumer side, false if there is nothing waiting
+	bool Pop(T &item)
+	{
+		uint32_t t = tail.load(std::memory_order_relaxed);
+		uint32_t h = head.load(std::memory_order_acquire);
+		
+		if (t == h)
+		{
+			return false;
+		}
+		
+		item = buffer[t];
+		tail.store((t + 1) & (N - 1), std::memory_order_release);
+		
+		return true;
+	}
+	
+	// items waiting, exact from either side only as of the call
+	uint32_t Depth()
+	{
+		return (head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire)) & (N - 1);
+	}
+	
+	const Counters &GetCounters() { return counters; }
+	
+private:
+	T buffer[N];
+	std::atomic<uint32_t> head;	// next slot the producer writes
+	std::atomic<uint32_t> tail;	// next slot the consumer reads
+	Counters counters;
+};
@@ -0,0 +1,233 @@
+/*
+ This file is part of Virtual Robot's Pine Synthesizer. 
+
+Copyright <2022> <Brian Gunnison>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+software and associated documentation files (the "Software"), to deal in the Software 
+without restriction, including without limitation the rights to use, copy, modify, 
+merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+permit persons to whom the Software is furnished to do so, subject to the following 
+conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include <math.h>
+#include "daisy_pod.h"
+#include "daisysp.h"
+
+#include "utilities.h"
+#include "cyclecounter.h"
+#include "fastmath.h"
+
+using namespace daisy;
+using namespace daisysp;
+
+
+const float fastExp2Table[32] = 
+{
+	1.0f, 1.02189715f, 1.04427378f, 1.0671404f, 1.09050773f, 1.11438674f, 1.13878863f, 1.16372486f,
+	1.18920712f, 1.21524736f, 1.24185781f, 1.26905096f, 1.29683955f, 1.32523664f, 1.35425555f, 1.38390988f,
+	1.41421356f, 1.44518081f, 1.47682615f, 1.50916443f, 1.54221083f, 1.57598085f, 1.61049033f, 1.64575548f,
+	1.68179283f, 1.7186193f, 1.75625216f, 1.79470908f, 1.83400809f, 1.87416763f, 1.91520656f, 1.95714412f,
+};
+
+// 1 / c rounded to a float, log2(c) is -log2 of that rounded value so m * (1 / c) and log2(c) agree
+const float fastLog2RecipTable[32] = 
+{
+	0.984615386f, 0.955223858f, 0.927536249f, 0.901408434f, 0.876712322f, 0.853333354f, 0.83116883f, 0.810126603f,
+	0.790123463f, 0.771084309f, 0.752941191f, 0.735632181f, 0.719101131f, 0.703296721f, 0.688172042f, 0.673684239f,
+	0.659793794f, 0.646464646f, 0.633663356f, 0.621359229f, 0.609523833f, 0.598130822f, 0.587155938f, 0.576576591f,
+	0.566371679f, 0.556521714f, 0.547008574f, 0.537815154f, 0.528925598f, 0.520325184f, 0.512000024f, 0.503937006f,
+};
+
+const float fastLog2Table[32] = 
+{
+	0.0223678117f, 0.066089224f, 0.10852443f, 0.149747146f, 0.18982457f, 0.228818656f, 0.266786542f, 0.303780712f,
+	0.339849992f, 0.375039485f, 0.409390908f, 0.442943501f, 0.475733416f, 0.507794604f, 0.539158812f, 0.569855547f,
+	0.599912887f, 0.629356621f, 0.658211506f, 0.686500514f, 0.714245463f, 0.741467032f, 0.768184387f, 0.794415831f,
+	0.820178968f, 0.845490117f, 0.870364648f, 0.894817689f, 0.918863298f, 0.942514559f, 0.965784216f, 0.988684692f,
+};
+
+// DaisySP's mtof of each note, powf(2, (m - 69) / 12) * 440 as float libm rounds it, so a whole
+// note is the same frequency with FAST_MATH on or off
+const float fastMtofTable[128] = 
+{
+	8.17579842f, 8.66195774f, 9.17702293f, 9.72271824f, 10.3008623f, 10.9133816f, 11.5623255f, 12.2498589f,
+	12.9782696f, 13.75f, 14.5676203f, 15.4338512f, 16.3515968f, 17.3239155f, 18.3540459f, 19.4454365f,
+	20.6017246f, 21.8267632f, 23.124651f, 24.4997177f, 25.9565392f, 27.5f, 29.1352329f, 30.8677101f,
+	32.7031937f, 34.6478271f, 36.7080994f, 38.890873f, 41.2034416f, 43.6535301f, 46.2493019f, 48.999424f,
+	51.9130898f, 55.0f, 58.2704659f, 61.7354202f, 65.4063873f, 69.2956543f, 73.4161987f, 77.7817459f,
+	82.4068832f, 87.3070602f, 92.4986038f, 97.998848f, 103.82618f, 110.0f, 116.540947f, 123.470825f,
+	130.812775f, 138.591324f, 146.832382f, 155.563492f, 164.813782f, 174.61412f, 184.997208f, 195.997726f,
+	207.652344f, 220.0f, 233.081863f, 246.94165f, 261.625549f, 277.182648f, 293.664764f, 311.126984f,
+	329.627563f, 349.228241f, 369.994415f, 391.995422f, 415.304688f, 440.0f, 466.163788f, 493.883301f,
+	523.251099f, 554.365295f, 587.329529f, 622.253967f, 659.255127f, 698.456482f, 739.988831f, 783.990845f,
+	830.609375f, 880.0f, 932.327576f, 987.766602f, 1046.5022f, 1108.73059f, 1174.65906f, 1244.50793f,
+	1318.51025f, 1396.91296f, 1479.97766f, 1567.98181f, 1661.21875f, 1760.0f, 1864.65491f, 1975.53345f,
+	2093.00439f, 2217.46094f, 2349.31836f, 2489.01587f, 2637.02026f, 2793.82593f, 2959.95532f, 3135.96313f,
+	3322.43774f, 3520.0f, 3729.30981f, 3951.06689f, 4186.00879f, 4434.92188f, 4698.63672f, 4978.03174f,
+	5274.04053f, 5587.65186f, 5919.91064f, 6271.92627f, 6644.87549f, 7040.0f, 7458.62158f, 7902.13184f,
+	8372.01758f, 8869.84473f, 9397.27148f, 9956.06348f, 10548.083f, 11175.3027f, 11839.8213f, 12543.8555f,
+};
+
+// keeps the optimiser from dropping the timed calls
+static volatile float sink;
+
+
+// the sweep's j-th argument evenly from lo to hi
+static float Sweep(float lo, float hi, uint32_t j)
+{
+	return lo + (hi - lo) * (float)j / (float)(FAST_MATH_SWEEP - 1);
+}
+
+// largest error of fast against the double precision ref over the sweep from lo to hi, relative to
+// ref where |ref| is over floor and absolute below, floor 0 is relative throughout and 1 absolute
+// for sin and tanh. logScale sweeps 2^lo to 2^hi
+template<typename Fast, typename Ref>
+static float MaxError(Fast fast, Ref ref, float lo, float hi, double floor, bool logScale)
+{
+	double worst = 0.0;
+	
+	for (uint32_t j = 0; j < FAST_MATH_SWEEP; j++)
+	{
+		float x = Sweep(lo, hi, j);
+		if (logScale)
+		{
+			x = (float)exp2((double)x);
+		}
+		
+		double r = ref((double)x);
+		double e = fabs((double)fast(x) - r) / fmax(fabs(r), floor);
+		worst = e > worst ? e : worst;
+	}
+	
+	return (float)worst;
+}
+
+// cycles per call of f over the sweep from lo to hi, the loop around it costs the same for
+// the libm function and the approximation
+template<typename F>
+static float Cycles(F f, float lo, float hi)
+{
+	float step = (hi - lo) / FAST_MATH_SWEEP;
+	float x = lo;
+	float sum = 0.0f;
+	
+	uint32_t start = CycleCount();
+	for (uint32_t j = 0; j < FAST_MATH_SWEEP; j++)
+	{
+		sum += f(x);
+		x += step;
+	}
+	uint32_t stop = CycleCount();
+	
+	sink = sum;
+	return (float)(stop - start) / FAST_MATH_SWEEP;
+}
+
+
+uint8_t FastMathCheck(FastMathResult *results)
+{
+	CycleCounterInit();
+	
+	const float pi100 = 100.0f * PI_F;
+	FastMathResult *r;
+	
+	r = &results[FAST_SIN];
+	r->name = "sin";
+	r->bound = FAST_SIN_ERROR;
+	r->maxError = MaxError([](float x) { return FastSin(x); }, [](double x) { return sin(x); }, -pi100, pi100, 1.0, false);
+	r->libmCycles = Cycles([](float x) { return sinf(x); }, -PI_F, PI_F);
+	r->fastCycles = Cycles([](float x) { return FastSin(x); }, -PI_F, PI_F);
+	
+	r = &results[FAST_COS];
+	r->name = "cos";
+	r->bound = FAST_SIN_ERROR;
+	r->maxError = MaxError([](float x) { return FastCos(x); }, [](double x) { return cos(x); }, -pi100, pi100, 1.0, false);
+	r->libmCycles = Cycles([](float x) { return cosf(x); }, -PI_F, PI_F);
+	r->fastCycles = Cycles([](float x) { return FastCos(x); }, -PI_F, PI_F);
+	
+	r = &results[FAST_EXP2];
+	r->name = "exp2";
+	r->bound = FAST_EXP2_ERROR;
+	r->maxError = MaxError([](float x) { return FastExp2(x); }, [](double x) { return exp2(x); }, -126.0f, 127.0f, 0.0, false);
+	r->libmCycles = Cycles([](float x) { return exp2f(x); }, -10.0f, 10.0f);
+	r->fastCycles = Cycles([](float x) { return FastExp2(x); }, -10.0f, 10.0f);
+	
+	r = &results[FAST_LOG2];
+	r->name = "log2";
+	r->bound = FAST_LOG2_ERROR;
+	r->maxError = MaxError([](float x) { return FastLog2(x); }, [](double x) { return log2(x); }, -126.0f, 127.0f, 1.0, true);
+	r->libmCycles = Cycles([](float x) { return log2f(x); }, 0.001f, 1000.0f);
+	r->fastCycles = Cycles([](float x) { return FastLog2(x); }, 0.001f, 1000.0f);
+	
+	// b from 0.01 to 100 for each of 9 exponents from -2 to 2
+	r = &results[FAST_POW];
+	r->name = "pow";
+	r->bound = FAST_POW_ERROR;
+	r->maxError = 0.0f;
+	for (int8_t k = -4; k <= 4; k++)
+	{
+		float e = k * 0.5f;
+		float err = MaxError([e](float b) { return FastPow(b, e); }, [e](double b) { return pow(b, (double)e); }, -6.64385619f, 6.64385619f, 0.0, true);
+		r->maxError = err > r->maxError ? err : r->maxError;
+	}
+	r->libmCycles = Cycles([](float b) { return powf(b, 0.25f); }, 0.0f, 1.0f);
+	r->fastCycles = Cycles([](float b) { return FastPow(b, 0.25f); }, 0.0f, 1.0f);
+	
+	r = &results[FAST_TANH];
+	r->name = "tanh";
+	r->bound = FAST_TANH_ERROR;
+	r->maxError = MaxError([](float x) { return FastTanh(x); }, [](double x) { return tanh(x); }, -12.0f, 12.0f, 1.0, false);
+	r->libmCycles = Cycles([](float x) { return tanhf(x); }, -4.0f, 4.0f);
+	r->fastCycles = Cycles([](float x) { return FastTanh(x); }, -4.0f, 4.0f);
+	
+	r = &results[FAST_MTOF];
+	r->name = "mtof";
+	r->bound = FAST_MTOF_ERROR;
+	r->maxError = MaxError([](float n) { return FastMtof(n); }, [](double n) { return 440.0 * exp2((n - 69.0) / 12.0); }, 0.0f, 127.0f, 0.0, false);
+	r->libmCycles = Cycles([](float n) { return mtof(n); }, 0.0f, 127.0f);
+	r->fastCycles = Cycles([](float n) { return FastMtof(n); }, 0.0f, 127.0f);
+	
+	uint8_t failed = 0;
+	for (uint8_t i = 0; i < NUM_FAST_FUNCTIONS; i++)
+	{
+		if (results[i].maxError > results[i].bound)
+		{
+			failed++;
+		}
+	}
+	
+	return failed;
+}
+
+
+void FastMathLog()
+{
+	FastMathResult results[NUM_FAST_FUNCTIONS];
+	uint8_t failed = FastMathCheck(results);
+	
+	log("Fast math %s, %d of %d past their error bound", FAST_MATH ? "on" : "off", failed, NUM_FAST_FUNCTIONS);
+	
+	// errors in parts per billion, log() has no floats
+	for (uint8_t i = 0; i < NUM_FAST_FUNCTIONS; i++)
+	{
+		const FastMathResult &r = results[i];
+		log("%s: error %u of %u e-9%s, libm %u.%02u cycles, fast %u.%02u cycles", 
+			r.name, 
+			(uint32_t)(r.maxError * 1e9f), 
+			(uint32_t)(r.bound * 1e9f), 
+			r.maxError > r.bound ? " FAILED" : "", 
+			(uint32_t)r.libmCycles, (uint32_t)(r.libmCycles * 100) % 100, 
+			(uint32_t)r.fastCycles, (uint32_t)(r.fastCycles * 100) % 100);
+	}
+}
@@ -0,0 +1,243 @@
+/*
+ This file is part of Virtual Robot's Pine Synthesizer. 
+
+Copyright <2022> <Brian Gunnison>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+software and associated documentation files (the "Software"), to deal in the Software 
+without restriction, including without limitation the rights to use, copy, modify, 
+merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+permit persons to whom the Software is furnished to do so, subject to the following 
+conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include "daisysp.h"
+
+// Polynomial and table approximations of the transcendental functions the voices and filters
+// work out their coefficients with, in place of newlib's float libm which is slow on the M7.
+// Every function is branch light straight line code, the errors below are the largest measured
+// against double precision libm over the range given, FastMathCheck() sweeps them again.
+//
+// The voice and filter code calls the Math*() switches at the bottom, FAST_MATH picks between
+// these and libm (the host build sets it with -DPINE_FAST_MATH=ON/OFF). DaisySP's own modules,
+// Svf::SetFreq and the rest, keep calling libm. The Moog filter is a ladder of our own (ladder.h)
+// so its tanh stages can take MathTanh.
+
+// 1 the voices and filters use the approximations, 0 libm and DaisySP's mtof
+#ifndef FAST_MATH
+#define FAST_MATH 1
+#endif
+
+// documented maximum errors, FastMathCheck() fails a function that goes past its bound
+#define FAST_SIN_ERROR		2.0e-7f		// absolute, |x| <= 100 pi, FastSin and FastCos
+#define FAST_EXP2_ERROR		2.5e-7f		// relative, -126 <= x <= 127
+#define FAST_LOG2_ERROR		2.5e-7f		// absolute where |log2(x)| < 1 and relative above, x a normal float > 0
+#define FAST_POW_ERROR		1.5e-6f		// relative, 0.01 <= b <= 100, |e| <= 2
+#define FAST_TANH_ERROR		2.0e-7f		// absolute, any x
+#define FAST_MTOF_ERROR		4.5e-7f		// relative, notes 0 to 127 and between
+
+#define FAST_PI_HI		3.140625f			// pi in two parts, k * FAST_PI_HI is exact for |k| < 2^15
+#define FAST_PI_LO		9.67653589793e-4f
+#define FAST_INV_PI		0.318309886f
+#define FAST_LOG2E		1.44269504f
+#define FAST_LN2		0.693147181f
+
+// 2^(j / 32), 1 / c and log2(c) for c = 1 + (j + 0.5) / 32, j 0 to 31, and mtof of the MIDI notes
+extern const float fastExp2Table[32];
+extern const float fastLog2RecipTable[32];
+extern const float fastLog2Table[32];
+extern const float fastMtofTable[128];
+
+
+inline float FastFloatFromBits(uint32_t u)
+{
+	float f;
+	memcpy(&f, &u, sizeof(f));
+	return f;
+}
+
+inline uint32_t FastBitsFromFloat(float f)
+{
+	uint32_t u;
+	memcpy(&u, &f, sizeof(u));
+	return u;
+}
+
+
+// sin(r) for |r| <= pi/2, an odd degree 9 minimax polynomial
+inline float FastSinPoly(float r)
+{
+	float r2 = r * r;
+	
+	return r + r * r2 * (-1.666665710e-01f + r2 * (8.333017290e-03f + r2 * (-1.980661511e-04f + r2 * 2.600054601e-06f)));
+}
+
+// sin(x) = (-1)^k sin(x - k pi), k the nearest integer to x / pi, k pi taken off in two parts
+inline float FastSin(float x)
+{
+	float kf = x * FAST_INV_PI;
+	int32_t k = (int32_t)(kf + (kf < 0.0f ? -0.5f : 0.5f));
+	float r = x - (float)k * FAST_PI_HI;
+	r -= (float)k * FAST_PI_LO;
+	
+	float s = FastSinPoly(r);
+	
+	return (k & 1) ? -s : s;
+}
+
+// cos(x) = sin(x + pi/2), the quarter turn goes into the reduction, (k - 1/2) pi, rather than
+// into x where it would round
+inline float FastCos(float x)
+{
+	float kf = x * FAST_INV_PI + 0.5f;
+	int32_t k = (int32_t)(kf + (kf < 0.0f ? -0.5f : 0.5f));
+	float h = (float)k - 0.5f;
+	float r = x - h * FAST_PI_HI;
+	r -= h * FAST_PI_LO;
+	
+	float s = FastSinPoly(r);
+	
+	return (k & 1) ? -s : s;
+}
+
+
+// 2^x: x is n / 32 + r, n the nearest integer to 32x and |r| <= 1/64. 2^(n / 32) is 2^(n / 32 mod 1)
+// from the table with n >> 5 added to its exponent bits, 2^r a degree 3 minimax polynomial.
+// x is clamped to [-126, 127], the range of normal floats
+inline float FastExp2(float x)
+{
+	x = x < -126.0f ? -126.0f : (x > 127.0f ? 127.0f : x);
+	
+	float s = x * 32.0f;
+	int32_t n = (int32_t)(s + (s < 0.0f ? -0.5f : 0.5f));
+	float r = x - (float)n * (1.0f / 32.0f);
+	
+	float p = 1.0f + r * (6.931471807e-01f + r * (2.402284522e-01f + r * 5.550361561e-02f));
+	
+	return p * FastFloatFromBits(FastBitsFromFloat(fastExp2Table[n & 31]) + ((uint32_t)(n >> 5) << 23));
+}
+
+// log2(x) for a normal float x > 0: the exponent bits, plus log2 of the mantissa m in [1, 2) as
+// log2(c) from the table, c the centre of m's 1/32 of the octave, and log2(m / c) with
+// |m / c - 1| < 1/64 a degree 3 minimax polynomial
+inline float FastLog2(float x)
+{
+	uint32_t u = FastBitsFromFloat(x);
+	int32_t e = (int32_t)((u >> 23) & 0xff) - 127;
+	uint32_t j = (u >> 18) & 31;
+	float m = FastFloatFromBits((u & 0x007fffff) | 0x3f800000);
+	
+	float r = m * fastLog2RecipTable[j] - 1.0f;
+	float p = r * (1.442695033e+00f + r * (-7.214228131e-01f + r * 4.810011790e-01f));
+	
+	return (float)e + fastLog2Table[j] + p;
+}
+
+// e^x and ln(x) through 2^x and log2(x), the rounding of x * log2(e) adds |x| * 5e-8 to the
+// relative error of FastExp
+inline float FastExp(float x)
+{
+	return FastExp2(x * FAST_LOG2E);
+}
+
+inline float FastLog(float x)
+{
+	return FastLog2(x) * FAST_LN2;
+}
+
+// b^e for b >= 0, 0 for b = 0
+inline float FastPow(float b, float e)
+{
+	return b > 0.0f ? FastExp2(e * FastLog2(b)) : 0.0f;
+}
+
+// tanh(x) = 1 - 2 / (e^2x + 1), clamped where it rounds to +-1 in a float. The error is absolute,
+// e^2x - 1 cancels for a small x so |x| under about 1e-6 comes out as 0 or a step of 6e-8
+inline float FastTanh(float x)
+{
+	x = x < -9.0f ? -9.0f : (x > 9.0f ? 9.0f : x);
+	float e = FastExp2(x * (2.0f * FAST_LOG2E));
+	
+	return (e - 1.0f) / (e + 1.0f);
+}
+
+// mtof, the whole notes from the table and a fraction of a note through FastExp2, the note
+// clamped to [0, 127]
+inline float FastMtof(float note)
+{
+	note = note < 0.0f ? 0.0f : (note > 127.0f ? 127.0f : note);
+	
+	int32_t i = (int32_t)note;
+	float f = note - (float)i;
+	
+	return f > 0.0f ? fastMtofTable[i] * FastExp2(f * (1.0f / 12.0f)) : fastMtofTable[i];
+}
+
+
+// what the voices and filters call
+#if FAST_MATH
+
+inline float MathSin(float x) { return FastSin(x); }
+inline float MathCos(float x) { return FastCos(x); }
+inline float MathExp(float x) { return FastExp(x); }
+inline float MathLog(float x) { return FastLog(x); }
+inline float MathPow(float b, float e) { return FastPow(b, e); }
+inline float MathTanh(float x) { return FastTanh(x); }
+inline float MathMtof(float note) { return FastMtof(note); }
+
+#else
+
+inline float MathSin(float x) { return sinf(x); }
+inline float MathCos(float x) { return cosf(x); }
+inline float MathExp(float x) { return expf(x); }
+inline float MathLog(float x) { return logf(x); }
+inline float MathPow(float b, float e) { return powf(b, e); }
+inline float MathTanh(float x) { return tanhf(x); }
+inline float MathMtof(float note) { return daisysp::mtof(note); }
+
+#endif
+
+
+#define FAST_MATH_SWEEP		4096	// arguments each function is checked and timed with
+
+typedef enum
+{
+	FAST_SIN,
+	FAST_COS,
+	FAST_EXP2,
+	FAST_LOG2,
+	FAST_POW,
+	FAST_TANH,
+	FAST_MTOF,
+	NUM_FAST_FUNCTIONS
+}FAST_FUNCTION;
+
+typedef struct
+{
+	const char *name;
+	float maxError;		// largest error against double precision libm over the sweep
+	float bound;		// the documented FAST_*_ERROR
+	float libmCycles;	// per call, the float libm function (DaisySP's mtof for mtof)
+	float fastCycles;	// per call
+}FastMathResult;
+
+// Sweeps each function over FAST_MATH_SWEEP arguments spanning its documented range, checks it
+// against libm and times both with CycleCount(). Fills results[NUM_FAST_FUNCTIONS] and returns the
+// number of functions past their bound, 0 when all pass. Takes a few msec on the seed.
+uint8_t FastMathCheck(FastMathResult *results);
+
+// logs FastMathCheck()
+void FastMathLog();
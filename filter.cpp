@@ -98,18 +98,6 @@ void Filters::Select(int8_t sel)
 	
 }
 
-void Filters::ProcessFreq() 
-{
-	pfilter->SetFreq(freqPotParm.Process());
-}
-
-
-void Filters::ProcessRes() 
-{
-	pfilter->SetRes(resPotParm.Process());
-}
-
-
 void Filters::SetFreqCC(uint8_t value)
 {
 	//f must be between 0.0 and sample_rate / 3
@@ -129,6 +117,11 @@ float Filters::Process(float in)
 	return pfilter->Process(in);
 }
 
+void Filters::ProcessBlock(float *buf, size_t n)
+{	
+	pfilter->ProcessBlock(buf, n);
+}
+
 
 void Filters::SetCC0(uint8_t value)
 {	
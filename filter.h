@@ -26,6 +26,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "daisysp.h"
 
 #include "midimap.h"
+#include "ladder.h"
 
 
 using namespace daisy;
@@ -39,6 +40,8 @@ public:
 	virtual void SetRes(float r) {}
 	virtual void SetFreq(float f) {}
 	virtual float Process(float in) { return in; }	
+	// filters n samples in place, same result as calling Process() per sample
+	virtual void ProcessBlock(float *buf, size_t n) {}
 	
 };
 
@@ -51,6 +54,14 @@ public:
 	void SetRes(float r) { filter.SetRes(r); }
 	void SetFreq(float f) { filter.SetFreq(f); }
 	float Process(float in) { filter.Process(in);  return filter.Low(); }	
+	void ProcessBlock(float *buf, size_t n) 
+	{ 
+		for (size_t s = 0; s < n; s++) 
+		{
+			filter.Process(buf[s]);  
+			buf[s] = filter.Low();
+		}
+	}
 	
 private:
 	Svf	filter;	
@@ -65,9 +76,16 @@ public:
 	void SetRes(float r) { filter.SetRes(r); }
 	void SetFreq(float f) { filter.SetFreq(f); }
 	float Process(float in) { return filter.Process(in) * 4;  }	// moog filter seems to have a gain issue
+	void ProcessBlock(float *buf, size_t n) 
+	{ 
+		for (size_t s = 0; s < n; s++) 
+		{
+			buf[s] = filter.Process(buf[s]) * 4;
+		}
+	}
 	
 private:
-	MoogLadder	filter;	
+	Ladder	filter;	
 };
 
 
@@ -77,6 +95,17 @@ class Filters : public CCMIDIMapable
 {
 public:
 	Filters() {}
+	
+	typedef enum
+	{
+		NO_FILTER,
+		SV_FILTER,
+		MOOG_FILTER
+	}FILTER_TYPE;
+	
+	#define NUM_FILTERS 3
+	
+	uint8_t GetSelector(void) { return currentFilterSelector; }
 		
 	void Init(DaisyPod *phw, float sampleRate); 
 	
@@ -84,6 +113,7 @@ public:
 	void Select(int8_t sel);
 	
 	float Process(float in);
+	void ProcessBlock(float *buf, size_t n);
 	
 	void SetCC0(uint8_t value);
 	void SetCC1(uint8_t value);
@@ -91,8 +121,10 @@ public:
 	// adjusts filter parms or selects specific filter via MIDI map
 	void CCProcess(uint8_t ccFuncNumber, uint8_t value);
 
-	void ProcessFreq(); // set via analog pot
-	void ProcessRes(); // set via analog pot
+	float ReadFreq() { return freqPotParm.Process(); } // control task, freq pot mapped to its range
+	float ReadRes() { return resPotParm.Process(); } // control task, resonance pot mapped to its range
+	void ApplyFreq(float f) { pfilter->SetFreq(f); } // audio side, a value from ReadFreq()
+	void ApplyRes(float r) { pfilter->SetRes(r); } // audio side, a value from ReadRes()
 
 
 private:
@@ -102,15 +134,6 @@ private:
 	Parameter freqPotParm; // sets range and plot of freq pot
 	Parameter resPotParm; // sets range and plot of resonance pot
 
-	typedef enum
-	{
-		NO_FILTER,
-		SV_FILTER,
-		MOOG_FILTER
-	}FILTER_TYPE;
-	
-	#define NUM_FILTERS 3
-	
 	void ChangeFilter(uint8_t sel);
 
 	
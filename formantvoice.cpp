@@ -25,130 +25,172 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include "utilities.h"
 #include "voice.h"
+#include "fastmath.h"
 
 using namespace daisy;
 using namespace daisysp;
 
+// the pot mappings, see InitPots()
+template<uint8_t N> Parameter FormantVoice<N>::ADSRAttackPotParm;
+template<uint8_t N> Parameter FormantVoice<N>::ADSRDecayPotParm;
+template<uint8_t N> Parameter FormantVoice<N>::ADSRSustainPotParm;
+template<uint8_t N> Parameter FormantVoice<N>::ADSRReleasePotParm;
 
-void FormantVoice::Init(DaisyPod *phw, float SR) 
+
+template<uint8_t N>
+void FormantVoice<N>::Init(DaisyPod *phw, float SR) 
 {
 	NullVoice::Init(phw, SR);
-	polyphony = FORMANT_VOICE_POLYPHONY;
+	InitPolyphony(FORMANT_VOICE_POLYPHONY, N, slots);
 	ADSROn = true;
 	ADSRAttack = ADSR_ATTACK_DEFAULT;
 	ADSRDecay = ADSR_DECAY_DEFAULT;
 	ADSRSustain = 1.0;
 	ADSRRelease = ADSR_RELEASE_DEFAULT;
 	
-	for (uint8_t i = 0; i < polyphony; i++)
+	env.Init(sampleRate);
+	env.SetAttackTime(ADSRAttack);
+	env.SetDecayTime(ADSRDecay);
+	env.SetSustainLevel(ADSRSustain);
+	env.SetReleaseTime(ADSRRelease);
+	
+	for (uint8_t i = 0; i < maxPolyphony; i++)
 	{
 		formant[i].Init(sampleRate);
 		formant[i].SetFormantFreq(1000);
 		formant[i].SetPhaseShift(0);
-		
-		adsr[i].Init(sampleRate);
-		adsr[i].SetAttackTime(ADSRAttack);
-		adsr[i].SetDecayTime(ADSRDecay);
-		adsr[i].SetSustainLevel(ADSRSustain);
-		adsr[i].SetReleaseTime(ADSRRelease);
 	}	
 	
-	// See controlmap
-	ADSRAttackPotParm.Init(hw->knob1, ADSR_ATTACK_MIN, ADSR_ATTACK_MAX, Parameter::LINEAR);
-	ADSRDecayPotParm.Init(hw->knob2, ADSR_DECAY_MIN, ADSR_DECAY_MAX, Parameter::LINEAR);
-	ADSRSustainPotParm.Init(hw->knob1, ADSR_SUSTAIN_MIN, ADSR_SUSTAIN_MAX, Parameter::LINEAR);
-	ADSRReleasePotParm.Init(hw->knob2, ADSR_RELEASE_MIN, ADSR_RELEASE_MAX, Parameter::LINEAR);
 	
 	Panic();
 }
 
-void FormantVoice::Panic() 
+template<uint8_t N>
+void FormantVoice<N>::Panic() 
 {
 	NullVoice::Panic();
 	
-	for (uint8_t i = 0; i < polyphony; i++)
+	for (uint8_t i = 0; i < maxPolyphony; i++)
 	{
-		adsr[i].Process(false);	
+		env.Process(i, false);
 	}
 }
 
-void FormantVoice::StartNote(uint8_t i, NoteOnEvent *p)
+template<uint8_t N>
+void FormantVoice<N>::StartNote(uint8_t i, NoteOnEvent *p)
 {
 	//log("n: %d, m: %d", i, p->note);
+	WakeSlot(i);
 	notes[i].midiNote = p->note;
 	notes[i].amplitude = (float)p->velocity / 127.0f;
 			
-	formant[i].SetCarrierFreq(mtof(p->note));
-	adsr[i].Retrigger(false); // set attack mode
+	formant[i].SetCarrierFreq(MathMtof(p->note));
+	env.Retrigger(i); // set attack mode
+}
+
+template<uint8_t N>
+void FormantVoice<N>::SetFreq(float f)
+{
+	
 }
 
-void FormantVoice::NoteOn(NoteOnEvent *p)
+template<uint8_t N>
+float FormantVoice<N>::Process(void) 
 {
-	for (uint8_t i = 0; i < polyphony; i++)
+	float sig = 0.0;
+	for (uint8_t i = 0; i < maxPolyphony; i++)
 	{
-		if (notes[i].midiNote == p->note)
+		if (notes[i].parked == true)
 		{
-			// if we are playing the same note
-			StartNote(i, p);
-			return;
+			continue;
 		}
 		
-		// start new note if unused and adsr is done 
-		if (notes[i].midiNote == 0 && adsr[i].IsRunning() == false)
+		bool attack = true;
+		if (notes[i].midiNote == 0)
+		{
+			attack = false; // release
+		}
+				
+		float ADSRLevel = 1.0;
+		if (ADSROn == true)
 		{
-			StartNote(i, p);
-			return;	
+			ADSRLevel = env.Process(i, attack);
 		}
+		sig += formant[i].Process() * ADSRLevel * notes[i].amplitude;
 	}
+	
+	return sig / mixDivisor;
 }
 
+// the envelopes of every slot at once, RenderSlot() reads its column
+template<uint8_t N>
+void FormantVoice<N>::RenderBank(size_t n)
+{
+	if (IsIdle() || ADSROn == false)
+	{
+		return;
+	}
+	
+	for (uint8_t i = 0; i < maxPolyphony; i++)
+	{
+		env.SetGate(i, notes[i].midiNote != 0); // released when 0
+	}
+	env.Render(envOut, n);
+}
 
-void FormantVoice::NoteOff(NoteOffEvent *p)
+template<uint8_t N>
+void FormantVoice<N>::RenderSlot(uint8_t i, float *buf, size_t n)
 {
-	for (uint8_t i = 0; i < polyphony; i++)
+	float amplitude = notes[i].amplitude;
+	if (ADSROn == false)
 	{
-		if (notes[i].midiNote == p->note)
+		for (size_t s = 0; s < n; s++)
 		{
-			notes[i].midiNote = 0;	
+			buf[s] = formant[i].Process() * amplitude;
 		}
+		return;
+	}
+	
+	const float *level = envOut + i;
+	const uint8_t stride = EnvelopeBank<N>::LANES;
+	
+	for (size_t s = 0; s < n; s++)
+	{
+		buf[s] = formant[i].Process() * level[s * stride] * amplitude;
 	}
 }
 
-
-void FormantVoice::SetFreq(float f)
+// the oscillator runs on so the phase a note starts at is the same as if the slot had sounded
+template<uint8_t N>
+void FormantVoice<N>::AdvanceSlot(uint8_t i, float *buf, size_t n)
 {
-	
+	for (size_t s = 0; s < n; s++)
+	{
+		formant[i].Process();
+	}
 }
 
-float FormantVoice::Process(void) 
+// a finished envelope is silent to the sample, the energy tail only without one
+template<uint8_t N>
+bool FormantVoice<N>::SlotIdle(uint8_t i)
 {
-	float sig = 0.0;
-	for (uint8_t i = 0; i < polyphony; i++)
+	if (ADSROn == false)
 	{
-		bool attack = true;
-		if (notes[i].midiNote == 0)
-		{
-			attack = false; // release
-		}
-				
-		float ADSRLevel = 1.0;
-		if (ADSROn == true)
-		{
-			ADSRLevel = adsr[i].Process(attack);
-		}
-		sig += formant[i].Process() * ADSRLevel * notes[i].amplitude;
+		return NullVoice::SlotIdle(i);
 	}
 	
-	return sig / polyphony;
+	return env.IsRunning(i) == false;
 }
 	
 
-void FormantVoice::SetCC4(uint8_t value)
+template<uint8_t N>
+void FormantVoice<N>::SetCC4(uint8_t value)
 {
 	SetFormantFreqCC(value);
 }
 
-void FormantVoice::SetCC5(uint8_t value)
+template<uint8_t N>
+void FormantVoice<N>::SetCC5(uint8_t value)
 {
 	SetPhaseShiftCC(value);
 }
@@ -156,7 +198,8 @@ void FormantVoice::SetCC5(uint8_t value)
 #define CARRIER_FREQ_MIN 1000.0
 #define CARRIER_FREQ_MAX 20000.0
 
-void FormantVoice::SetFormantFreqCC(uint8_t value)
+template<uint8_t N>
+void FormantVoice<N>::SetFormantFreqCC(uint8_t value)
 {
 	float f = GetCCMinMax(value, CARRIER_FREQ_MIN, CARRIER_FREQ_MAX);
 	if (f == formantFreq)
@@ -166,14 +209,15 @@ void FormantVoice::SetFormantFreqCC(uint8_t value)
 	formantFreq = f;
 	//log("Formant Freq: %u ", (uint32_t)(formantFreq * 1000));
 
-	for (uint8_t i = 0; i < polyphony; i++)
+	for (uint8_t i = 0; i < maxPolyphony; i++)
 	{
 		formant[i].SetCarrierFreq(formantFreq); 
 	}
 }
 
 
-void FormantVoice::SetPhaseShiftCC(uint8_t value)
+template<uint8_t N>
+void FormantVoice<N>::SetPhaseShiftCC(uint8_t value)
 {
 	float p = float(value)/127.0;
 	if (p == phaseShift)
@@ -182,29 +226,38 @@ void FormantVoice::SetPhaseShiftCC(uint8_t value)
 	}
 	phaseShift = p;
 	
-	for (uint8_t i = 0; i < polyphony; i++)
+	for (uint8_t i = 0; i < maxPolyphony; i++)
 	{
 		formant[i].SetPhaseShift(phaseShift); 
 	}
 }
 
 
-void FormantVoice::SetCC0(uint8_t value)
+template<uint8_t N>
+void FormantVoice<N>::SetCC0(uint8_t value)
 {
 	SetADSRAttack(GetCCMinMax(value, ADSR_ATTACK_MIN, ADSR_ATTACK_MAX));
 }
 
-void FormantVoice::SetCC1(uint8_t value)
+template<uint8_t N>
+void FormantVoice<N>::SetCC1(uint8_t value)
 {
 	SetADSRDecay(GetCCMinMax(value, ADSR_DECAY_MIN, ADSR_DECAY_MAX));
 }
 
-void FormantVoice::SetCC2(uint8_t value)
+template<uint8_t N>
+void FormantVoice<N>::SetCC2(uint8_t value)
 {
 	if (value == 127)
 	{
 		ADSROn = false;
 		log("ADSR off");
+		
+		// every slot's oscillator drones without the ADSR
+		for (uint8_t i = 0; i < maxPolyphony; i++)
+		{
+			WakeSlot(i);
+		}
 	}
 	else
 	{
@@ -214,13 +267,15 @@ void FormantVoice::SetCC2(uint8_t value)
 	SetADSRSustain(value / 127.0);
 }
 
-void FormantVoice::SetCC3(uint8_t value)
+template<uint8_t N>
+void FormantVoice<N>::SetCC3(uint8_t value)
 {
 	SetADSRRelease(GetCCMinMax(value, ADSR_RELEASE_MIN, ADSR_RELEASE_MAX));
 }
 
 
-void FormantVoice::SetADSRAttack(float a)
+template<uint8_t N>
+void FormantVoice<N>::SetADSRAttack(float a)
 {
 	if (a == ADSRAttack)
 	{
@@ -230,14 +285,12 @@ void FormantVoice::SetADSRAttack(float a)
 	ADSRAttack = a;
 	//log("Attack: %d msec", (uint32_t)(ADSRAttack * 1000));
 	
-	for (uint8_t i = 0; i < polyphony; i++)
-	{
-		adsr[i].SetAttackTime(ADSRAttack); 
-	}
+	env.SetAttackTime(ADSRAttack);
 }
 	
 
-void FormantVoice::SetADSRDecay(float v)
+template<uint8_t N>
+void FormantVoice<N>::SetADSRDecay(float v)
 {
 	if (v == ADSRDecay)
 	{
@@ -246,14 +299,12 @@ void FormantVoice::SetADSRDecay(float v)
 	ADSRDecay = v;
 	//log("Decay: %d", (uint32_t)(ADSRDecay * 1000));
 	
-	for (uint8_t i = 0; i < polyphony; i++)
-	{
-		adsr[i].SetDecayTime(ADSRDecay); 
-	}
+	env.SetDecayTime(ADSRDecay);
 }
 
 
-void FormantVoice::SetADSRSustain(float v)
+template<uint8_t N>
+void FormantVoice<N>::SetADSRSustain(float v)
 {	
 	if (v == ADSRSustain)
 	{
@@ -262,13 +313,11 @@ void FormantVoice::SetADSRSustain(float v)
 	ADSRSustain = v;
 	//log("Sustain: %d", (uint32_t)(ADSRSustain * 1000));
 
-	for (uint8_t i = 0; i < polyphony; i++)
-	{
-		adsr[i].SetSustainLevel(ADSRSustain); 
-	}
+	env.SetSustainLevel(ADSRSustain);
 }
 
-void FormantVoice::SetADSRRelease(float v)
+template<uint8_t N>
+void FormantVoice<N>::SetADSRRelease(float v)
 {
 	if (v == ADSRRelease)
 	{
@@ -277,33 +326,67 @@ void FormantVoice::SetADSRRelease(float v)
 	ADSRRelease = v;
 	//log("Release: %d", (uint32_t)(ADSRRelease * 1000));
 
-	for (uint8_t i = 0; i < polyphony; i++)
-	{
-		adsr[i].SetReleaseTime(ADSRRelease); 
-	}
-}
-
-void FormantVoice::ProcessParm0()
-{
-	SetADSRAttack(ADSRAttackPotParm.Process());
+	env.SetReleaseTime(ADSRRelease);
 }
 
-
-void FormantVoice::ProcessParm1()
+template<uint8_t N>
+void FormantVoice<N>::InitPots(DaisyPod *phw)
 {
-	SetADSRDecay(ADSRDecayPotParm.Process());
+	// See controlmap
+	ADSRAttackPotParm.Init(phw->knob1, ADSR_ATTACK_MIN, ADSR_ATTACK_MAX, Parameter::LINEAR);
+	ADSRDecayPotParm.Init(phw->knob2, ADSR_DECAY_MIN, ADSR_DECAY_MAX, Parameter::LINEAR);
+	ADSRSustainPotParm.Init(phw->knob1, ADSR_SUSTAIN_MIN, ADSR_SUSTAIN_MAX, Parameter::LINEAR);
+	ADSRReleasePotParm.Init(phw->knob2, ADSR_RELEASE_MIN, ADSR_RELEASE_MAX, Parameter::LINEAR);
 }
 
 
-void FormantVoice::ProcessParm2()
+template<uint8_t N>
+float FormantVoice<N>::ReadParm(uint8_t n)
 {
-	SetADSRSustain(ADSRSustainPotParm.Process());
+	switch (n)
+	{
+	case 0:
+		return ADSRAttackPotParm.Process();
+		
+	case 1:
+		return ADSRDecayPotParm.Process();
+		
+	case 2:
+		return ADSRSustainPotParm.Process();
+		
+	case 3:
+		return ADSRReleasePotParm.Process();
+		
+	default:
+		return 0.0;
+	}
 }
 
 
-void FormantVoice::ProcessParm3()
+template<uint8_t N>
+void FormantVoice<N>::ApplyParm(uint8_t n, float value)
 {
-	SetADSRRelease(ADSRReleasePotParm.Process());
+	switch (n)
+	{
+	case 0:
+		SetADSRAttack(value);
+		break;
+		
+	case 1:
+		SetADSRDecay(value);
+		break;
+		
+	case 2:
+		SetADSRSustain(value);
+		break;
+		
+	case 3:
+		SetADSRRelease(value);
+		break;
+		
+	default:
+		break;
+	}
 }
 
-
+template class FormantVoice<FORMANT_VOICE_MAX_POLYPHONY>;
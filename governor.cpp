@@ -0,0 +1,163 @@
+/*
+ This file is part of Virtual Robot's Pine Synthesizer. 
+
+Copyright <2022> <Brian Gunnison>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+software and associated documentation files (the "Software"), to deal in the Software 
+without restriction, including without limitation the rights to use, copy, modify, 
+merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+permit persons to whom the Software is furnished to do so, subject to the following 
+conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "daisy_pod.h"
+#include "daisysp.h"
+
+#include "utilities.h"
+#include "voice.h"
+#include "filter.h"
+#include "governor.h"
+
+using namespace daisy;
+using namespace daisysp;
+
+
+void PolyphonyGovernor::Init(Voices *v, Filters *f, CpuLoadMeter *m)
+{
+	voices = v;
+	filters = f;
+	meter = m;
+	
+	for (uint8_t i = 0; i < NUM_VOICES; i++)
+	{
+		for (uint8_t j = 0; j < NUM_FILTERS; j++)
+		{
+			ceiling[i][j] = 0xFF; // no limit until calibrated
+		}
+	}
+	hold = 0;
+	calm = 0;
+	
+	counters.blocks = 0;
+	counters.overloads = 0;
+	counters.lowered = 0;
+	counters.raised = 0;
+	counters.polyphony = voices->GetPolyphony();
+	counters.minPolyphony = counters.polyphony;
+	counters.avgLoad = 0.0;
+	counters.peakLoad = 0.0;
+}
+
+
+// the calibrated limit of the current voice and filter, no more than the engine has slots.
+// The mix stays divided by the boot polyphony, so a note sounds as loud whatever the polyphony
+uint8_t PolyphonyGovernor::GetCeiling()
+{
+	uint8_t max = voices->GetMaxPolyphony();
+	uint8_t c = ceiling[voices->GetSelector()][filters->GetSelector()];
+	
+	if (c < max)
+	{
+		max = c;
+	}
+	
+	return max;
+}
+
+
+void PolyphonyGovernor::Update()
+{
+	// the meter is reset every block so its max is the load of the block just rendered
+	float load = meter->GetMaxCpuLoad();
+	meter->Reset();
+	
+	counters.blocks++;
+	counters.avgLoad += (load - counters.avgLoad) * GOVERNOR_SMOOTHING;
+	if (load > counters.peakLoad)
+	{
+		counters.peakLoad = load;
+	}
+	
+	if (hold > 0)
+	{
+		hold--;
+	}
+	
+	uint8_t p = voices->GetPolyphony();
+	uint8_t max = GetCeiling();
+	
+	if (p > max)
+	{
+		// a voice or filter change put the polyphony over what calibration says fits
+		voices->SetPolyphony(max);
+		counters.lowered += p - max;
+		calm = 0;
+		hold = GOVERNOR_HOLD_BLOCKS;
+	}
+	else if (load > GOVERNOR_HIGH_WATER)
+	{
+		counters.overloads++;
+		calm = 0;
+		
+		if (hold == 0 && p > 1)
+		{
+			voices->SetPolyphony(p - 1);
+			counters.lowered++;
+			hold = GOVERNOR_HOLD_BLOCKS;
+		}
+	}
+	else
+	{
+		// every slot of a voice costs about the same, so one more slot costs load / p
+		float projected = counters.avgLoad * (p + 1) / p;
+		
+		if (p < max && projected < GOVERNOR_LOW_WATER)
+		{
+			calm++;
+		}
+		else
+		{
+			calm = 0;
+		}
+		
+		if (calm >= GOVERNOR_RAISE_BLOCKS && hold == 0)
+		{
+			voices->SetPolyphony(p + 1);
+			counters.raised++;
+			calm = 0;
+			hold = GOVERNOR_HOLD_BLOCKS;
+		}
+	}
+	
+	counters.polyphony = voices->GetPolyphony();
+	if (counters.polyphony < counters.minPolyphony)
+	{
+		counters.minPolyphony = counters.polyphony;
+	}
+}
+
+
+void PolyphonyGovernor::LogCounters()
+{
+	log("Governor poly: %d (min %d, max %d) load: %d%% peak: %d%% over: %u lowered: %u raised: %u", 
+		counters.polyphony, 
+		counters.minPolyphony, 
+		GetCeiling(),
+		(int)(counters.avgLoad * 100), 
+		(int)(counters.peakLoad * 100), 
+		counters.overloads, 
+		counters.lowered, 
+		counters.raised);
+	
+	counters.peakLoad = 0.0;
+}
@@ -0,0 +1,78 @@
+/*
+ This file is part of Virtual Robot's Pine Synthesizer. 
+
+Copyright <2022> <Brian Gunnison>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+software and associated documentation files (the "Software"), to deal in the Software 
+without restriction, including without limitation the rights to use, copy, modify, 
+merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+permit persons to whom the Software is furnished to do so, subject to the following 
+conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include "daisy_pod.h"
+#include "voice.h"
+#include "filter.h"
+
+using namespace daisy;
+
+#define GOVERNOR_HIGH_WATER		0.90f	// a block over this load retires the quietest slot
+#define GOVERNOR_LOW_WATER		0.75f	// a slot is added when the projected load stays under this
+#define GOVERNOR_SMOOTHING		0.01f	// one pole smoothing of the block load, about 100 blocks
+#define GOVERNOR_HOLD_BLOCKS	20		// let a retiring slot fade and the load settle before acting again
+#define GOVERNOR_RAISE_BLOCKS	1000	// calm blocks (about 1 sec) before a slot is added
+
+
+// raises and lowers the active voice's polyphony from the CPU load of each audio block
+// so the callback never overruns, see NullVoice::SetPolyphony
+class PolyphonyGovernor
+{
+public:
+	typedef struct
+	{
+		uint32_t blocks;		// blocks seen
+		uint32_t overloads;		// blocks over the high water mark
+		uint32_t lowered;		// slots retired
+		uint32_t raised;		// slots returned to service
+		uint8_t polyphony;		// active polyphony now
+		uint8_t minPolyphony;	// lowest the governor has gone
+		float avgLoad;			// smoothed block load
+		float peakLoad;			// worst block since the counters were last logged
+	}Counters;
+	
+	void Init(Voices *v, Filters *f, CpuLoadMeter *m);
+	
+	// highest polyphony the governor allows for a voice and filter pair, from the boot calibration
+	void SetCeiling(uint8_t voice, uint8_t filter, uint8_t p) { ceiling[voice][filter] = p; }
+	
+	// call from the audio callback after loadMeter.OnBlockEnd(), resets the meter every block
+	void Update();
+	
+	uint8_t GetCeiling();
+	const Counters &GetCounters() { return counters; }
+	void LogCounters();
+	
+private:
+	Voices *voices;
+	Filters *filters;
+	CpuLoadMeter *meter;
+	
+	uint8_t ceiling[NUM_VOICES][NUM_FILTERS];
+	
+	uint16_t hold;	// blocks before the next change is allowed
+	uint16_t calm;	// consecutive blocks a raise would have fitted
+	
+	Counters counters;
+};
@@ -25,16 +25,19 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include "utilities.h"
 #include "voice.h"
+#include "fastmath.h"
 
 using namespace daisy;
 using namespace daisysp;
 
-void HiHatVoice::Init(DaisyPod *phw, float SR) 
+template<uint8_t N>
+void HiHatVoice<N>::Init(DaisyPod *phw, float SR) 
 {
 	NullVoice::Init(phw, SR);
-	polyphony = HIHAT_VOICE_POLYPHONY;
+	InitPolyphony(HIHAT_VOICE_POLYPHONY, N, slots);
+	allocator.SetReuseTails(true);
 	
-	for (uint8_t i = 0; i < polyphony; i++)
+	for (uint8_t i = 0; i < maxPolyphony; i++)
 	{
 		hihat[i].Init(sampleRate);
 	}	
@@ -42,96 +45,93 @@ void HiHatVoice::Init(DaisyPod *phw, float SR)
 	Panic();
 }
 
-void HiHatVoice::Panic() 
+template<uint8_t N>
+void HiHatVoice<N>::Panic() 
 {
 	NullVoice::Panic();
 	
-	//for (uint8_t i = 0; i < polyphony; i++)
+	//for (uint8_t i = 0; i < maxPolyphony; i++)
 	//{
 	//	hihat[i].Reset();
 	//}
 }
 
 
-void HiHatVoice::StartNote(uint8_t i, NoteOnEvent *p)
+template<uint8_t N>
+void HiHatVoice<N>::StartNote(uint8_t i, NoteOnEvent *p)
 {
 	//log("n: %d, m: %d", i, p->note);
+	WakeSlot(i);
 	notes[i].midiNote = p->note;
 	notes[i].amplitude = (float)p->velocity / 127.0f;
 			
-	hihat[i].SetFreq(mtof(p->note));
+	hihat[i].SetFreq(MathMtof(p->note));
 	hihat[i].Trig();
 	
 }
 
-void HiHatVoice::NoteOn(NoteOnEvent *p)
+template<uint8_t N>
+float HiHatVoice<N>::Process(void) 
 {
-	for (uint8_t i = 0; i < polyphony; i++)
+	float sig = 0.0;
+	for (uint8_t i = 0; i < maxPolyphony; i++)
 	{
-		
-		if (notes[i].midiNote == p->note)
+		if (notes[i].parked == true)
 		{
-			// if we are playing the same note
-			StartNote(i, p);
-			return;
+			continue;
 		}
 		
-		// start new note if unused and (todo) adsr is done 
-		if (notes[i].midiNote == 0 )
-		{
-			StartNote(i, p);
-			return;	
-		}
+		sig += hihat[i].Process() * notes[i].amplitude;
 	}
+	
+	return sig / mixDivisor;
 }
 
-
-void HiHatVoice::NoteOff(NoteOffEvent *p)
+// the pitch comes from the note
+template<uint8_t N>
+void HiHatVoice<N>::SetFreq(float f)
 {
-	for (uint8_t i = 0; i < polyphony; i++)
-	{
-		if (notes[i].midiNote == p->note)
-		{
-			notes[i].midiNote = 0;	
-		}
-	}
+	
 }
 
-
-float HiHatVoice::Process(void) 
+template<uint8_t N>
+void HiHatVoice<N>::RenderSlot(uint8_t i, float *buf, size_t n)
 {
-	float sig = 0.0;
-	for (uint8_t i = 0; i < polyphony; i++)
+	float amplitude = notes[i].amplitude;
+	for (size_t s = 0; s < n; s++)
 	{
-		sig += hihat[i].Process() * notes[i].amplitude;
+		buf[s] = hihat[i].Process() * amplitude;
 	}
-	
-	return sig / polyphony;
 }
 	
-void HiHatVoice::SetCC0(uint8_t value)
+template<uint8_t N>
+void HiHatVoice<N>::SetCC0(uint8_t value)
 {
 	SetDecayCC(value);
 }
 
-void HiHatVoice::SetCC1(uint8_t value)
+template<uint8_t N>
+void HiHatVoice<N>::SetCC1(uint8_t value)
 {
 	SetToneCC(value);
 }
 
-void HiHatVoice::SetCC2(uint8_t value)
+template<uint8_t N>
+void HiHatVoice<N>::SetCC2(uint8_t value)
 {
 	SetAccentCC(value);
 }
 
-void HiHatVoice::SetCC3(uint8_t value)
+template<uint8_t N>
+void HiHatVoice<N>::SetCC3(uint8_t value)
 {
 	SetNoisinessCC(value);
 }
 
 
 
-void HiHatVoice::SetDecayCC(uint8_t value)
+template<uint8_t N>
+void HiHatVoice<N>::SetDecayCC(uint8_t value)
 {
 	float set = (float)value / 127.0;
 	if (set == decay)
@@ -140,14 +140,15 @@ void HiHatVoice::SetDecayCC(uint8_t value)
 	}
 	
 	decay = set;
-	for (uint8_t i = 0; i < polyphony; i++)
+	for (uint8_t i = 0; i < maxPolyphony; i++)
 	{
 		hihat[i].SetDecay(decay);
 	}
 }
 
 
-void HiHatVoice::SetToneCC(uint8_t value)
+template<uint8_t N>
+void HiHatVoice<N>::SetToneCC(uint8_t value)
 {
 	float set = (float)value / 127.0;
 	if (set == tone)
@@ -156,14 +157,15 @@ void HiHatVoice::SetToneCC(uint8_t value)
 	}
 	
 	tone = set;
-	for (uint8_t i = 0; i < polyphony; i++)
+	for (uint8_t i = 0; i < maxPolyphony; i++)
 	{
 		hihat[i].SetTone(tone);
 	}
 }
 
 
-void HiHatVoice::SetAccentCC(uint8_t value)
+template<uint8_t N>
+void HiHatVoice<N>::SetAccentCC(uint8_t value)
 {
 	float set = (float)value / 127.0;
 	if (set == accent)
@@ -172,14 +174,15 @@ void HiHatVoice::SetAccentCC(uint8_t value)
 	}
 	
 	accent = set;
-	for (uint8_t i = 0; i < polyphony; i++)
+	for (uint8_t i = 0; i < maxPolyphony; i++)
 	{
 		hihat[i].SetAccent(accent);
 	}
 }
 
 
-void HiHatVoice::SetNoisinessCC(uint8_t value)
+template<uint8_t N>
+void HiHatVoice<N>::SetNoisinessCC(uint8_t value)
 {
 	float set = (float)value / 127.0;
 	if (set == noisiness)
@@ -188,10 +191,61 @@ void HiHatVoice::SetNoisinessCC(uint8_t value)
 	}
 	
 	noisiness = set;
-	for (uint8_t i = 0; i < polyphony; i++)
+	for (uint8_t i = 0; i < maxPolyphony; i++)
 	{
 		hihat[i].SetNoisiness(noisiness);
 	}
 }
 
 
+// the hihat has no pot parameters, parameters 0 - 3 are its CCs (decay, tone, accent, noisiness) 0 - 1
+template<uint8_t N>
+float HiHatVoice<N>::ReadParm(uint8_t n)
+{
+	switch (n)
+	{
+	case 0:
+		return decay;
+		
+	case 1:
+		return tone;
+		
+	case 2:
+		return accent;
+		
+	case 3:
+		return noisiness;
+		
+	default:
+		return 0.0;
+	}
+}
+
+
+template<uint8_t N>
+void HiHatVoice<N>::ApplyParm(uint8_t n, float value)
+{
+	switch (n)
+	{
+	case 0:
+		SetDecayCC(value * 127.0f);
+		break;
+		
+	case 1:
+		SetToneCC(value * 127.0f);
+		break;
+		
+	case 2:
+		SetAccentCC(value * 127.0f);
+		break;
+		
+	case 3:
+		SetNoisinessCC(value * 127.0f);
+		break;
+		
+	default:
+		break;
+	}
+}
+
+template class HiHatVoice<HIHAT_VOICE_MAX_POLYPHONY>;
@@ -0,0 +1,587 @@
+/*
+ This file is part of Virtual Robot's Pine Synthesizer. 
+
+Copyright <2022> <Brian Gunnison>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+software and associated documentation files (the "Software"), to deal in the Software 
+without restriction, including without limitation the rights to use, copy, modify, 
+merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+permit persons to whom the Software is furnished to do so, subject to the following 
+conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+// pine_bench, times the DaisySP building blocks the voices use and each voice engine at 1 to its
+// maximum polyphony of sounding notes, and writes ns/sample and samples/second as JSON so runs
+// can be compared across commits (host/bench_compare.py), with the RAM of each engine, and the
+// error and cycles per call of each fastmath.h function against libm.
+//
+//   pine_bench [--out bench.json] [--sr 48000] [--seconds 0.25] [--runs 7] [--filter name]
+//   pine_bench --calibrate [--sr 48000]
+//
+// --calibrate runs the seed's boot calibration (CostCalibrator) on this machine instead and prints
+// its cost and safe polyphony table.
+// Each result is the median of the runs, each run is seconds of audio from a fresh note.
+// Exits with 1 when a fastmath.h function is past its documented error.
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include "daisy_pod.h"
+#include "daisysp.h"
+#include "voice.h"
+#include "filter.h"
+#include "fastmath.h"
+#include "calibrate.h"
+#include "cyclecounter.h"
+
+using namespace daisy;
+using namespace daisysp;
+
+extern DaisyPod hw;
+
+#ifndef PINE_GIT_REV
+#define PINE_GIT_REV "unknown"
+#endif
+
+typedef struct
+{
+	float sampleRate;
+	float seconds;		// audio per run
+	int runs;
+	const char *filter;	// only benchmarks whose name contains this, NULL all
+	const char *outPath;	// NULL stdout
+}BenchOptions;
+
+typedef struct
+{
+	std::string name;
+	int notes;			// sounding notes for a voice engine, 0 for a primitive
+	double nsPerSample;	// median of the runs
+	double nsMin;
+	double nsMax;
+}BenchResult;
+
+static BenchOptions options;
+typedef struct
+{
+	std::string name;
+	int slots;
+	size_t bytes;		// sizeof the engine with its own slots
+	size_t maxBytes;	// and with MAX_POLYPHONY slots
+}EngineSize;
+
+static std::vector<BenchResult> results;
+static std::vector<EngineSize> sizes;
+static std::vector<FastMathResult> mathResults;
+static uint8_t mathFailed;
+
+// keeps the optimiser from dropping the rendered samples
+static volatile float sink;
+
+
+static bool Selected(const std::string &name)
+{
+	return options.filter == NULL || name.find(options.filter) != std::string::npos;
+}
+
+
+// setup() readies a fresh engine and returns nothing, render(n) renders n samples and returns their sum
+template<typename Setup, typename Render>
+static void Bench(const std::string &name, int notes, Setup setup, Render render)
+{
+	if (!Selected(name))
+	{
+		return;
+	}
+	
+	size_t samples = (size_t)(options.seconds * options.sampleRate);
+	std::vector<double> ns;
+	
+	// one run untimed to warm the caches and the branch predictors
+	for (int r = 0; r <= options.runs; r++)
+	{
+		setup();
+		
+		auto start = std::chrono::steady_clock::now();
+		sink = render(samples);
+		auto stop = std::chrono::steady_clock::now();
+		
+		if (r > 0)
+		{
+			ns.push_back(std::chrono::duration<double, std::nano>(stop - start).count() / samples);
+		}
+	}
+	
+	std::sort(ns.begin(), ns.end());
+	
+	BenchResult b;
+	b.name = name;
+	b.notes = notes;
+	b.nsPerSample = ns[ns.size() / 2];
+	b.nsMin = ns.front();
+	b.nsMax = ns.back();
+	results.push_back(b);
+	
+	fprintf(stderr, "%-24s %2d %10.1f ns/sample %12.0f samples/s\n", name.c_str(), notes, b.nsPerSample, 1e9 / b.nsPerSample);
+}
+
+
+// N saws a block at a time as OscVoice renders them, at spread pitches
+template<uint8_t N>
+static void BenchSawBank(float f)
+{
+	static SawBank<N> bank;
+	static float out[MAX_BLOCK_SIZE * SawBank<N>::LANES];
+	
+	Bench("SawBank<" + std::to_string(N) + ">", 0, 
+		[&]() { bank.Init(options.sampleRate); for (uint8_t i = 0; i < N; i++) { bank.SetFreq(i, f * (1.0f + i * 0.5f)); } }, 
+		[&](size_t n) 
+		{ 
+			float sum = 0; 
+			for (size_t s = 0; s < n; s += MAX_BLOCK_SIZE) 
+			{ 
+				bank.Render(out, MAX_BLOCK_SIZE); 
+				sum += out[0]; 
+			} 
+			return sum; 
+		});
+}
+
+
+// N envelopes a block at a time as the engines render them, half the gates flip every 64 blocks
+// so segment ends are in the mix, compare with N times the Adsr below
+template<uint8_t N>
+static void BenchEnvelopeBank()
+{
+	static EnvelopeBank<N> bank;
+	static float out[MAX_BLOCK_SIZE * EnvelopeBank<N>::LANES];
+	
+	Bench("EnvelopeBank<" + std::to_string(N) + ">", 0, 
+		[&]() { bank.Init(options.sampleRate); bank.SetAttackTime(ADSR_ATTACK_DEFAULT); bank.SetDecayTime(ADSR_DECAY_DEFAULT); bank.SetSustainLevel(ADSR_SUSTAIN_DEFAULT); bank.SetReleaseTime(ADSR_RELEASE_DEFAULT); }, 
+		[&](size_t n) 
+		{ 
+			float sum = 0; 
+			for (size_t s = 0; s < n; s += MAX_BLOCK_SIZE) 
+			{ 
+				size_t block = s / MAX_BLOCK_SIZE;
+				for (uint8_t i = 0; i < N; i++)
+				{
+					bank.SetGate(i, (i & 1) || ((block / 64) & 1));
+				}
+				bank.Render(out, MAX_BLOCK_SIZE); 
+				sum += out[0]; 
+			} 
+			return sum; 
+		});
+}
+
+// a noise filter bank a block at a time as NoiseVoice renders it, every slot sounding at spread
+// notes (tune sets slot i to a note), compare with N times the NoiseFilter below
+template<typename Bank, typename Tune>
+static void BenchNoiseBank(const std::string &name, Tune tune)
+{
+	static Bank bank;
+	static float out[MAX_BLOCK_SIZE * Bank::LANES];
+	
+	Bench(name, 0, 
+		[&]() 
+		{ 
+			bank.Init(options.sampleRate); 
+			for (uint8_t i = 0; i < Bank::LANES; i++) 
+			{ 
+				bank.SetSeed(i, 7 + i * 7); 
+				tune(bank, i, 48 + i * 2); 
+				bank.SetActive(i, true); 
+			} 
+		}, 
+		[&](size_t n) 
+		{ 
+			float sum = 0; 
+			for (size_t s = 0; s < n; s += MAX_BLOCK_SIZE) 
+			{ 
+				bank.Render(NULL, out, MAX_BLOCK_SIZE); 
+				sum += out[0]; 
+			} 
+			return sum; 
+		});
+}
+
+
+// the DaisySP building blocks of the voices and filters, each on its own
+static void BenchPrimitives()
+{
+	float sr = options.sampleRate;
+	float f = mtof(57);
+	
+	static Svf svf;
+	Bench("Svf", 0, 
+		[&]() { svf.Init(sr); svf.SetFreq(2000); svf.SetRes(0.5); }, 
+		[&](size_t n) { float out = 0; for (size_t s = 0; s < n; s++) { svf.Process((s & 64) ? 0.5f : -0.5f); out += svf.Low(); } return out; });
+	
+	static MoogLadder moog;
+	Bench("MoogLadder", 0, 
+		[&]() { moog.Init(sr); moog.SetFreq(2000); moog.SetRes(0.5); }, 
+		[&](size_t n) { float out = 0; for (size_t s = 0; s < n; s++) { out += moog.Process((s & 64) ? 0.5f : -0.5f); } return out; });
+	
+	// the MoogFilter's own ladder, its tanh through MathTanh
+	static Ladder ladder;
+	Bench("Ladder", 0, 
+		[&]() { ladder.Init(sr); ladder.SetFreq(2000); ladder.SetRes(0.5); }, 
+		[&](size_t n) { float out = 0; for (size_t s = 0; s < n; s++) { out += ladder.Process((s & 64) ? 0.5f : -0.5f); } return out; });
+	
+	static StringVoice string;
+	Bench("StringVoice", 0, 
+		[&]() { new (&string) StringVoice(); string.Init(sr); string.SetFreq(f); string.Trig(); }, 
+		[&](size_t n) { float out = 0; for (size_t s = 0; s < n; s++) { out += string.Process(); } return out; });
+	
+	static ModalVoice modal;
+	Bench("ModalVoice", 0, 
+		[&]() { new (&modal) ModalVoice(); modal.Init(sr); modal.SetFreq(f); modal.Trig(); }, 
+		[&](size_t n) { float out = 0; for (size_t s = 0; s < n; s++) { out += modal.Process(); } return out; });
+	
+	static Oscillator osc;
+	Bench("Oscillator polyblep saw", 0, 
+		[&]() { osc.Init(sr); osc.SetWaveform(Oscillator::WAVE_POLYBLEP_SAW); osc.SetFreq(f); }, 
+		[&](size_t n) { float out = 0; for (size_t s = 0; s < n; s++) { out += osc.Process(); } return out; });
+	
+	// the whole bank per sample, compare with N times the Oscillator above
+	BenchSawBank<8>(f);
+	BenchSawBank<16>(f);
+	BenchSawBank<32>(f);
+	
+	static FormantOscillator formant;
+	Bench("FormantOscillator", 0, 
+		[&]() { formant.Init(sr); formant.SetFormantFreq(1000); formant.SetCarrierFreq(f); }, 
+		[&](size_t n) { float out = 0; for (size_t s = 0; s < n; s++) { out += formant.Process(); } return out; });
+	
+	// gate held, sustain at the voices' default of 0 so it runs attack, decay then sustain
+	static Adsr adsr;
+	Bench("Adsr", 0, 
+		[&]() { adsr.Init(sr); adsr.SetAttackTime(ADSR_ATTACK_DEFAULT); adsr.SetDecayTime(ADSR_DECAY_DEFAULT); adsr.SetSustainLevel(ADSR_SUSTAIN_DEFAULT); }, 
+		[&](size_t n) { float out = 0; for (size_t s = 0; s < n; s++) { out += adsr.Process(true); } return out; });
+	
+	BenchEnvelopeBank<8>();
+	BenchEnvelopeBank<16>();
+	BenchEnvelopeBank<32>();
+	
+	static HiHat<SquareNoise> hihat;
+	Bench("HiHat<SquareNoise>", 0, 
+		[&]() { new (&hihat) HiHat<SquareNoise>(); hihat.Init(sr); hihat.SetFreq(f); hihat.Trig(); }, 
+		[&](size_t n) { float out = 0; for (size_t s = 0; s < n; s++) { out += hihat.Process(); } return out; });
+	
+	static NoiseFilter noise;
+	Bench("NoiseFilter", 0, 
+		[&]() { noise.Init(sr, 7); noise.SetAmp(1.0); noise.SetFreq(f); }, 
+		[&](size_t n) { float out = 0; for (size_t s = 0; s < n; s++) { out += noise.Process(1.0); } return out; });
+	
+	// the Svfs against the biquads of NOISE_FILTER_BIQUAD
+	auto svfTune = [](auto &bank, uint8_t i, uint8_t note) { bank.SetFreq(i, mtof(note)); };
+	auto biquadTune = [](auto &bank, uint8_t i, uint8_t note) { bank.SetNote(i, note); };
+	BenchNoiseBank<NoiseFilterBank<8>>("NoiseFilterBank<8>", svfTune);
+	BenchNoiseBank<NoiseFilterBank<16>>("NoiseFilterBank<16>", svfTune);
+	BenchNoiseBank<NoiseFilterBank<32>>("NoiseFilterBank<32>", svfTune);
+	BenchNoiseBank<NoiseBiquadBank<8>>("NoiseBiquadBank<8>", biquadTune);
+	BenchNoiseBank<NoiseBiquadBank<16>>("NoiseBiquadBank<16>", biquadTune);
+	BenchNoiseBank<NoiseBiquadBank<32>>("NoiseBiquadBank<32>", biquadTune);
+}
+
+
+// a voice engine through ProcessBlock() as the block renderer runs it, with notes sounding notes.
+// cc4 if not -1 is sent to the engine's SetCC4() after Init() (voice CC function 4)
+template<template<uint8_t> class Engine, uint8_t N>
+static void BenchVoice(const char *name, int cc4 = -1)
+{
+	typedef Engine<N> V;
+	
+	if (cc4 < 0)
+	{
+		EngineSize size;
+		size.name = name;
+		size.slots = N;
+		size.bytes = sizeof(Engine<N>);
+		size.maxBytes = sizeof(Engine<MAX_POLYPHONY>);
+		sizes.push_back(size);
+	}
+	
+	V *voice = new V();
+	voice->Init(&hw, options.sampleRate);
+	
+	uint8_t max = voice->GetMaxPolyphony();
+	
+	for (uint8_t notes = 1; notes <= max; notes++)
+	{
+		Bench(name, notes, 
+			[&]() 
+			{ 
+				voice->Init(&hw, options.sampleRate); 
+				if (cc4 >= 0)
+				{
+					voice->SetCC4(cc4);
+				}
+				voice->SetPolyphony(max);
+				for (uint8_t i = 0; i < notes; i++)
+				{
+					NoteOnEvent p;
+					p.channel = 0;
+					p.note = 48 + 5 * i;
+					p.velocity = 100;
+					voice->NoteOn(&p);
+				}
+			}, 
+			[&](size_t n) 
+			{ 
+				float block[MAX_BLOCK_SIZE];
+				float out = 0; 
+				for (size_t s = 0; s < n; s += MAX_BLOCK_SIZE) 
+				{ 
+					voice->ProcessBlock(block, MAX_BLOCK_SIZE); 
+					out += block[0]; 
+				} 
+				return out; 
+			});
+	}
+	
+	delete voice;
+}
+
+
+static void BenchVoices()
+{
+	BenchVoice<OscVoice, OSC_VOICE_MAX_POLYPHONY>("OscVoice");
+	BenchVoice<SpringVoice, SPRING_VOICE_MAX_POLYPHONY>("SpringVoice");
+	BenchVoice<MalletVoice, MALLET_VOICE_MAX_POLYPHONY>("MalletVoice");
+	BenchVoice<HiHatVoice, HIHAT_VOICE_MAX_POLYPHONY>("HiHatVoice");
+	BenchVoice<FormantVoice, FORMANT_VOICE_MAX_POLYPHONY>("FormantVoice");
+	BenchVoice<NoiseVoice, NOISE_VOICE_MAX_POLYPHONY>("NoiseVoice");
+	BenchVoice<NoiseVoice, NOISE_VOICE_MAX_POLYPHONY>("NoiseVoice biquad", 127);
+}
+
+
+// each fastmath.h function against libm, its error checked against the documented bound and the
+// median cycles per call of the runs, the seed logs the same at boot (FastMathLog)
+static void BenchFastMath()
+{
+	if (!Selected("FastMath"))
+	{
+		return;
+	}
+	
+	std::vector<FastMathResult> runs[NUM_FAST_FUNCTIONS];
+	FastMathResult r[NUM_FAST_FUNCTIONS];
+	
+	for (int k = 0; k < options.runs; k++)
+	{
+		mathFailed = FastMathCheck(r);
+		for (uint8_t i = 0; i < NUM_FAST_FUNCTIONS; i++)
+		{
+			runs[i].push_back(r[i]);
+		}
+	}
+	
+	float nsPerCycle = 1e9f / CyclesPerSecond();
+	
+	for (uint8_t i = 0; i < NUM_FAST_FUNCTIONS; i++)
+	{
+		std::vector<FastMathResult> &v = runs[i];
+		FastMathResult m = v[0];
+		
+		std::sort(v.begin(), v.end(), [](const FastMathResult &a, const FastMathResult &b) { return a.libmCycles < b.libmCycles; });
+		m.libmCycles = v[v.size() / 2].libmCycles;
+		std::sort(v.begin(), v.end(), [](const FastMathResult &a, const FastMathResult &b) { return a.fastCycles < b.fastCycles; });
+		m.fastCycles = v[v.size() / 2].fastCycles;
+		mathResults.push_back(m);
+		
+		fprintf(stderr, "FastMath %-15s error %8.2e of %8.2e%s %6.1f -> %5.1f ns/call %5.1fx\n", 
+			m.name, m.maxError, m.bound, m.maxError > m.bound ? " FAILED" : "       ", 
+			m.libmCycles * nsPerCycle, m.fastCycles * nsPerCycle, m.libmCycles / m.fastCycles);
+	}
+}
+
+
+static void WriteJson(FILE *f)
+{
+	fprintf(f, "{\n");
+	fprintf(f, "  \"rev\": \"%s\",\n", PINE_GIT_REV);
+	fprintf(f, "  \"compiler\": \"%s\",\n", __VERSION__);
+	fprintf(f, "  \"sample_rate\": %.0f,\n", options.sampleRate);
+	fprintf(f, "  \"block_size\": %d,\n", MAX_BLOCK_SIZE);
+	fprintf(f, "  \"seconds_per_run\": %g,\n", options.seconds);
+	fprintf(f, "  \"runs\": %d,\n", options.runs);
+	fprintf(f, "  \"results\": [\n");
+	
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const BenchResult &b = results[i];
+		fprintf(f, "    {\"name\": \"%s\", \"notes\": %d, \"ns_per_sample\": %.3f, \"ns_min\": %.3f, \"ns_max\": %.3f, \"samples_per_sec\": %.0f}%s\n", 
+			b.name.c_str(), b.notes, b.nsPerSample, b.nsMin, b.nsMax, 1e9 / b.nsPerSample, (i + 1 < results.size()) ? "," : "");
+	}
+	
+	fprintf(f, "  ],\n");
+	fprintf(f, "  \"sizes\": [\n");
+	
+	for (size_t i = 0; i < sizes.size(); i++)
+	{
+		const EngineSize &e = sizes[i];
+		fprintf(f, "    {\"name\": \"%s\", \"slots\": %d, \"bytes\": %zu, \"bytes_at_max_polyphony\": %zu}%s\n", 
+			e.name.c_str(), e.slots, e.bytes, e.maxBytes, (i + 1 < sizes.size()) ? "," : "");
+	}
+	
+	fprintf(f, "  ],\n");
+	fprintf(f, "  \"fastmath\": [\n");
+	
+	float nsPerCycle = 1e9f / CyclesPerSecond();
+	for (size_t i = 0; i < mathResults.size(); i++)
+	{
+		const FastMathResult &m = mathResults[i];
+		fprintf(f, "    {\"name\": \"%s\", \"max_error\": %.3g, \"bound\": %.3g, \"libm_cycles\": %.2f, \"fast_cycles\": %.2f, \"libm_ns\": %.3f, \"fast_ns\": %.3f}%s\n", 
+			m.name, m.maxError, m.bound, m.libmCycles, m.fastCycles, m.libmCycles * nsPerCycle, m.fastCycles * nsPerCycle, (i + 1 < mathResults.size()) ? "," : "");
+	}
+	
+	fprintf(f, "  ]\n");
+	fprintf(f, "}\n");
+}
+
+
+// CostCalibrator::Log()'s lines on stdout
+static void PrintLine(const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	vprintf(format, args);
+	va_end(args);
+	printf("\n");
+}
+
+
+static void Calibrate()
+{
+	CostCalibrator calibrator;
+	std::unique_ptr<Voices> voices(new Voices());
+	
+	voices->Init(&hw, options.sampleRate);
+	calibrator.Init(voices.get(), options.sampleRate);
+	calibrator.Run();
+	calibrator.Log(PrintLine);
+}
+
+
+static void Usage()
+{
+	fprintf(stderr, "usage: pine_bench [--out bench.json] [--sr 48000] [--seconds 0.25] [--runs 7] [--filter name]\n");
+	fprintf(stderr, "       pine_bench --calibrate [--sr 48000]\n");
+}
+
+
+int main(int argc, char **argv)
+{
+	options.sampleRate = 48000.0f;
+	options.seconds = 0.25f;
+	options.runs = 7;
+	options.filter = NULL;
+	options.outPath = NULL;
+	bool calibrate = false;
+	
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--calibrate") == 0)
+		{
+			calibrate = true;
+			continue;
+		}
+		
+		if (i + 1 >= argc)
+		{
+			Usage();
+			return 2;
+		}
+		
+		const char *a = argv[i];
+		const char *v = argv[++i];
+		
+		if (strcmp(a, "--out") == 0)
+		{
+			options.outPath = v;
+		}
+		else if (strcmp(a, "--sr") == 0)
+		{
+			options.sampleRate = atof(v);
+		}
+		else if (strcmp(a, "--seconds") == 0)
+		{
+			options.seconds = atof(v);
+		}
+		else if (strcmp(a, "--runs") == 0)
+		{
+			options.runs = atoi(v);
+		}
+		else if (strcmp(a, "--filter") == 0)
+		{
+			options.filter = v;
+		}
+		else
+		{
+			Usage();
+			return 2;
+		}
+	}
+	
+	if (options.sampleRate <= 0 || options.seconds * options.sampleRate < MAX_BLOCK_SIZE || options.runs < 1)
+	{
+		Usage();
+		return 2;
+	}
+	
+	hw.SetAudioSampleRate(options.sampleRate);
+	
+	if (calibrate)
+	{
+		Calibrate();
+		return 0;
+	}
+	
+	BenchPrimitives();
+	BenchVoices();
+	BenchFastMath();
+	
+	FILE *f = stdout;
+	if (options.outPath != NULL)
+	{
+		f = fopen(options.outPath, "w");
+		if (f == NULL)
+		{
+			fprintf(stderr, "%s: cannot write\n", options.outPath);
+			return 1;
+		}
+	}
+	
+	WriteJson(f);
+	
+	if (f != stdout)
+	{
+		fclose(f);
+	}
+	
+	if (mathFailed > 0)
+	{
+		fprintf(stderr, "%d fast math functions past their error bound\n", mathFailed);
+		return 1;
+	}
+	
+	return 0;
+}
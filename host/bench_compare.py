@@ -0,0 +1,72 @@
+"""
+/*
+ This file is part of Virtual Robot's Pine Synthesizer. 
+
+Copyright <2022> <Brian Gunnison>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+software and associated documentation files (the "Software"), to deal in the Software 
+without restriction, including without limitation the rights to use, copy, modify, 
+merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+permit persons to whom the Software is furnished to do so, subject to the following 
+conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+Compares two pine_bench JSON files, prints the change in ns/sample of each benchmark
+  python bench_compare.py before.json after.json [--threshold 5]
+Exits 1 if anything got slower by more than threshold percent
+"""
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        b = json.load(f)
+    return b, {(r["name"], r["notes"]): r for r in b["results"]}
+
+
+def main():
+    args = sys.argv[1:]
+    threshold = 5.0
+    if "--threshold" in args:
+        i = args.index("--threshold")
+        threshold = float(args[i + 1])
+        del args[i:i + 2]
+
+    if len(args) != 2:
+        print(__doc__.split('*/')[-1].strip())
+        return 2
+
+    before_bench, before = load(args[0])
+    after_bench, after = load(args[1])
+    print("%s -> %s" % (before_bench.get("rev", "?"), after_bench.get("rev", "?")))
+    print("%-24s %5s %10s %10s %8s" % ("name", "notes", "before", "after", "change"))
+
+    slower = 0
+    for key, a in after.items():
+        if key not in before:
+            continue
+        b = before[key]
+        change = (a["ns_per_sample"] - b["ns_per_sample"]) / b["ns_per_sample"] * 100
+        flag = ""
+        if change > threshold:
+            flag = " slower"
+            slower += 1
+        print("%-24s %5d %10.1f %10.1f %+7.1f%%%s" % (key[0], key[1], b["ns_per_sample"], a["ns_per_sample"], change, flag))
+
+    return 1 if slower else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,438 @@
+/*
+ This file is part of Virtual Robot's Pine Synthesizer. 
+
+Copyright <2022> <Brian Gunnison>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+software and associated documentation files (the "Software"), to deal in the Software 
+without restriction, including without limitation the rights to use, copy, modify, 
+merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+permit persons to whom the Software is furnished to do so, subject to the following 
+conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+// Host stand-in for libDaisy's daisy_pod.h. Just enough of DaisyPod, its controls, MIDI events,
+// the USB serial link and System for the synthesis code to build and run on a PC.
+// Pots, buttons and the encoder hold whatever a host program sets them to, nothing reads hardware.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <math.h>
+#include <chrono>
+
+namespace daisy
+{
+
+class AnalogControl
+{
+public:
+	float Process() { return val_; }
+	float Value() const { return val_; }
+	
+	// host only, where the pot is, 0 to 1
+	void SetValue(float v) { val_ = v; }
+	
+private:
+	float val_ = 0.0f;
+};
+
+
+class Switch
+{
+public:
+	bool RisingEdge() const { return rising_; }
+	bool FallingEdge() const { return false; }
+	bool Pressed() const { return pressed_; }
+	
+	// host only, a press shows as one rising edge at the next ProcessDigitalControls()
+	void Press() { pressed_ = true; pending_ = true; }
+	void Release() { pressed_ = false; }
+	void Debounce() { rising_ = pending_; pending_ = false; }
+	
+private:
+	bool pressed_ = false;
+	bool pending_ = false;
+	bool rising_ = false;
+};
+
+
+class Encoder
+{
+public:
+	int32_t Increment() const { return inc_; }
+	bool RisingEdge() const { return false; }
+	
+	// host only, steps reported by the next ProcessDigitalControls()
+	void Turn(int32_t steps) { pending_ += steps; }
+	void Debounce() { inc_ = pending_; pending_ = 0; }
+	
+private:
+	int32_t inc_ = 0;
+	int32_t pending_ = 0;
+};
+
+
+class RgbLed
+{
+public:
+	void Set(float r, float g, float b) { r_ = r; g_ = g; b_ = b; }
+	void Update() {}
+	
+private:
+	float r_ = 0.0f, g_ = 0.0f, b_ = 0.0f;
+};
+
+
+// maps a control onto a range, the same curves as libDaisy
+class Parameter
+{
+public:
+	enum Curve
+	{
+		LINEAR,
+		EXPONENTIAL,
+		LOGARITHMIC,
+		CUBE,
+		LAST
+	};
+	
+	void Init(AnalogControl &input, float min, float max, Curve curve)
+	{
+		pmin_ = min;
+		pmax_ = max;
+		pcurve_ = curve;
+		in_ = &input;
+		lmin_ = logf(min < 0.0000001f ? 0.0000001f : min);
+		lmax_ = logf(max);
+	}
+	
+	float Process()
+	{
+		float v = in_->Value();
+		
+		switch (pcurve_)
+		{
+		case LINEAR:
+			val_ = (v * (pmax_ - pmin_)) + pmin_;
+			break;
+			
+		case EXPONENTIAL:
+			val_ = ((v * v) * (pmax_ - pmin_)) + pmin_;
+			break;
+			
+		case LOGARITHMIC:
+			val_ = expf((v * (lmax_ - lmin_)) + lmin_);
+			break;
+			
+		case CUBE:
+			val_ = ((v * (v * v)) * (pmax_ - pmin_)) + pmin_;
+			break;
+			
+		default:
+			break;
+		}
+		
+		return val_;
+	}
+	
+	float Value() { return val_; }
+	
+private:
+	AnalogControl *in_ = NULL;
+	float pmin_ = 0.0f, pmax_ = 1.0f, lmin_ = 0.0f, lmax_ = 0.0f;
+	Curve pcurve_ = LINEAR;
+	float val_ = 0.0f;
+};
+
+
+// the USB serial link, transmitted bytes go to a host file if one is set (see logger.h for the format)
+class UsbHandle
+{
+public:
+	enum UsbPeriph
+	{
+		FS_INTERNAL,
+		FS_EXTERNAL,
+		FS_BOTH
+	};
+	
+	enum class Result
+	{
+		OK,
+		ERR
+	};
+	
+	typedef void (*ReceiveCallback)(uint8_t *buff, uint32_t *len);
+	
+	void Init(UsbPeriph dev) {}
+	
+	Result TransmitInternal(uint8_t *buff, size_t size)
+	{
+		if (sink_ != NULL)
+		{
+			fwrite(buff, 1, size, sink_);
+		}
+		return Result::OK;
+	}
+	
+	void SetReceiveCallback(ReceiveCallback cb, UsbPeriph dev) { rx_ = cb; }
+	
+	// host only, where transmitted bytes go, NULL drops them
+	void SetSink(FILE *f) { sink_ = f; }
+	
+	// host only, delivers a line as if it had been typed on the serial link
+	void Receive(const char *line)
+	{
+		if (rx_ != NULL)
+		{
+			uint32_t len = 0;
+			while (line[len] != 0)
+			{
+				len++;
+			}
+			rx_((uint8_t *)line, &len);
+		}
+	}
+	
+private:
+	FILE *sink_ = NULL;
+	ReceiveCallback rx_ = NULL;
+};
+
+
+class DaisySeed
+{
+public:
+	UsbHandle usb_handle;
+	void SetLed(bool state) {}
+};
+
+
+enum MidiMessageType
+{
+	NoteOff,
+	NoteOn,
+	PolyphonicKeyPressure,
+	ControlChange,
+	ProgramChange,
+	ChannelPressure,
+	PitchBend,
+	SystemCommon,
+	SystemRealTime,
+	ChannelMode,
+	MessageLast
+};
+
+struct NoteOffEvent
+{
+	int channel;
+	uint8_t note;
+	uint8_t velocity;
+};
+
+struct NoteOnEvent
+{
+	int channel;
+	uint8_t note;
+	uint8_t velocity;
+};
+
+struct ControlChangeEvent
+{
+	int channel;
+	uint8_t control_number;
+	uint8_t value;
+};
+
+struct ProgramChangeEvent
+{
+	int channel;
+	uint8_t program;
+};
+
+struct MidiEvent
+{
+	MidiMessageType type;
+	int channel;
+	uint8_t data[2];
+	
+	NoteOffEvent AsNoteOff()
+	{
+		NoteOffEvent m;
+		m.channel = channel;
+		m.note = data[0];
+		m.velocity = data[1];
+		return m;
+	}
+	
+	NoteOnEvent AsNoteOn()
+	{
+		NoteOnEvent m;
+		m.channel = channel;
+		m.note = data[0];
+		m.velocity = data[1];
+		return m;
+	}
+	
+	ControlChangeEvent AsControlChange()
+	{
+		ControlChangeEvent m;
+		m.channel = channel;
+		m.control_number = data[0];
+		m.value = data[1];
+		return m;
+	}
+	
+	ProgramChangeEvent AsProgramChange()
+	{
+		ProgramChangeEvent m;
+		m.channel = channel;
+		m.program = data[0];
+		return m;
+	}
+};
+
+
+// no UART on the host, a host program feeds the synth directly
+class MidiUartHandler
+{
+public:
+	void StartReceive() {}
+	void Listen() {}
+	bool HasEvents() { return false; }
+	MidiEvent PopEvent() { return MidiEvent(); }
+};
+
+
+class AudioHandle
+{
+public:
+	typedef const float *const *InputBuffer;
+	typedef float **OutputBuffer;
+	typedef const float *InterleavingInputBuffer;
+	typedef float *InterleavingOutputBuffer;
+	typedef void (*InterleavingAudioCallback)(InterleavingInputBuffer in, InterleavingOutputBuffer out, size_t size);
+};
+
+
+class System
+{
+public:
+	static uint32_t GetNow() { return (uint32_t)(Elapsed() / 1000000); }
+	static uint32_t GetUs() { return (uint32_t)(Elapsed() / 1000); }
+	static void Delay(uint32_t ms) {}
+	
+private:
+	static uint64_t Elapsed()
+	{
+		static const auto start = std::chrono::steady_clock::now();
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+};
+
+
+// same interface as libDaisy's, a host program drives OnBlockStart/End around its own render calls
+class CpuLoadMeter
+{
+public:
+	void Init(float sampleRateInHz, int blockSizeInSamples, float smoothingFilterCutoffHz = 1.0f)
+	{
+		blockNs_ = 1e9f * blockSizeInSamples / sampleRateInHz;
+		coeff_ = 1.0f - expf(-2.0f * 3.14159265f * smoothingFilterCutoffHz * blockSizeInSamples / sampleRateInHz);
+		Reset();
+	}
+	
+	void OnBlockStart() { start_ = std::chrono::steady_clock::now(); }
+	
+	void OnBlockEnd()
+	{
+		float ns = std::chrono::duration<float, std::nano>(std::chrono::steady_clock::now() - start_).count();
+		float load = ns / blockNs_;
+		
+		if (first_)
+		{
+			min_ = max_ = avg_ = load;
+			first_ = false;
+			return;
+		}
+		
+		avg_ += (load - avg_) * coeff_;
+		if (load < min_)
+		{
+			min_ = load;
+		}
+		if (load > max_)
+		{
+			max_ = load;
+		}
+	}
+	
+	float GetAvgCpuLoad() const { return avg_; }
+	float GetMinCpuLoad() const { return min_; }
+	float GetMaxCpuLoad() const { return max_; }
+	
+	void Reset()
+	{
+		first_ = true;
+		min_ = max_ = avg_ = 0.0f;
+	}
+	
+private:
+	std::chrono::steady_clock::time_point start_;
+	float blockNs_ = 1e6f;
+	float coeff_ = 0.01f;
+	float min_ = 0.0f, max_ = 0.0f, avg_ = 0.0f;
+	bool first_ = true;
+};
+
+
+class DaisyPod
+{
+public:
+	DaisySeed seed;
+	Encoder encoder;
+	AnalogControl knob1, knob2;
+	Switch button1, button2;
+	RgbLed led1, led2;
+	MidiUartHandler midi;
+	
+	void Init(bool boost = false) {}
+	void SetAudioBlockSize(size_t size) { blockSize_ = size; }
+	size_t AudioBlockSize() { return blockSize_; }
+	float AudioSampleRate() { return sampleRate_; }
+	
+	// host only, the pod runs at 48 kHz
+	void SetAudioSampleRate(float sr) { sampleRate_ = sr; }
+	
+	void StartAdc() {}
+	void StartAudio(AudioHandle::InterleavingAudioCallback cb) {}
+	void ProcessAnalogControls() {}
+	
+	void ProcessDigitalControls()
+	{
+		encoder.Debounce();
+		button1.Debounce();
+		button2.Debounce();
+	}
+	
+	void UpdateLeds() {}
+	
+private:
+	size_t blockSize_ = 48;
+	float sampleRate_ = 48000.0f;
+};
+
+} // namespace daisy
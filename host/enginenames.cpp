@@ -0,0 +1,104 @@
+/*
+ This file is part of Virtual Robot's Pine Synthesizer. 
+
+Copyright <2022> <Brian Gunnison>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+software and associated documentation files (the "Software"), to deal in the Software 
+without restriction, including without limitation the rights to use, copy, modify, 
+merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+permit persons to whom the Software is furnished to do so, subject to the following 
+conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "voice.h"
+#include "filter.h"
+#include "enginenames.h"
+
+
+#define VOICE_NAME(type, engine, slots, member, name, r, g, b, shortName, cost) shortName,
+static const char *voiceNames[NUM_VOICES] = { VOICE_ENGINES(VOICE_NAME) };
+#undef VOICE_NAME
+static const char *filterNames[NUM_FILTERS] = { "none", "svf", "moog" };
+
+
+const char *GetVoiceName(int v)
+{
+	return (v >= 0 && v < NUM_VOICES) ? voiceNames[v] : "?";
+}
+
+
+const char *GetFilterName(int f)
+{
+	return (f >= 0 && f < NUM_FILTERS) ? filterNames[f] : "?";
+}
+
+
+static bool ParseSelector(const char *s, const char **names, int n, int &sel)
+{
+	if (strcmp(s, "all") == 0)
+	{
+		sel = -1;
+		return true;
+	}
+	
+	for (int i = 0; i < n; i++)
+	{
+		if (strcmp(s, names[i]) == 0)
+		{
+			sel = i;
+			return true;
+		}
+	}
+	
+	char *end;
+	long v = strtol(s, &end, 10);
+	if (*end != 0 || v < 0 || v >= n)
+	{
+		return false;
+	}
+	
+	sel = (int)v;
+	return true;
+}
+
+
+bool ParseVoice(const char *s, int &v)
+{
+	return ParseSelector(s, voiceNames, NUM_VOICES, v);
+}
+
+
+bool ParseFilter(const char *s, int &f)
+{
+	return ParseSelector(s, filterNames, NUM_FILTERS, f);
+}
+
+
+void PrintEngineNames(FILE *f)
+{
+	fprintf(f, "  voices:");
+	for (int v = 0; v < NUM_VOICES; v++)
+	{
+		fprintf(f, " %d %s", v, voiceNames[v]);
+	}
+	
+	fprintf(f, "\n  filters:");
+	for (int i = 0; i < NUM_FILTERS; i++)
+	{
+		fprintf(f, " %d %s", i, filterNames[i]);
+	}
+	fprintf(f, "\n");
+}
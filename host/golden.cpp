@@ -0,0 +1,405 @@
+/*
+ This file is part of Virtual Robot's Pine Synthesizer. 
+
+Copyright <2022> <Brian Gunnison>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+software and associated documentation files (the "Software"), to deal in the Software 
+without restriction, including without limitation the rights to use, copy, modify, 
+merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+permit persons to whom the Software is furnished to do so, subject to the following 
+conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+// pine_golden, renders fixed MIDI scenarios through every voice and filter and compares them with
+// reference WAV files by max abs error, RMS error and spectral distance against per voice thresholds,
+// so a performance change can be accepted when the numbers show the sound still matches.
+//
+//   pine_golden --update [--dir golden]	render the references, on a commit whose sound is known good
+//   pine_golden [--dir golden]				compare, exits 1 if any render is outside its thresholds
+//
+// A render that fails is written next to its reference as <name>.new.wav to listen to.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <complex>
+#include <filesystem>
+#include "daisy_pod.h"
+#include "voice.h"
+#include "filter.h"
+#include "offline.h"
+#include "wavfile.h"
+#include "enginenames.h"
+
+using namespace daisy;
+
+extern DaisyPod hw;
+
+#define GOLDEN_SAMPLE_RATE	48000
+#define GOLDEN_BLOCK_SIZE	48
+#define GOLDEN_TAIL			1.0f
+
+// spectral distance frames
+#define GOLDEN_FFT_SIZE		1024
+#define GOLDEN_FFT_HOP		512
+#define GOLDEN_FLOOR_DB		-80.0	// dBFS, bins below this in both renders do not count, differences in inaudible tails do not fail
+
+typedef struct
+{
+	float maxAbs;		// largest sample difference
+	float rms;			// RMS of the difference
+	float spectralDb;	// mean log spectral distance, dB
+}GoldenThresholds;
+
+// in Voices::VOICE_TYPE order. The noise voice is judged by its spectrum, a change in the noise
+// generator moves every sample but not the sound
+static const GoldenThresholds thresholds[NUM_VOICES] = 
+{
+	{ 1e-3f, 1e-4f, 0.5f },		// synth
+	{ 1e-3f, 1e-4f, 0.5f },		// spring
+	{ 1e-3f, 1e-4f, 0.5f },		// mallet
+	{ 1e-3f, 1e-4f, 0.5f },		// formant
+	{ 2.0f, 0.5f, 1.0f },		// noise
+};
+
+typedef struct
+{
+	float maxAbs;
+	float rms;
+	float spectralDb;
+}GoldenDistance;
+
+
+static MidiFileEvent Message(double seconds, MidiMessageType type, uint8_t d0, uint8_t d1)
+{
+	MidiFileEvent e;
+	e.seconds = seconds;
+	e.event.type = type;
+	e.event.channel = 0;
+	e.event.data[0] = d0;
+	e.event.data[1] = d1;
+	return e;
+}
+
+
+// overlapping notes of A minor pentatonic over two octaves
+static void Melody(std::vector<MidiFileEvent> &s)
+{
+	const uint8_t notes[] = { 57, 60, 62, 64, 67, 69, 72, 74, 76, 79 };
+	for (size_t i = 0; i < sizeof(notes); i++)
+	{
+		s.push_back(Message(i * 0.2, NoteOn, notes[i], 100));
+		s.push_back(Message(i * 0.2 + 0.3, NoteOff, notes[i], 0));
+	}
+}
+
+
+// every slot at once, held and released together
+static void Chord(std::vector<MidiFileEvent> &s)
+{
+	for (uint8_t i = 0; i < MAX_POLYPHONY; i++)
+	{
+		s.push_back(Message(0.0, NoteOn, 45 + 5 * i, 90));
+	}
+	for (uint8_t i = 0; i < MAX_POLYPHONY; i++)
+	{
+		s.push_back(Message(1.5, NoteOff, 45 + 5 * i, 0));
+	}
+}
+
+
+// one note at rising velocities
+static void Velocity(std::vector<MidiFileEvent> &s)
+{
+	for (uint8_t i = 0; i < 8; i++)
+	{
+		s.push_back(Message(i * 0.25, NoteOn, 60, 16 + 16 * i - 1));
+		s.push_back(Message(i * 0.25 + 0.2, NoteOff, 60, 0));
+	}
+}
+
+
+// the filter cutoff swept by CC (Alesis V125 map) with resonance up and notes held
+static void Sweep(std::vector<MidiFileEvent> &s)
+{
+	s.push_back(Message(0.0, ControlChange, 21, 100));
+	s.push_back(Message(0.0, NoteOn, 48, 100));
+	s.push_back(Message(0.0, NoteOn, 55, 100));
+	s.push_back(Message(0.0, NoteOn, 60, 100));
+	
+	for (uint8_t i = 0; i <= 127; i++)
+	{
+		s.push_back(Message(0.01 + i * 0.015, ControlChange, 20, i));
+	}
+	
+	s.push_back(Message(2.0, NoteOff, 48, 0));
+	s.push_back(Message(2.0, NoteOff, 55, 0));
+	s.push_back(Message(2.0, NoteOff, 60, 0));
+}
+
+
+typedef struct
+{
+	const char *name;
+	void (*make)(std::vector<MidiFileEvent> &s);
+	bool ccMap;
+}GoldenScenario;
+
+static const GoldenScenario scenarios[] = 
+{
+	{ "melody", Melody, false },
+	{ "chord", Chord, false },
+	{ "velocity", Velocity, false },
+	{ "sweep", Sweep, true },
+};
+
+#define NUM_SCENARIOS (sizeof(scenarios) / sizeof(scenarios[0]))
+
+
+// in place radix 2 FFT, n a power of 2
+static void FFT(std::vector<std::complex<double>> &x)
+{
+	size_t n = x.size();
+	
+	for (size_t i = 1, j = 0; i < n; i++)
+	{
+		size_t bit = n >> 1;
+		for (; j & bit; bit >>= 1)
+		{
+			j ^= bit;
+		}
+		j ^= bit;
+		
+		if (i < j)
+		{
+			std::swap(x[i], x[j]);
+		}
+	}
+	
+	for (size_t len = 2; len <= n; len <<= 1)
+	{
+		std::complex<double> w = std::polar(1.0, -2.0 * M_PI / len);
+		for (size_t i = 0; i < n; i += len)
+		{
+			std::complex<double> wk = 1.0;
+			for (size_t k = 0; k < len / 2; k++)
+			{
+				std::complex<double> a = x[i + k];
+				std::complex<double> b = x[i + k + len / 2] * wk;
+				x[i + k] = a + b;
+				x[i + k + len / 2] = a - b;
+				wk *= w;
+			}
+		}
+	}
+}
+
+
+// power spectrum of one Hann windowed frame of the left channel, dBFS so a full scale sine peaks at 0
+static void FrameSpectrum(const std::vector<float> &in, size_t start, std::vector<double> &db)
+{
+	std::vector<std::complex<double>> x(GOLDEN_FFT_SIZE);
+	
+	for (size_t i = 0; i < GOLDEN_FFT_SIZE; i++)
+	{
+		size_t frame = start + i;
+		double s = (2 * frame < in.size()) ? in[2 * frame] : 0.0;
+		x[i] = s * 0.5 * (1.0 - cos(2.0 * M_PI * i / GOLDEN_FFT_SIZE));
+	}
+	
+	FFT(x);
+	
+	// the Hann window sums to N / 2, a sine of amplitude A gives a bin of A * N / 4
+	double scale = 4.0 / GOLDEN_FFT_SIZE;
+	
+	db.resize(GOLDEN_FFT_SIZE / 2 + 1);
+	for (size_t k = 0; k < db.size(); k++)
+	{
+		db[k] = 10.0 * log10(std::norm(x[k]) * scale * scale + 1e-20);
+	}
+}
+
+
+static GoldenDistance Compare(const std::vector<float> &ref, const std::vector<float> &out)
+{
+	GoldenDistance d = { 0.0f, 0.0f, 0.0f };
+	size_t n = std::max(ref.size(), out.size());
+	double sum = 0.0;
+	
+	for (size_t i = 0; i < n; i++)
+	{
+		float a = (i < ref.size()) ? ref[i] : 0.0f;
+		float b = (i < out.size()) ? out[i] : 0.0f;
+		float e = fabsf(a - b);
+		
+		d.maxAbs = std::max(d.maxAbs, e);
+		sum += (double)e * e;
+	}
+	
+	d.rms = n ? (float)sqrt(sum / n) : 0.0f;
+	
+	// log spectral distance, the RMS difference in dB over the bins that are above the floor, averaged over frames
+	size_t frames = n / 2;
+	double total = 0.0;
+	size_t counted = 0;
+	std::vector<double> a, b;
+	
+	for (size_t start = 0; start + GOLDEN_FFT_SIZE <= frames; start += GOLDEN_FFT_HOP)
+	{
+		FrameSpectrum(ref, start, a);
+		FrameSpectrum(out, start, b);
+		
+		double frameSum = 0.0;
+		size_t bins = 0;
+		for (size_t k = 0; k < a.size(); k++)
+		{
+			if (a[k] < GOLDEN_FLOOR_DB && b[k] < GOLDEN_FLOOR_DB)
+			{
+				continue;
+			}
+			
+			double x = std::max(a[k], GOLDEN_FLOOR_DB) - std::max(b[k], GOLDEN_FLOOR_DB);
+			frameSum += x * x;
+			bins++;
+		}
+		
+		if (bins > 0)
+		{
+			total += sqrt(frameSum / bins);
+			counted++;
+		}
+	}
+	
+	d.spectralDb = counted ? (float)(total / counted) : 0.0f;
+	
+	return d;
+}
+
+
+static void Usage()
+{
+	fprintf(stderr, "usage: pine_golden [--update] [--dir golden]\n");
+}
+
+
+int main(int argc, char **argv)
+{
+	bool update = false;
+	std::string dir = "golden";
+	
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--update") == 0)
+		{
+			update = true;
+		}
+		else if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc)
+		{
+			dir = argv[++i];
+		}
+		else
+		{
+			Usage();
+			return 2;
+		}
+	}
+	
+	hw.SetAudioSampleRate(GOLDEN_SAMPLE_RATE);
+	
+	OfflineSettings settings;
+	settings.sampleRate = GOLDEN_SAMPLE_RATE;
+	settings.blockSize = GOLDEN_BLOCK_SIZE;
+	settings.tail = GOLDEN_TAIL;
+	settings.gain = 1.0f;
+	settings.voiceCC4 = -1;
+	
+	if (update)
+	{
+		std::error_code ec;
+		std::filesystem::create_directories(dir, ec);
+	}
+	
+	int failed = 0;
+	int missing = 0;
+	std::vector<float> out;
+	std::vector<float> ref;
+	
+	if (!update)
+	{
+		printf("%-9s %-8s %-6s %10s %10s %8s\n", "scenario", "voice", "filter", "max abs", "rms", "spec dB");
+	}
+	
+	for (size_t sc = 0; sc < NUM_SCENARIOS; sc++)
+	{
+		std::vector<MidiFileEvent> song;
+		scenarios[sc].make(song);
+		std::stable_sort(song.begin(), song.end(), [](const MidiFileEvent &a, const MidiFileEvent &b) { return a.seconds < b.seconds; });
+		settings.ccMap = scenarios[sc].ccMap;
+		
+		for (int v = 0; v < NUM_VOICES; v++)
+		{
+			for (int f = 0; f < NUM_FILTERS; f++)
+			{
+				std::string name = dir + "/" + scenarios[sc].name + "-" + GetVoiceName(v) + "-" + GetFilterName(f);
+				RenderOffline(song, settings, v, f, out);
+				
+				if (update)
+				{
+					if (!WriteWavFile((name + ".wav").c_str(), out.data(), out.size() / 2, 2, GOLDEN_SAMPLE_RATE))
+					{
+						fprintf(stderr, "%s.wav: cannot write\n", name.c_str());
+						return 1;
+					}
+					continue;
+				}
+				
+				uint16_t channels;
+				uint32_t sampleRate;
+				std::string error;
+				if (!ReadWavFile((name + ".wav").c_str(), ref, channels, sampleRate, error) || channels != 2 || sampleRate != GOLDEN_SAMPLE_RATE)
+				{
+					printf("%-9s %-8s %-6s no reference\n", scenarios[sc].name, GetVoiceName(v), GetFilterName(f));
+					missing++;
+					continue;
+				}
+				
+				GoldenDistance d = Compare(ref, out);
+				const GoldenThresholds &t = thresholds[v];
+				bool pass = d.maxAbs <= t.maxAbs && d.rms <= t.rms && d.spectralDb <= t.spectralDb;
+				
+				printf("%-9s %-8s %-6s %10.2e %10.2e %8.3f%s\n", scenarios[sc].name, GetVoiceName(v), GetFilterName(f), 
+					d.maxAbs, d.rms, d.spectralDb, pass ? "" : "  FAIL");
+				
+				if (!pass)
+				{
+					WriteWavFile((name + ".new.wav").c_str(), out.data(), out.size() / 2, 2, GOLDEN_SAMPLE_RATE);
+					failed++;
+				}
+			}
+		}
+	}
+	
+	if (update)
+	{
+		printf("references written to %s\n", dir.c_str());
+		return 0;
+	}
+	
+	printf("%d failed, %d without a reference\n", failed, missing);
+	
+	return (failed || missing) ? 1 : 0;
+}
@@ -0,0 +1,304 @@
+/*
+ This file is part of Virtual Robot's Pine Synthesizer. 
+
+Copyright <2022> <Brian Gunnison>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+software and associated documentation files (the "Software"), to deal in the Software 
+without restriction, including without limitation the rights to use, copy, modify, 
+merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+permit persons to whom the Software is furnished to do so, subject to the following 
+conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include <stdio.h>
+#include <algorithm>
+#include "midifile.h"
+
+
+typedef struct
+{
+	uint64_t tick;
+	uint32_t order;		// file order, keeps events on the same tick in sequence
+	bool tempo;
+	uint32_t usPerQuarter;
+	MidiEvent event;
+}TrackEvent;
+
+
+static uint32_t ReadBE(const uint8_t *p, uint8_t n)
+{
+	uint32_t v = 0;
+	for (uint8_t i = 0; i < n; i++)
+	{
+		v = (v << 8) | p[i];
+	}
+	return v;
+}
+
+
+// variable length quantity, false if it runs off the end
+static bool ReadVLQ(const std::vector<uint8_t> &d, size_t &pos, size_t end, uint32_t &v)
+{
+	v = 0;
+	for (uint8_t i = 0; i < 4; i++)
+	{
+		if (pos >= end)
+		{
+			return false;
+		}
+		
+		uint8_t b = d[pos++];
+		v = (v << 7) | (b & 0x7F);
+		if ((b & 0x80) == 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+
+static bool ReadTrack(const std::vector<uint8_t> &d, size_t pos, size_t end, std::vector<TrackEvent> &out, std::string &error)
+{
+	uint64_t tick = 0;
+	uint8_t status = 0;
+	
+	while (pos < end)
+	{
+		uint32_t delta;
+		if (!ReadVLQ(d, pos, end, delta) || pos >= end)
+		{
+			error = "truncated track";
+			return false;
+		}
+		tick += delta;
+		
+		uint8_t b = d[pos];
+		if (b & 0x80)
+		{
+			pos++;
+			
+			if (b == 0xFF)
+			{
+				// meta event, only tempo matters
+				if (pos >= end)
+				{
+					error = "truncated meta event";
+					return false;
+				}
+				uint8_t type = d[pos++];
+				uint32_t len;
+				if (!ReadVLQ(d, pos, end, len) || pos + len > end)
+				{
+					error = "truncated meta event";
+					return false;
+				}
+				
+				if (type == 0x51 && len == 3)
+				{
+					TrackEvent t = {};
+					t.tick = tick;
+					t.tempo = true;
+					t.usPerQuarter = ReadBE(&d[pos], 3);
+					out.push_back(t);
+				}
+				
+				if (type == 0x2F)
+				{
+					return true; // end of track
+				}
+				
+				pos += len;
+				continue;
+			}
+			
+			if (b == 0xF0 || b == 0xF7)
+			{
+				// sysex, skipped
+				uint32_t len;
+				if (!ReadVLQ(d, pos, end, len) || pos + len > end)
+				{
+					error = "truncated sysex";
+					return false;
+				}
+				pos += len;
+				continue;
+			}
+			
+			status = b;
+		}
+		else if (status == 0)
+		{
+			error = "running status without a status byte";
+			return false;
+		}
+		
+		// channel message, running status when the status byte was left out
+		uint8_t kind = status & 0xF0;
+		uint8_t n = (kind == 0xC0 || kind == 0xD0) ? 1 : 2;
+		if (pos + n > end)
+		{
+			error = "truncated channel message";
+			return false;
+		}
+		
+		TrackEvent t = {};
+		t.tick = tick;
+		t.event.channel = status & 0x0F;
+		t.event.data[0] = d[pos];
+		t.event.data[1] = (n == 2) ? d[pos + 1] : 0;
+		pos += n;
+		
+		switch (kind)
+		{
+		case 0x80:
+			t.event.type = NoteOff;
+			break;
+			
+		case 0x90:
+			t.event.type = (t.event.data[1] == 0) ? NoteOff : NoteOn;
+			break;
+			
+		case 0xA0:
+			t.event.type = PolyphonicKeyPressure;
+			break;
+			
+		case 0xB0:
+			t.event.type = ControlChange;
+			break;
+			
+		case 0xC0:
+			t.event.type = ProgramChange;
+			break;
+			
+		case 0xD0:
+			t.event.type = ChannelPressure;
+			break;
+			
+		default:
+			t.event.type = PitchBend;
+			break;
+		}
+		
+		out.push_back(t);
+	}
+	
+	return true;
+}
+
+
+bool ReadMidiFile(const char *path, std::vector<MidiFileEvent> &events, std::string &error)
+{
+	FILE *f = fopen(path, "rb");
+	if (f == NULL)
+	{
+		error = "cannot open " + std::string(path);
+		return false;
+	}
+	
+	std::vector<uint8_t> d;
+	uint8_t buf[4096];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+	{
+		d.insert(d.end(), buf, buf + n);
+	}
+	fclose(f);
+	
+	if (d.size() < 14 || ReadBE(&d[0], 4) != 0x4D546864) // MThd
+	{
+		error = "not a standard MIDI file";
+		return false;
+	}
+	
+	uint32_t headerLen = ReadBE(&d[4], 4);
+	uint16_t format = ReadBE(&d[8], 2);
+	uint16_t tracks = ReadBE(&d[10], 2);
+	uint16_t division = ReadBE(&d[12], 2);
+	
+	if (format > 1)
+	{
+		error = "only format 0 and 1 files are supported";
+		return false;
+	}
+	
+	if (division & 0x8000)
+	{
+		error = "SMPTE time division is not supported";
+		return false;
+	}
+	
+	// ticks per quarter note, every event time divides by it
+	if (division == 0)
+	{
+		error = "time division of 0 ticks per quarter note";
+		return false;
+	}
+	
+	std::vector<TrackEvent> all;
+	size_t pos = 8 + headerLen;
+	
+	for (uint16_t t = 0; t < tracks && pos + 8 <= d.size(); t++)
+	{
+		uint32_t len = ReadBE(&d[pos + 4], 4);
+		size_t start = pos + 8;
+		size_t end = start + len;
+		if (end > d.size())
+		{
+			error = "truncated file";
+			return false;
+		}
+		
+		if (ReadBE(&d[pos], 4) == 0x4D54726B) // MTrk
+		{
+			if (!ReadTrack(d, start, end, all, error))
+			{
+				return false;
+			}
+		}
+		
+		pos = end;
+	}
+	
+	for (size_t i = 0; i < all.size(); i++)
+	{
+		all[i].order = i;
+	}
+	
+	std::stable_sort(all.begin(), all.end(), [](const TrackEvent &a, const TrackEvent &b) { return a.tick < b.tick; });
+	
+	// ticks to seconds through the tempo map, 120 bpm until the first tempo event
+	double usPerTick = 500000.0 / division;
+	double seconds = 0.0;
+	uint64_t lastTick = 0;
+	
+	events.clear();
+	for (const TrackEvent &t : all)
+	{
+		seconds += (t.tick - lastTick) * usPerTick / 1e6;
+		lastTick = t.tick;
+		
+		if (t.tempo)
+		{
+			usPerTick = (double)t.usPerQuarter / division;
+			continue;
+		}
+		
+		MidiFileEvent e;
+		e.seconds = seconds;
+		e.event = t.event;
+		events.push_back(e);
+	}
+	
+	return true;
+}
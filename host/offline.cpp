@@ -0,0 +1,128 @@
+/*
+ This file is part of Virtual Robot's Pine Synthesizer. 
+
+Copyright <2022> <Brian Gunnison>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+software and associated documentation files (the "Software"), to deal in the Software 
+without restriction, including without limitation the rights to use, copy, modify, 
+merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+permit persons to whom the Software is furnished to do so, subject to the following 
+conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include <chrono>
+#include <memory>
+#include "daisy_pod.h"
+#include "voice.h"
+#include "filter.h"
+#include "midimap.h"
+#include "blockrender.h"
+#include "offline.h"
+
+using namespace daisy;
+
+extern DaisyPod hw;
+
+
+OfflineResult RenderOffline(const std::vector<MidiFileEvent> &song, const OfflineSettings &o, int v, int f, std::vector<float> &out)
+{
+	// new engines and maps each time so one combination does not leave notes or a scale behind for the next
+	std::unique_ptr<Voices> ownVoices(new Voices());
+	std::unique_ptr<Filters> ownFilters(new Filters());
+	Voices *voices = ownVoices.get();
+	Filters *filters = ownFilters.get();
+	CCMIDIMap ccmap;
+	CCMIDINoteMap noteMap;
+	BlockRenderer renderer;
+	
+	voices->Init(&hw, o.sampleRate);
+	filters->Init(&hw, o.sampleRate);
+	voices->CCProcess(10 + v, 0);
+	while (voices->BeginBlock())
+	{
+		// both steps of the switch before the render starts
+	}
+	if (o.voiceCC4 >= 0)
+	{
+		voices->CCProcess(4, o.voiceCC4);
+	}
+	filters->CCProcess(10 + f, 0);
+	
+	ccmap.Init();
+	noteMap.Init();
+	if (o.ccMap)
+	{
+		SetAlesisV125MIDIMap(&ccmap, &noteMap, voices, filters);
+	}
+	else
+	{
+		noteMap.SetOctaveUpDownNotes(40, 41);
+		SetFCB1010MIDIMap(&noteMap);
+	}
+	
+	renderer.Init(voices, filters, &ccmap, o.sampleRate, o.blockSize);
+	
+	uint32_t last = song.empty() ? 0 : (uint32_t)(song.back().seconds * o.sampleRate);
+	size_t frames = last + (size_t)(o.tail * o.sampleRate);
+	frames = (frames + o.blockSize - 1) / o.blockSize * o.blockSize;
+	
+	out.assign(frames * 2, 0.0f);
+	std::vector<float> block(o.blockSize);
+	size_t next = 0;
+	
+	auto start = std::chrono::steady_clock::now();
+	
+	for (size_t pos = 0; pos < frames; pos += o.blockSize)
+	{
+		// events due in this block, queued just before it as the main loop would, stamped a block early
+		// because the renderer plays events a block after their timestamp
+		while (next < song.size() && (size_t)(song[next].seconds * o.sampleRate) < pos + o.blockSize)
+		{
+			MidiEvent m = song[next].event;
+			SynthEvent e;
+			uint32_t sample = (uint32_t)(song[next].seconds * o.sampleRate);
+			
+			if (MapMidiMessage(&m, &noteMap, &e))
+			{
+				renderer.Post(e, sample - (uint32_t)o.blockSize);
+			}
+			next++;
+		}
+		
+		// the pod's silence bypass, so the renders show what it leaves out
+		if (renderer.Silent())
+		{
+			renderer.Skip(block.data(), o.blockSize);
+		}
+		else
+		{
+			renderer.Render(block.data(), o.blockSize);
+		}
+		
+		for (size_t i = 0; i < o.blockSize; i++)
+		{
+			out[2 * (pos + i)] = block[i] * o.gain;
+			out[2 * (pos + i) + 1] = block[i] * o.gain;
+		}
+	}
+	
+	auto end = std::chrono::steady_clock::now();
+	
+	OfflineResult r;
+	r.seconds = std::chrono::duration<double>(end - start).count();
+	r.overflows = renderer.GetQueueCounters().overflows;
+	r.late = renderer.GetCounters().late;
+	r.silent = renderer.GetCounters().silent;
+	
+	return r;
+}
@@ -0,0 +1,51 @@
+/*
+ This file is part of Virtual Robot's Pine Synthesizer. 
+
+Copyright <2022> <Brian Gunnison>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+software and associated documentation files (the "Software"), to deal in the Software 
+without restriction, including without limitation the rights to use, copy, modify, 
+merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+permit persons to whom the Software is furnished to do so, subject to the following 
+conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "midifile.h"
+
+typedef struct
+{
+	float sampleRate;
+	size_t blockSize;
+	float tail;			// seconds rendered after the last event
+	float gain;
+	bool ccMap;			// CCs through the Alesis V125 map, else the pod's setup: no CC map, FCB1010 note maps
+	int voiceCC4;		// -1 none, else sent to the voice as CC function 4 once selected (the noise voice's filters)
+}OfflineSettings;
+
+typedef struct
+{
+	double seconds;		// wall clock time of the render loop
+	uint32_t overflows;	// events lost to a full queue
+	uint32_t late;		// events played after their sample
+	uint32_t silent;	// blocks the silence bypass skipped
+}OfflineResult;
+
+// renders the song with voice v and filter f into interleaved stereo, as the pod's audio callback does.
+// Events go through the note map and the block renderer's queue and land on their sample.
+// New engines and maps each call, so nothing carries over from one render to the next.
+OfflineResult RenderOffline(const std::vector<MidiFileEvent> &song, const OfflineSettings &o, int v, int f, std::vector<float> &out);
@@ -0,0 +1,237 @@
+/*
+ This file is part of Virtual Robot's Pine Synthesizer. 
+
+Copyright <2022> <Brian Gunnison>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+software and associated documentation files (the "Software"), to deal in the Software 
+without restriction, including without limitation the rights to use, copy, modify, 
+merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+permit persons to whom the Software is furnished to do so, subject to the following 
+conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+// pine_render, plays a MIDI file through the synthesis core into a WAV file and reports how much faster
+// than real time each voice and filter renders it.
+//
+//   pine_render in.mid out.wav [--voice N|all] [--filter N|all] [--sr 48000] [--block 48] [--tail sec] [--gain g] [--cc4 value]
+//
+// --cc4 sends the value to the voice as CC function 4, for the noise voice 127 renders with the biquad filters.
+// The MIDI goes the same way as on the pod: the note map (FCB1010 scales, octave notes 40 and 41), then the
+// block renderer's queue, so each event lands on its sample. With all voices or filters one file is written
+// per combination, out-<voice>-<filter>.wav.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "daisy_pod.h"
+#include "voice.h"
+#include "filter.h"
+#include "midifile.h"
+#include "offline.h"
+#include "wavfile.h"
+#include "enginenames.h"
+
+using namespace daisy;
+
+extern DaisyPod hw;
+
+typedef struct
+{
+	const char *midiPath;
+	const char *wavPath;
+	int voice;			// -1 all
+	int filter;			// -1 all
+	float sampleRate;
+	size_t blockSize;
+	float tail;			// seconds rendered after the last event
+	float gain;
+	int cc4;			// -1 none
+}RenderOptions;
+
+
+
+static void Usage()
+{
+	fprintf(stderr, "usage: pine_render in.mid out.wav [--voice N|all] [--filter N|all] [--sr 48000] [--block 48] [--tail sec] [--gain g] [--cc4 value]\n");
+	PrintEngineNames(stderr);
+}
+
+
+static bool ParseArgs(int argc, char **argv, RenderOptions &o)
+{
+	o.midiPath = NULL;
+	o.wavPath = NULL;
+	o.voice = Voices::SYNTH_VOICE;
+	o.filter = Filters::NO_FILTER;
+	o.sampleRate = 48000.0f;
+	o.blockSize = 48;
+	o.tail = 2.0f;
+	o.gain = 1.0f;
+	o.cc4 = -1;
+	
+	for (int i = 1; i < argc; i++)
+	{
+		const char *a = argv[i];
+		const char *v = (i + 1 < argc) ? argv[i + 1] : NULL;
+		
+		if (a[0] != '-' || a[1] != '-')
+		{
+			if (o.midiPath == NULL)
+			{
+				o.midiPath = a;
+			}
+			else if (o.wavPath == NULL)
+			{
+				o.wavPath = a;
+			}
+			else
+			{
+				return false;
+			}
+			continue;
+		}
+		
+		if (v == NULL)
+		{
+			return false;
+		}
+		i++;
+		
+		if (strcmp(a, "--voice") == 0)
+		{
+			if (!ParseVoice(v, o.voice))
+			{
+				return false;
+			}
+		}
+		else if (strcmp(a, "--filter") == 0)
+		{
+			if (!ParseFilter(v, o.filter))
+			{
+				return false;
+			}
+		}
+		else if (strcmp(a, "--sr") == 0)
+		{
+			o.sampleRate = atof(v);
+		}
+		else if (strcmp(a, "--block") == 0)
+		{
+			o.blockSize = atoi(v);
+		}
+		else if (strcmp(a, "--tail") == 0)
+		{
+			o.tail = atof(v);
+		}
+		else if (strcmp(a, "--gain") == 0)
+		{
+			o.gain = atof(v);
+		}
+		else if (strcmp(a, "--cc4") == 0)
+		{
+			o.cc4 = atoi(v);
+		}
+		else
+		{
+			return false;
+		}
+	}
+	
+	return o.midiPath != NULL && o.wavPath != NULL && o.sampleRate > 0 && o.blockSize > 0 && o.tail >= 0;
+}
+
+
+// out.wav to out-<voice>-<filter>.wav
+static std::string CombinationPath(const char *path, int v, int f)
+{
+	std::string p(path);
+	std::string ext;
+	size_t dot = p.rfind('.');
+	if (dot != std::string::npos && p.find('/', dot) == std::string::npos)
+	{
+		ext = p.substr(dot);
+		p = p.substr(0, dot);
+	}
+	
+	return p + "-" + GetVoiceName(v) + "-" + GetFilterName(f) + ext;
+}
+
+
+int main(int argc, char **argv)
+{
+	RenderOptions o;
+	if (!ParseArgs(argc, argv, o))
+	{
+		Usage();
+		return 2;
+	}
+	
+	std::vector<MidiFileEvent> song;
+	std::string error;
+	if (!ReadMidiFile(o.midiPath, song, error))
+	{
+		fprintf(stderr, "%s: %s\n", o.midiPath, error.c_str());
+		return 1;
+	}
+	
+	hw.SetAudioSampleRate(o.sampleRate);
+	
+	bool many = (o.voice < 0 || o.filter < 0);
+	int v0 = (o.voice < 0) ? 0 : o.voice;
+	int v1 = (o.voice < 0) ? NUM_VOICES : o.voice + 1;
+	int f0 = (o.filter < 0) ? 0 : o.filter;
+	int f1 = (o.filter < 0) ? NUM_FILTERS : o.filter + 1;
+	
+	printf("%s: %zu events, %.0f Hz, block %zu\n", o.midiPath, song.size(), o.sampleRate, o.blockSize);
+	printf("%-8s %-6s %10s %10s %10s %10s\n", "voice", "filter", "audio s", "render s", "x realtime", "silent %");
+	
+	OfflineSettings settings;
+	settings.sampleRate = o.sampleRate;
+	settings.blockSize = o.blockSize;
+	settings.tail = o.tail;
+	settings.gain = o.gain;
+	settings.ccMap = false;
+	settings.voiceCC4 = o.cc4;
+	
+	int status = 0;
+	std::vector<float> out;
+	
+	for (int v = v0; v < v1; v++)
+	{
+		for (int f = f0; f < f1; f++)
+		{
+			OfflineResult r = RenderOffline(song, settings, v, f, out);
+			double audio = out.size() / 2 / o.sampleRate;
+			
+			double silent = 100.0 * r.silent * o.blockSize / (out.size() / 2);
+			
+			printf("%-8s %-6s %10.2f %10.4f %10.1f %10.1f\n", GetVoiceName(v), GetFilterName(f), audio, r.seconds, audio / r.seconds, silent);
+			
+			if (r.overflows > 0 || r.late > 0)
+			{
+				fprintf(stderr, "  %u events lost to queue overflow, %u played late\n", r.overflows, r.late);
+			}
+			
+			std::string path = many ? CombinationPath(o.wavPath, v, f) : std::string(o.wavPath);
+			if (!WriteWavFile(path.c_str(), out.data(), out.size() / 2, 2, (uint32_t)o.sampleRate))
+			{
+				fprintf(stderr, "%s: cannot write\n", path.c_str());
+				status = 1;
+			}
+		}
+	}
+	
+	return status;
+}
@@ -0,0 +1,491 @@
+/*
+ This file is part of Virtual Robot's Pine Synthesizer. 
+
+Copyright <2022> <Brian Gunnison>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+software and associated documentation files (the "Software"), to deal in the Software 
+without restriction, including without limitation the rights to use, copy, modify, 
+merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+permit persons to whom the Software is furnished to do so, subject to the following 
+conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+// pine_stress, scripted worst case scenarios for each voice and filter. Every block of the
+// scenario is timed through the block renderer as the audio callback runs it, and the maximum
+// and 99.9th percentile block time are reported against the block deadline, so polyphony
+// ceilings and CALIBRATE_HEADROOM can be set from the worst block rather than the average.
+//
+//   pine_stress [--voice N|all] [--filter N|all] [--scenario name|all] [--seconds 10] [--sr 48000] [--block 48] [--out stress.json]
+//
+// Voices run with every slot in service (*_VOICE_MAX_POLYPHONY), the most the governor can raise
+// them to, whatever the calibrated ceiling on the seed. Events go through the Alesis V125 CC map
+// (SetAlesisV125MIDIMap), so the CCs are the ones a controller would send.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include "daisy_pod.h"
+#include "voice.h"
+#include "filter.h"
+#include "midimap.h"
+#include "blockrender.h"
+#include "cyclecounter.h"
+#include "enginenames.h"
+
+using namespace daisy;
+
+extern DaisyPod hw;
+
+// CCs of the Alesis V125 map
+#define STRESS_CC_FREQ			20
+#define STRESS_CC_RES			21
+#define STRESS_CC_VOICE_PARM	22	// to 27
+#define STRESS_CC_VOICE_SELECT	48	// to 52
+
+typedef struct
+{
+	float sampleRate;
+	size_t blockSize;
+	float seconds;
+	int voice;			// -1 all
+	int filter;			// -1 all
+	int scenario;		// -1 all
+	const char *outPath;	// NULL no JSON
+}StressOptions;
+
+typedef struct
+{
+	int scenario;
+	int voice;
+	int filter;
+	uint8_t polyphony;
+	double meanUs;
+	double p999Us;
+	double maxUs;
+	double switchUs;	// longest step of a voice switch, Voices::BeginBlock()
+	double deadlineUs;
+}StressResult;
+
+
+// posts the scenario's events for one block, offsets are into the block
+class StressScript
+{
+public:
+	StressScript(BlockRenderer *r, uint32_t blockStart, size_t blockSize, uint8_t notes) 
+		: polyphony(notes), renderer(r), start(blockStart), size(blockSize) {}
+	
+	void CC(uint8_t cc, uint8_t value, size_t offset)
+	{
+		SynthEvent e;
+		e.type = SYNTH_EVENT_CC;
+		e.channel = 0;
+		e.data0 = cc;
+		e.data1 = value;
+		Post(e, offset);
+	}
+	
+	// a note on each slot, the same notes each time so held notes are retriggered
+	void Chord(size_t offset)
+	{
+		for (uint8_t i = 0; i < polyphony; i++)
+		{
+			SynthEvent e;
+			e.type = SYNTH_EVENT_NOTE_ON;
+			e.channel = 0;
+			e.data0 = 48 + 5 * i;
+			e.data1 = 100;
+			Post(e, offset);
+		}
+	}
+	
+	uint8_t polyphony;
+	
+private:
+	void Post(SynthEvent &e, size_t offset)
+	{
+		// the renderer plays events a block after their timestamp
+		renderer->Post(e, start + (offset % size) - size);
+	}
+	
+	BlockRenderer *renderer;
+	uint32_t start;
+	size_t size;
+};
+
+
+// 0 - 127 - 0 over period blocks
+static uint8_t Triangle(uint32_t block, uint32_t period)
+{
+	uint32_t p = block % period;
+	uint32_t half = period / 2;
+	return (uint8_t)((p < half ? p : period - p) * 127 / half);
+}
+
+
+// every slot held, the reference the other scenarios are compared to
+static void Sustain(uint32_t block, StressScript &s)
+{
+	if (block == 0)
+	{
+		s.Chord(0);
+	}
+}
+
+
+// every slot retriggered in the same block every 8 blocks while the cutoff sweeps
+static void Retrigger(uint32_t block, StressScript &s)
+{
+	if (block % 8 == 0)
+	{
+		s.Chord(0);
+	}
+	
+	s.CC(STRESS_CC_FREQ, Triangle(block, 64), 0);
+}
+
+
+// every mapped filter and voice parameter changes every block, spread over the block
+static void CCFlood(uint32_t block, StressScript &s)
+{
+	if (block == 0)
+	{
+		s.Chord(0);
+	}
+	
+	s.CC(STRESS_CC_FREQ, Triangle(block, 64), 0);
+	s.CC(STRESS_CC_RES, Triangle(block + 16, 64), 5);
+	
+	for (uint8_t p = 0; p < 6; p++)
+	{
+		s.CC(STRESS_CC_VOICE_PARM + p, Triangle(block + 8 * p, 48), 11 + 6 * p);
+	}
+}
+
+
+// the voice changes every 16 blocks with notes held, the chord is replayed on the new voice
+static void VoiceSwitch(uint32_t block, StressScript &s)
+{
+	// the CC is played the next block and the two blocks after build and initialise the engine, muted.
+	// The chord is due in the first of them, so it waits and starts every slot in the first block the
+	// new engine renders
+	if (block % 16 == 0 && block > 0)
+	{
+		s.CC(STRESS_CC_VOICE_SELECT + (block / 16) % NUM_VOICES, 127, 0);
+	}
+	
+	if (block % 16 == 1 || block == 0)
+	{
+		s.Chord(0);
+	}
+}
+
+
+// resonance at its maximum while the cutoff sweeps, notes retriggered every 32 blocks
+static void MaxResonance(uint32_t block, StressScript &s)
+{
+	if (block == 0)
+	{
+		s.CC(STRESS_CC_RES, 127, 0);
+	}
+	
+	if (block % 32 == 0)
+	{
+		s.Chord(0);
+	}
+	
+	s.CC(STRESS_CC_FREQ, Triangle(block, 32), 0);
+}
+
+
+typedef void (*ScenarioFunc)(uint32_t block, StressScript &s);
+
+typedef struct
+{
+	const char *name;
+	ScenarioFunc script;
+}Scenario;
+
+static const Scenario scenarios[] = 
+{
+	{ "sustain", Sustain },
+	{ "retrigger", Retrigger },
+	{ "ccflood", CCFlood },
+	{ "switch", VoiceSwitch },
+	{ "resonance", MaxResonance },
+};
+
+#define NUM_SCENARIOS (sizeof(scenarios) / sizeof(scenarios[0]))
+
+
+static StressResult RunScenario(const StressOptions &o, int sc, int v, int f)
+{
+	std::unique_ptr<Voices> ownVoices(new Voices());
+	std::unique_ptr<Filters> ownFilters(new Filters());
+	Voices *voices = ownVoices.get();
+	Filters *filters = ownFilters.get();
+	CCMIDIMap ccmap;
+	CCMIDINoteMap noteMap;
+	BlockRenderer renderer;
+	
+	voices->Init(&hw, o.sampleRate);
+	filters->Init(&hw, o.sampleRate);
+	
+	voices->CCProcess(10 + v, 0);
+	while (voices->BeginBlock())
+	{
+		// both steps of the switch before the render starts
+	}
+	filters->CCProcess(10 + f, 0);
+	
+	ccmap.Init();
+	noteMap.Init();
+	SetAlesisV125MIDIMap(&ccmap, &noteMap, voices, filters);
+	
+	renderer.Init(voices, filters, &ccmap, o.sampleRate, o.blockSize);
+	
+	uint32_t blocks = (uint32_t)(o.seconds * o.sampleRate / o.blockSize);
+	std::vector<float> out(o.blockSize);
+	std::vector<uint32_t> cycles(blocks);
+	
+	StressResult r;
+	r.scenario = sc;
+	r.voice = v;
+	r.filter = f;
+	r.polyphony = voices->GetMaxPolyphony();
+	
+	for (uint32_t b = 0; b < blocks; b++)
+	{
+		// every voice at its ceiling, a switch rebuilds the engine at its default polyphony
+		voices->SetPolyphony(voices->GetMaxPolyphony());
+		
+		// the chord fills the voice playing now, which changes when switching
+		StressScript script(&renderer, renderer.GetSampleClock(), o.blockSize, voices->GetMaxPolyphony());
+		scenarios[sc].script(b, script);
+		
+		uint32_t start = CycleCount();
+		renderer.Render(out.data(), o.blockSize);
+		cycles[b] = CycleCount() - start;
+	}
+	
+	double usPerCycle = 1e6 / CyclesPerSecond();
+	double sum = 0;
+	for (uint32_t c : cycles)
+	{
+		sum += c;
+	}
+	
+	std::sort(cycles.begin(), cycles.end());
+	size_t p999 = (size_t)(cycles.size() * 0.999);
+	if (p999 >= cycles.size())
+	{
+		p999 = cycles.size() - 1;
+	}
+	
+	r.meanUs = sum / cycles.size() * usPerCycle;
+	r.p999Us = cycles[p999] * usPerCycle;
+	r.maxUs = cycles.back() * usPerCycle;
+	r.switchUs = voices->GetSwitchCounters().maxCycles * usPerCycle;
+	r.deadlineUs = o.blockSize / o.sampleRate * 1e6;
+	
+	return r;
+}
+
+
+static void WriteJson(FILE *f, const StressOptions &o, const std::vector<StressResult> &results)
+{
+	fprintf(f, "{\n");
+	fprintf(f, "  \"sample_rate\": %.0f,\n", o.sampleRate);
+	fprintf(f, "  \"block_size\": %zu,\n", o.blockSize);
+	fprintf(f, "  \"seconds\": %g,\n", o.seconds);
+	fprintf(f, "  \"results\": [\n");
+	
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const StressResult &r = results[i];
+		fprintf(f, "    {\"scenario\": \"%s\", \"voice\": \"%s\", \"filter\": \"%s\", \"polyphony\": %d, \"mean_us\": %.3f, \"p999_us\": %.3f, \"max_us\": %.3f, \"switch_us\": %.3f, \"deadline_us\": %.3f}%s\n", 
+			scenarios[r.scenario].name, GetVoiceName(r.voice), GetFilterName(r.filter), r.polyphony, 
+			r.meanUs, r.p999Us, r.maxUs, r.switchUs, r.deadlineUs, (i + 1 < results.size()) ? "," : "");
+	}
+	
+	fprintf(f, "  ]\n");
+	fprintf(f, "}\n");
+}
+
+
+static void Usage()
+{
+	fprintf(stderr, "usage: pine_stress [--voice N|all] [--filter N|all] [--scenario name|all] [--seconds 10] [--sr 48000] [--block 48] [--out stress.json]\n");
+	PrintEngineNames(stderr);
+	fprintf(stderr, "  scenarios:");
+	for (size_t i = 0; i < NUM_SCENARIOS; i++)
+	{
+		fprintf(stderr, " %s", scenarios[i].name);
+	}
+	fprintf(stderr, "\n");
+}
+
+
+static bool ParseScenario(const char *s, int &sc)
+{
+	if (strcmp(s, "all") == 0)
+	{
+		sc = -1;
+		return true;
+	}
+	
+	for (size_t i = 0; i < NUM_SCENARIOS; i++)
+	{
+		if (strcmp(s, scenarios[i].name) == 0)
+		{
+			sc = (int)i;
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+
+static bool ParseArgs(int argc, char **argv, StressOptions &o)
+{
+	o.sampleRate = 48000.0f;
+	o.blockSize = 48;
+	o.seconds = 10.0f;
+	o.voice = -1;
+	o.filter = -1;
+	o.scenario = -1;
+	o.outPath = NULL;
+	
+	for (int i = 1; i < argc; i++)
+	{
+		if (i + 1 >= argc)
+		{
+			return false;
+		}
+		
+		const char *a = argv[i];
+		const char *v = argv[++i];
+		
+		if (strcmp(a, "--voice") == 0)
+		{
+			if (!ParseVoice(v, o.voice))
+			{
+				return false;
+			}
+		}
+		else if (strcmp(a, "--filter") == 0)
+		{
+			if (!ParseFilter(v, o.filter))
+			{
+				return false;
+			}
+		}
+		else if (strcmp(a, "--scenario") == 0)
+		{
+			if (!ParseScenario(v, o.scenario))
+			{
+				return false;
+			}
+		}
+		else if (strcmp(a, "--seconds") == 0)
+		{
+			o.seconds = atof(v);
+		}
+		else if (strcmp(a, "--sr") == 0)
+		{
+			o.sampleRate = atof(v);
+		}
+		else if (strcmp(a, "--block") == 0)
+		{
+			o.blockSize = atoi(v);
+		}
+		else if (strcmp(a, "--out") == 0)
+		{
+			o.outPath = v;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	
+	return o.sampleRate > 0 && o.blockSize > 0 && o.blockSize <= MAX_BLOCK_SIZE && o.seconds * o.sampleRate >= o.blockSize;
+}
+
+
+int main(int argc, char **argv)
+{
+	StressOptions o;
+	if (!ParseArgs(argc, argv, o))
+	{
+		Usage();
+		return 2;
+	}
+	
+	hw.SetAudioSampleRate(o.sampleRate);
+	CycleCounterInit();
+	
+	std::vector<StressResult> results;
+	
+	printf("block %zu at %.0f Hz, deadline %.1f us\n", o.blockSize, o.sampleRate, o.blockSize / o.sampleRate * 1e6);
+	printf("%-10s %-8s %-6s %4s %9s %9s %9s %7s %9s\n", "scenario", "voice", "filter", "poly", "mean us", "p99.9 us", "max us", "max %", "switch us");
+	
+	for (int sc = 0; sc < (int)NUM_SCENARIOS; sc++)
+	{
+		if (o.scenario >= 0 && sc != o.scenario)
+		{
+			continue;
+		}
+		
+		for (int v = 0; v < NUM_VOICES; v++)
+		{
+			if (o.voice >= 0 && v != o.voice)
+			{
+				continue;
+			}
+			
+			for (int f = 0; f < NUM_FILTERS; f++)
+			{
+				if (o.filter >= 0 && f != o.filter)
+				{
+					continue;
+				}
+				
+				StressResult r = RunScenario(o, sc, v, f);
+				results.push_back(r);
+				
+				printf("%-10s %-8s %-6s %4d %9.2f %9.2f %9.2f %6.1f%% %9.2f\n", scenarios[sc].name, GetVoiceName(v), GetFilterName(f), 
+					r.polyphony, r.meanUs, r.p999Us, r.maxUs, r.maxUs / r.deadlineUs * 100, r.switchUs);
+			}
+		}
+	}
+	
+	if (o.outPath != NULL)
+	{
+		FILE *f = fopen(o.outPath, "w");
+		if (f == NULL)
+		{
+			fprintf(stderr, "%s: cannot write\n", o.outPath);
+			return 1;
+		}
+		
+		WriteJson(f, o, results);
+		fclose(f);
+	}
+	
+	return 0;
+}
@@ -0,0 +1,163 @@
+/*
+ This file is part of Virtual Robot's Pine Synthesizer. 
+
+Copyright <2022> <Brian Gunnison>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+software and associated documentation files (the "Software"), to deal in the Software 
+without restriction, including without limitation the rights to use, copy, modify, 
+merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+permit persons to whom the Software is furnished to do so, subject to the following 
+conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include <stdio.h>
+#include <string.h>
+#include "wavfile.h"
+
+
+static void Put16(uint8_t *p, uint16_t v)
+{
+	p[0] = v & 0xFF;
+	p[1] = v >> 8;
+}
+
+
+static void Put32(uint8_t *p, uint32_t v)
+{
+	for (uint8_t i = 0; i < 4; i++)
+	{
+		p[i] = (v >> (8 * i)) & 0xFF;
+	}
+}
+
+
+static uint32_t Get32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+
+static uint16_t Get16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+
+bool WriteWavFile(const char *path, const float *samples, size_t frames, uint16_t channels, uint32_t sampleRate)
+{
+	FILE *f = fopen(path, "wb");
+	if (f == NULL)
+	{
+		return false;
+	}
+	
+	uint32_t dataBytes = frames * channels * 4;
+	uint8_t h[44];
+	
+	memcpy(h, "RIFF", 4);
+	Put32(h + 4, 36 + dataBytes);
+	memcpy(h + 8, "WAVE", 4);
+	memcpy(h + 12, "fmt ", 4);
+	Put32(h + 16, 16);
+	Put16(h + 20, 3); // IEEE float
+	Put16(h + 22, channels);
+	Put32(h + 24, sampleRate);
+	Put32(h + 28, sampleRate * channels * 4);
+	Put16(h + 32, channels * 4);
+	Put16(h + 34, 32);
+	memcpy(h + 36, "data", 4);
+	Put32(h + 40, dataBytes);
+	
+	// the host is little endian like the WAV format
+	bool ok = fwrite(h, 1, sizeof(h), f) == sizeof(h) && fwrite(samples, 4, frames * channels, f) == frames * channels;
+	
+	return (fclose(f) == 0) && ok;
+}
+
+
+bool ReadWavFile(const char *path, std::vector<float> &samples, uint16_t &channels, uint32_t &sampleRate, std::string &error)
+{
+	FILE *f = fopen(path, "rb");
+	if (f == NULL)
+	{
+		error = "cannot open " + std::string(path);
+		return false;
+	}
+	
+	std::vector<uint8_t> d;
+	uint8_t buf[4096];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+	{
+		d.insert(d.end(), buf, buf + n);
+	}
+	fclose(f);
+	
+	if (d.size() < 12 || memcmp(&d[0], "RIFF", 4) != 0 || memcmp(&d[8], "WAVE", 4) != 0)
+	{
+		error = "not a WAV file";
+		return false;
+	}
+	
+	uint16_t format = 0;
+	uint16_t bits = 0;
+	channels = 0;
+	
+	size_t pos = 12;
+	while (pos + 8 <= d.size())
+	{
+		uint32_t len = Get32(&d[pos + 4]);
+		const uint8_t *c = &d[pos + 8];
+		
+		if (pos + 8 + len > d.size())
+		{
+			len = d.size() - pos - 8;
+		}
+		
+		if (memcmp(&d[pos], "fmt ", 4) == 0 && len >= 16)
+		{
+			format = Get16(c);
+			channels = Get16(c + 2);
+			sampleRate = Get32(c + 4);
+			bits = Get16(c + 14);
+		}
+		
+		if (memcmp(&d[pos], "data", 4) == 0)
+		{
+			if (format == 3 && bits == 32)
+			{
+				samples.resize(len / 4);
+				memcpy(samples.data(), c, samples.size() * 4);
+				return true;
+			}
+			
+			if (format == 1 && bits == 16)
+			{
+				samples.resize(len / 2);
+				for (size_t i = 0; i < samples.size(); i++)
+				{
+					samples[i] = (int16_t)Get16(c + 2 * i) / 32768.0f;
+				}
+				return true;
+			}
+			
+			error = "only 32 bit float and 16 bit PCM WAV files are supported";
+			return false;
+		}
+		
+		pos += 8 + len + (len & 1);
+	}
+	
+	error = "no data in WAV file";
+	return false;
+}
@@ -0,0 +1,75 @@
+/*
+ This file is part of Virtual Robot's Pine Synthesizer. 
+
+Copyright <2022> <Brian Gunnison>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+software and associated documentation files (the "Software"), to deal in the Software 
+without restriction, including without limitation the rights to use, copy, modify, 
+merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+permit persons to whom the Software is furnished to do so, subject to the following 
+conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "daisysp.h"
+#include "fastmath.h"
+
+using namespace daisysp;
+
+// Four pole transistor ladder low pass: a tanh on the input less the resonance feedback, then four
+// one poles that each follow the tanh of their input from the tanh of their state (Huovilainen's
+// model without the oversampling). In place of DaisySP's MoogLadder, whose tanh is out of reach,
+// so the nine tanh a sample go through MathTanh and FAST_MATH switches them to FastTanh
+class Ladder
+{
+public:
+	void Init(float SR)
+	{
+		sampleRate = SR;
+		
+		for (uint8_t k = 0; k < 4; k++)
+		{
+			stage[k] = 0.0f;
+		}
+		
+		SetFreq(5000.0f);
+		res = 0.4f;
+	}
+	
+	void SetFreq(float f) { g = 1.0f - MathExp(-TWOPI_F * f / sampleRate); }
+	// 0 to 1, self oscillation near 1
+	void SetRes(float r) { res = r; }
+	
+	float Process(float in)
+	{
+		float x = MathTanh(in - res * 4.0f * stage[3]);
+		
+		for (uint8_t k = 0; k < 4; k++)
+		{
+			stage[k] += g * (MathTanh(x) - MathTanh(stage[k]));
+			x = stage[k];
+		}
+		
+		return stage[3];
+	}
+	
+private:
+	float sampleRate;
+	float g;		// one pole coefficient of the cutoff
+	float res;
+	float stage[4];
+};
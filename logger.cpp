@@ -0,0 +1,340 @@
+/*
+ This file is part of Virtual Robot's Pine Synthesizer. 
+
+Copyright <2022> <Brian Gunnison>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+software and associated documentation files (the "Software"), to deal in the Software 
+without restriction, including without limitation the rights to use, copy, modify, 
+merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+permit persons to whom the Software is furnished to do so, subject to the following 
+conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include <stdarg.h>
+#include <string.h>
+#include <atomic>
+#include "daisy_pod.h"
+
+#include "utilities.h"
+#include "logger.h"
+
+using namespace daisy;
+
+
+typedef enum
+{
+	LOG_ARG_INT,
+	LOG_ARG_STR
+}LOG_ARG_KIND;
+
+typedef struct
+{
+	std::atomic<uint8_t> ready;	// set last by the writer, cleared by LogFlush()
+	uint8_t id;
+	uint8_t len;
+	uint8_t payload[LOG_RECORD_PAYLOAD];
+}LogRecord;
+
+typedef struct
+{
+	std::atomic<const char *> format;
+	std::atomic<uint8_t> ready;	// nargs and kinds are valid
+	uint8_t nargs;
+	uint8_t kinds[LOG_MAX_ARGS];
+	bool sent;	// definition transmitted, main loop only
+}LogFormat;
+
+static DaisyPod *hw = NULL;
+
+// writers reserve a record by moving head, LogFlush() is the only reader
+static LogRecord records[LOG_RECORDS];
+static std::atomic<uint32_t> head(0);
+static std::atomic<uint32_t> tail(0);
+
+static LogFormat formats[LOG_MAX_FORMATS];
+
+static std::atomic<uint32_t> logged(0);
+static std::atomic<uint32_t> dropped(0);
+static uint32_t sent = 0;
+static uint32_t droppedReported = 0;
+static volatile bool resendFormats = false;
+
+// frames waiting for the USB, kept until a transmit succeeds
+static uint8_t tx[LOG_TX_BUFFER];
+static size_t txLen = 0;
+
+
+// argument kinds in format order, returns the count
+static uint8_t ParseFormat(const char *f, uint8_t *kinds)
+{
+	uint8_t n = 0;
+	
+	while (*f != 0 && n < LOG_MAX_ARGS)
+	{
+		if (*f++ != '%')
+		{
+			continue;
+		}
+		
+		if (*f == '%')
+		{
+			f++;
+			continue;
+		}
+		
+		// flags, width, precision and length modifiers
+		while (*f != 0 && strchr("-+ #0123456789.lhzjt", *f) != NULL)
+		{
+			f++;
+		}
+		
+		if (*f == 0)
+		{
+			break;
+		}
+		
+		kinds[n++] = (*f == 's') ? LOG_ARG_STR : LOG_ARG_INT;
+		f++;
+	}
+	
+	return n;
+}
+
+
+// the format's slot in the table, added on first use, -1 if the table is full
+static int16_t FindFormat(const char *format)
+{
+	uint32_t h = ((uintptr_t)format >> 2) & (LOG_MAX_FORMATS - 1);
+	
+	for (uint32_t i = 0; i < LOG_MAX_FORMATS; i++)
+	{
+		uint32_t id = (h + i) & (LOG_MAX_FORMATS - 1);
+		LogFormat &e = formats[id];
+		const char *f = e.format.load(std::memory_order_acquire);
+		
+		if (f == format)
+		{
+			return id;
+		}
+		
+		if (f == NULL)
+		{
+			if (e.format.compare_exchange_strong(f, format, std::memory_order_acq_rel))
+			{
+				e.nargs = ParseFormat(format, e.kinds);
+				e.ready.store(1, std::memory_order_release);
+				return id;
+			}
+			
+			// another context took the slot first, maybe for the same format
+			if (f == format)
+			{
+				return id;
+			}
+		}
+	}
+	
+	return -1;
+}
+
+
+void log(const char* format, ...)
+{
+	int16_t id = FindFormat(format);
+	if (id < 0)
+	{
+		dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	
+	LogFormat &fmt = formats[id];
+	uint8_t nargs;
+	uint8_t localKinds[LOG_MAX_ARGS];
+	const uint8_t *kinds = fmt.kinds;
+	
+	if (fmt.ready.load(std::memory_order_acquire))
+	{
+		nargs = fmt.nargs;
+	}
+	else
+	{
+		// this interrupted the context that is adding the format
+		nargs = ParseFormat(format, localKinds);
+		kinds = localKinds;
+	}
+	
+	uint32_t h = head.load(std::memory_order_relaxed);
+	do
+	{
+		if (h - tail.load(std::memory_order_acquire) >= LOG_RECORDS)
+		{
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+	} while (!head.compare_exchange_weak(h, h + 1, std::memory_order_acq_rel));
+	
+	LogRecord &r = records[h & (LOG_RECORDS - 1)];
+	r.id = id;
+	
+	// bytes the arguments after the current one need, so a long string leaves them room
+	uint8_t reserve = 0;
+	for (uint8_t a = 0; a < nargs; a++)
+	{
+		reserve += (kinds[a] == LOG_ARG_STR) ? 1 : 4;
+	}
+	
+	uint8_t len = 0;
+	va_list va;
+	va_start(va, format);
+	
+	for (uint8_t a = 0; a < nargs; a++)
+	{
+		if (kinds[a] == LOG_ARG_STR)
+		{
+			reserve -= 1;
+			const char *s = va_arg(va, const char *);
+			if (s == NULL)
+			{
+				s = "(null)";
+			}
+			
+			size_t room = LOG_RECORD_PAYLOAD - len - 1 - reserve;
+			size_t n = strnlen(s, room);
+			r.payload[len++] = n;
+			memcpy(&r.payload[len], s, n);
+			len += n;
+		}
+		else
+		{
+			reserve -= 4;
+			int32_t v = va_arg(va, int32_t);
+			memcpy(&r.payload[len], &v, 4);
+			len += 4;
+		}
+	}
+	
+	va_end(va);
+	
+	r.len = len;
+	r.ready.store(1, std::memory_order_release);
+	logged.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+void LogInit(DaisyPod *phw)
+{
+	hw = phw;
+}
+
+
+void LogResendFormats()
+{
+	resendFormats = true;
+}
+
+
+LogCounters LogGetCounters()
+{
+	LogCounters c;
+	c.logged = logged.load(std::memory_order_relaxed);
+	c.dropped = dropped.load(std::memory_order_relaxed);
+	c.sent = sent;
+	return c;
+}
+
+
+// moves waiting records into tx as frames until it is full
+static void FillTx()
+{
+	while (true)
+	{
+		uint32_t t = tail.load(std::memory_order_relaxed);
+		if (t == head.load(std::memory_order_acquire))
+		{
+			break;
+		}
+		
+		// a writer that reserved this record may have been interrupted before finishing it
+		LogRecord &r = records[t & (LOG_RECORDS - 1)];
+		if (!r.ready.load(std::memory_order_acquire))
+		{
+			break;
+		}
+		
+		LogFormat &fmt = formats[r.id];
+		const char *format = fmt.format.load(std::memory_order_acquire);
+		size_t flen = fmt.sent ? 0 : strnlen(format, 255);
+		size_t need = 3 + r.len + (fmt.sent ? 0 : 3 + flen);
+		
+		if (txLen + need > LOG_TX_BUFFER)
+		{
+			break;
+		}
+		
+		if (!fmt.sent)
+		{
+			tx[txLen++] = LOG_FRAME_FORMAT;
+			tx[txLen++] = r.id;
+			tx[txLen++] = flen;
+			memcpy(&tx[txLen], format, flen);
+			txLen += flen;
+			fmt.sent = true;
+		}
+		
+		tx[txLen++] = LOG_FRAME_RECORD;
+		tx[txLen++] = r.id;
+		tx[txLen++] = r.len;
+		memcpy(&tx[txLen], r.payload, r.len);
+		txLen += r.len;
+		
+		r.ready.store(0, std::memory_order_relaxed);
+		tail.store(t + 1, std::memory_order_release);
+		sent++;
+	}
+}
+
+
+void LogFlush()
+{
+	if (resendFormats)
+	{
+		resendFormats = false;
+		for (uint8_t i = 0; i < LOG_MAX_FORMATS; i++)
+		{
+			formats[i].sent = false;
+		}
+	}
+	
+	uint32_t d = dropped.load(std::memory_order_relaxed);
+	if (d != droppedReported)
+	{
+		droppedReported = d;
+		log("Log: %u records dropped", d);
+	}
+	
+	if (txLen == 0)
+	{
+		FillTx();
+	}
+	
+	if (txLen == 0 || hw == NULL)
+	{
+		return;
+	}
+	
+	// busy or not connected, the same frames go again next time
+	if (hw->seed.usb_handle.TransmitInternal(tx, txLen) == UsbHandle::Result::OK)
+	{
+		txLen = 0;
+	}
+}
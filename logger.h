@@ -0,0 +1,68 @@
+/*
+ This file is part of Virtual Robot's Pine Synthesizer. 
+
+Copyright <2022> <Brian Gunnison>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+software and associated documentation files (the "Software"), to deal in the Software 
+without restriction, including without limitation the rights to use, copy, modify, 
+merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+permit persons to whom the Software is furnished to do so, subject to the following 
+conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "daisy_pod.h"
+
+using namespace daisy;
+
+// log() (utilities.h) does not format or transmit. It stores the format string's id and the raw
+// arguments in a fixed size record in a lock-free ring, which any context, the audio callback
+// included, may write. LogFlush() in the main loop sends the records over USB as binary frames
+// and serial_monitor.py turns them back into text.
+//
+// Frames on the wire, all lengths in bytes:
+//   0x01 id len format[len]	defines a format id, sent before its first record
+//   0x02 id len payload[len]	a record, payload is the arguments in format order:
+//								integers as 4 bytes little endian, strings as a length byte then the characters
+//
+// %d %u %x %c and %s are supported, anything else logs as an integer.
+
+#define LOG_RECORDS			64	// ring size, a power of two
+#define LOG_RECORD_PAYLOAD	44	// argument bytes per record, longer strings are truncated
+#define LOG_MAX_FORMATS		64	// distinct format strings
+#define LOG_MAX_ARGS		8
+#define LOG_TX_BUFFER		512	// bytes sent per LogFlush()
+
+#define LOG_FRAME_FORMAT	0x01
+#define LOG_FRAME_RECORD	0x02
+
+
+typedef struct
+{
+	uint32_t logged;	// records written
+	uint32_t dropped;	// records lost to a full ring or format table
+	uint32_t sent;		// records transmitted
+}LogCounters;
+
+void LogInit(DaisyPod *hw);
+
+// main loop, sends what is waiting, returns without waiting on the USB
+void LogFlush();
+
+// sends each format definition again before its next record, for a monitor that connected late
+void LogResendFormats();
+
+LogCounters LogGetCounters();
@@ -25,102 +25,93 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include "utilities.h"
 #include "voice.h"
+#include "fastmath.h"
 
 using namespace daisy;
 using namespace daisysp;
 
-void MalletVoice::Init(DaisyPod *phw, float SR) 
+// the pot mappings, see InitPots()
+template<uint8_t N> Parameter MalletVoice<N>::DampingPotParm;
+template<uint8_t N> Parameter MalletVoice<N>::StructurePotParm;
+template<uint8_t N> Parameter MalletVoice<N>::BrightnessPotParm;
+template<uint8_t N> Parameter MalletVoice<N>::AccentPotParm;
+
+template<uint8_t N>
+void MalletVoice<N>::Init(DaisyPod *phw, float SR) 
 {
 	NullVoice::Init(phw, SR);
-	polyphony = MALLET_VOICE_POLYPHONY;
+	InitPolyphony(MALLET_VOICE_POLYPHONY, N, slots);
+	allocator.SetReuseTails(true);
 	
-	for (uint8_t i = 0; i < polyphony; i++)
+	for (uint8_t i = 0; i < maxPolyphony; i++)
 	{
 		mallet[i].Init(sampleRate);
 	}	
 	
-	DampingPotParm.Init(hw->knob1, 0, 1, Parameter::LINEAR);
-	StructurePotParm.Init(hw->knob2, 0, 1, Parameter::LINEAR); // sets range and plot 
-	BrightnessPotParm.Init(hw->knob1, 0, 1, Parameter::LINEAR); // sets range and plot 
-	AccentPotParm.Init(hw->knob2, 0, 1, Parameter::LINEAR); // sets range and plot 
-
 	Panic();
 }
 
-void MalletVoice::Panic() 
+template<uint8_t N>
+void MalletVoice<N>::Panic() 
 {
 	NullVoice::Panic();
 	
-	//for (uint8_t i = 0; i < polyphony; i++)
+	//for (uint8_t i = 0; i < maxPolyphony; i++)
 	//{
 	//	mallet[i].Reset();
 	//}
 }
 
 
-void MalletVoice::StartNote(uint8_t i, NoteOnEvent *p)
+template<uint8_t N>
+void MalletVoice<N>::StartNote(uint8_t i, NoteOnEvent *p)
 {
 	//log("n: %d, m: %d", i, p->note);
+	WakeSlot(i);
 	notes[i].midiNote = p->note;
 	notes[i].amplitude = (float)p->velocity / 127.0f;
 			
-	mallet[i].SetFreq(mtof(p->note));
+	mallet[i].SetFreq(MathMtof(p->note));
 	mallet[i].Trig();
 	
 }
 
-void MalletVoice::NoteOn(NoteOnEvent *p)
+template<uint8_t N>
+void MalletVoice<N>::SetFreq(float f)
 {
-	for (uint8_t i = 0; i < polyphony; i++)
-	{
-		
-		if (notes[i].midiNote == p->note)
-		{
-			// if we are playing the same note
-			StartNote(i, p);
-			return;
-		}
-		
-		// start new note if unused and (todo) adsr is done 
-		if (notes[i].midiNote == 0 )
-		{
-			StartNote(i, p);
-			return;	
-		}
-	}
+	
 }
 
-
-void MalletVoice::NoteOff(NoteOffEvent *p)
+template<uint8_t N>
+float MalletVoice<N>::Process(void) 
 {
-	for (uint8_t i = 0; i < polyphony; i++)
+	float sig = 0.0;
+	for (uint8_t i = 0; i < maxPolyphony; i++)
 	{
-		if (notes[i].midiNote == p->note)
+		if (notes[i].parked == true)
 		{
-			notes[i].midiNote = 0;	
+			continue;
 		}
+		
+		sig += mallet[i].Process() * notes[i].amplitude;
 	}
-}
-
-
-void MalletVoice::SetFreq(float f)
-{
 	
+	return sig / mixDivisor;
 }
 
-float MalletVoice::Process(void) 
+template<uint8_t N>
+void MalletVoice<N>::RenderSlot(uint8_t i, float *buf, size_t n)
 {
-	float sig = 0.0;
-	for (uint8_t i = 0; i < polyphony; i++)
+	float amplitude = notes[i].amplitude;
+	for (size_t s = 0; s < n; s++)
 	{
-		sig += mallet[i].Process() * notes[i].amplitude;
+		buf[s] = mallet[i].Process() * amplitude;
 	}
-	
-	return sig / polyphony;
 }
 	
 
-void MalletVoice::SetDamping(float v)
+template<uint8_t N>
+void MalletVoice<N>::SetDamping(float v)
 {
 	if (v == damping)
 	{
@@ -128,14 +119,15 @@ void MalletVoice::SetDamping(float v)
 	}
 	
 	damping = v;
-	for (uint8_t i = 0; i < polyphony; i++)
+	for (uint8_t i = 0; i < maxPolyphony; i++)
 	{
 		mallet[i].SetDamping(damping);
 	}
 }
 
 
-void MalletVoice::SetStructure(float v)
+template<uint8_t N>
+void MalletVoice<N>::SetStructure(float v)
 {
 	if (v == structure)
 	{
@@ -143,14 +135,15 @@ void MalletVoice::SetStructure(float v)
 	}
 	
 	structure = v;
-	for (uint8_t i = 0; i < polyphony; i++)
+	for (uint8_t i = 0; i < maxPolyphony; i++)
 	{
 		mallet[i].SetStructure(structure);
 	}
 }
 
 
-void MalletVoice::SetBrightness(float v)
+template<uint8_t N>
+void MalletVoice<N>::SetBrightness(float v)
 {
 	if (v == brightness)
 	{
@@ -158,14 +151,15 @@ void MalletVoice::SetBrightness(float v)
 	}
 	
 	brightness = v;
-	for (uint8_t i = 0; i < polyphony; i++)
+	for (uint8_t i = 0; i < maxPolyphony; i++)
 	{
 		mallet[i].SetBrightness(brightness);
 	}
 }
 
 
-void MalletVoice::SetAccent(float v)
+template<uint8_t N>
+void MalletVoice<N>::SetAccent(float v)
 {
 	if (v == accent)
 	{
@@ -173,54 +167,97 @@ void MalletVoice::SetAccent(float v)
 	}
 	
 	accent = v;
-	for (uint8_t i = 0; i < polyphony; i++)
+	for (uint8_t i = 0; i < maxPolyphony; i++)
 	{
 		mallet[i].SetAccent(accent);
 	}
 }
 
 
-void MalletVoice::ProcessParm0()
+template<uint8_t N>
+void MalletVoice<N>::InitPots(DaisyPod *phw)
 {
-	SetDamping(DampingPotParm.Process());
+	// See controlmap
+	DampingPotParm.Init(phw->knob1, 0, 1, Parameter::LINEAR);
+	StructurePotParm.Init(phw->knob2, 0, 1, Parameter::LINEAR); // sets range and plot 
+	BrightnessPotParm.Init(phw->knob1, 0, 1, Parameter::LINEAR); // sets range and plot 
+	AccentPotParm.Init(phw->knob2, 0, 1, Parameter::LINEAR); // sets range and plot 
 }
 
 
-void MalletVoice::ProcessParm1()
+template<uint8_t N>
+float MalletVoice<N>::ReadParm(uint8_t n)
 {
-	SetStructure(StructurePotParm.Process());
+	switch (n)
+	{
+	case 0:
+		return DampingPotParm.Process();
+		
+	case 1:
+		return StructurePotParm.Process();
+		
+	case 2:
+		return BrightnessPotParm.Process();
+		
+	case 3:
+		return AccentPotParm.Process();
+		
+	default:
+		return 0.0;
+	}
 }
 
-void MalletVoice::ProcessParm2()
-{
-	SetBrightness(BrightnessPotParm.Process());
-}
 
-void MalletVoice::ProcessParm3()
+template<uint8_t N>
+void MalletVoice<N>::ApplyParm(uint8_t n, float value)
 {
-	SetAccent(AccentPotParm.Process());
+	switch (n)
+	{
+	case 0:
+		SetDamping(value);
+		break;
+		
+	case 1:
+		SetStructure(value);
+		break;
+		
+	case 2:
+		SetBrightness(value);
+		break;
+		
+	case 3:
+		SetAccent(value);
+		break;
+		
+	default:
+		break;
+	}
 }
 
+
 	
-void MalletVoice::SetCC0(uint8_t value)
+template<uint8_t N>
+void MalletVoice<N>::SetCC0(uint8_t value)
 {
 	SetDamping(value / 127.0);
 }
 
-void MalletVoice::SetCC1(uint8_t value)
+template<uint8_t N>
+void MalletVoice<N>::SetCC1(uint8_t value)
 {
 	SetStructure(value / 127.0);
 }
 
-void MalletVoice::SetCC2(uint8_t value)
+template<uint8_t N>
+void MalletVoice<N>::SetCC2(uint8_t value)
 {
 	SetBrightness(value / 127.0);
 }
 
-void MalletVoice::SetCC3(uint8_t value)
+template<uint8_t N>
+void MalletVoice<N>::SetCC3(uint8_t value)
 {
 	SetAccent(value / 127.0);
 }
 
-
-
+template class MalletVoice<MALLET_VOICE_MAX_POLYPHONY>;
@@ -103,3 +103,56 @@ void SetAlesisV125MIDIMap(CCMIDIMap *ccmap, CCMIDINoteMap *noteMap, CCMIDIMapabl
 	ccmap->Add(4, 26, voice); 
 	ccmap->Add(5, 27, voice); 
 }
+
+
+bool MapMidiMessage(MidiEvent *m, CCMIDINoteMap *noteMap, SynthEvent *e)
+{
+	switch (m->type)
+	{
+	case NoteOn:
+		{
+			NoteOnEvent p = m->AsNoteOn();
+			p.note = noteMap->Process(p.note, true);
+			if (p.note > 127)
+			{
+				return false; // so we can use notes as control
+			}
+
+			e->type = SYNTH_EVENT_NOTE_ON;
+			e->channel = p.channel;
+			e->data0 = p.note;
+			e->data1 = p.velocity;
+		}
+		return true;
+
+	case NoteOff:
+		{
+			NoteOffEvent p = m->AsNoteOff();
+			p.note = noteMap->Process(p.note, false);
+			if (p.note > 127)
+			{
+				return false; // so we can use notes as control
+			}
+			
+			e->type = SYNTH_EVENT_NOTE_OFF;
+			e->channel = p.channel;
+			e->data0 = p.note;
+			e->data1 = p.velocity;
+		}
+		return true;
+
+	case ControlChange:
+		{
+			ControlChangeEvent p = m->AsControlChange();
+			e->type = SYNTH_EVENT_CC;
+			e->channel = p.channel;
+			e->data0 = p.control_number;
+			e->data1 = p.value;
+			noteMap->Change(p.control_number, p.value); // the note map lives in the main loop
+		}
+		return true;
+		
+	default: 
+		return false;
+	}
+}
@@ -26,6 +26,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include <stdint.h>
 #include "utilities.h"
+#include "eventqueue.h"
 
 // A class inherits from this the method CCProcess which maps a enumerated CC function which is then called with the CC value
 class CCMIDIMapable
@@ -248,6 +249,7 @@ public:
 		
 		upOctaveNote = 128;
 		downOctaveNote = 128;
+		setCC = 0;
 	}
 	
 	void Add(uint8_t cc, MIDINoteMap *noteMap) 
@@ -259,9 +261,9 @@ public:
 	
 	void Change(uint8_t cc, uint8_t value)
 	{
-		if (cc >= 127) 
+		if (cc >= 127 || map[cc] == NULL) 
 		{
-			return;
+			return; // not a scale select CC
 		}
 		
 		if (cc == setCC && value == 0)
@@ -320,4 +322,9 @@ private:
 void SetAlesisV125MIDIMap(CCMIDIMap *ccmap, CCMIDINoteMap *noteMap, CCMIDIMapable *voice, CCMIDIMapable *filt);
 void SetFCB1010MIDIMap(CCMIDINoteMap *noteMap);
 
+// maps a MIDI message into what the synth plays: notes go through the note map and are dropped if
+// the map used them as controls (octave up/down), CCs also select the note map's scale.
+// false if there is nothing to play. Main loop side, shared by spring.cpp and the host tools.
+bool MapMidiMessage(MidiEvent *m, CCMIDINoteMap *noteMap, SynthEvent *e);
+
 
@@ -0,0 +1,859 @@
+/*
+ This file is part of Virtual Robot's Pine Synthesizer. 
+
+Copyright <2022> <Brian Gunnison>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+software and associated documentation files (the "Software"), to deal in the Software 
+without restriction, including without limitation the rights to use, copy, modify, 
+merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+permit persons to whom the Software is furnished to do so, subject to the following 
+conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+#include "daisysp.h"
+#include "fastmath.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+using namespace daisysp;
+
+// 16807^n, the noise's multiplier over n samples, so a lane that is not rendered has its seed moved
+// on as if it were and its next note gets the noise it would have had
+inline uint32_t NoiseSkip(size_t n)
+{
+	uint32_t m = 1;
+	for (size_t k = 0; k < n; k++)
+	{
+		m *= 16807;
+	}
+	return m;
+}
+
+// NoiseFilter for N slots as structure of arrays: each slot's white noise, its high pass and
+// the three band passes after it, with the state and coefficients of every filter side by side
+// so one instruction steps several slots. A block runs one filter at a time over all of its
+// samples, in place in the output, so only that filter's state is held in registers. AVX2
+// steps 8 slots and SSE2 4 on a host build, the Cortex-M7 runs each slot's chain in a scalar
+// loop. The filters are DaisySP's Svf (double sampled), sample for sample the same as NoiseFilter
+// with FAST_MATH 0, their coefficients come from FastSin and FastPow otherwise.
+template<uint8_t N>
+class NoiseFilterBank
+{
+public:
+	// as SawBank::LANES (oscbank.h), the spare lanes are never active
+	static constexpr uint8_t LANES = (N + 7) & ~7;
+	
+	// the high pass, set an octave below the note to prevent rumble, then the band passes
+	static constexpr uint8_t STAGES = 4;
+	
+	void Init(float SR)
+	{
+		sampleRate = SR;
+		fcMax = SR / 3.0f;
+		
+		for (uint8_t i = 0; i < LANES; i++)
+		{
+			seed[i] = 1;
+			amp[i] = 1.0f;
+			active[i] = false;
+			
+			for (uint8_t k = 0; k < STAGES; k++)
+			{
+				ResetStage(k, i);
+			}
+			SetRes(0, i, 0.5f);
+		}
+		
+		SetResonance(0.8f);
+	}
+	
+	void SetSeed(uint8_t i, int32_t s) { seed[i] = s; }
+	void SetAmp(uint8_t i, float a) { amp[i] = a; }
+	
+	// slot i is rendered in the next Render(), the others keep their filter state and only their noise moves on
+	void SetActive(uint8_t i, bool a) { active[i] = a; }
+	
+	// n samples of every lane's noise without rendering, for a block with no slot active
+	void Skip(size_t n)
+	{
+		uint32_t m = NoiseSkip(n);
+		
+		for (uint8_t i = 0; i < LANES; i++)
+		{
+			seed[i] = (int32_t)((uint32_t)seed[i] * m);
+		}
+	}
+	
+	void SetFreq(uint8_t i, float f)
+	{
+		SetStageFreq(0, i, f / 2);
+		
+		for (uint8_t k = 1; k < STAGES; k++)
+		{
+			SetStageFreq(k, i, f);
+		}
+	}
+	
+	void SetResonance(float res)
+	{
+		float r = fclamp(res, 0.3, 1.0);
+		
+		for (uint8_t i = 0; i < LANES; i++)
+		{
+			gain[i] = 3.0 / r; // as the resonance goes up the gain goes down
+			
+			for (uint8_t k = 1; k < STAGES; k++)
+			{
+				SetRes(k, i, r);
+			}
+		}
+	}
+	
+	void SetDrive(float d)
+	{
+		float drv = fclamp(d * 0.1f, 0.f, 1.f);
+		
+		for (uint8_t i = 0; i < LANES; i++)
+		{
+			for (uint8_t k = 1; k < STAGES; k++)
+			{
+				preDrive[k][i] = drv;
+				drive[k][i] = preDrive[k][i] * res[k][i];
+			}
+		}
+	}
+	
+	// n samples of every active slot into out, sample major: out[s * LANES + i] is slot i at
+	// sample s. level is the envelope in the same layout, it scales the noise into the band
+	// passes to excite them, or NULL for none.
+	void Render(const float *level, float *out, size_t n)
+	{
+		alignas(32) float startLow[STAGES][LANES];
+		alignas(32) float startBand[STAGES][LANES];
+		int32_t startSeed[LANES];
+		
+		for (uint8_t i = 0; i < LANES; i++)
+		{
+			startSeed[i] = seed[i];
+			
+			for (uint8_t k = 0; k < STAGES; k++)
+			{
+				startLow[k][i] = low[k][i];
+				startBand[k][i] = band[k][i];
+			}
+		}
+		
+		RenderLanes(level, out, n);
+		
+		uint32_t skip = NoiseSkip(n);
+		
+		for (uint8_t i = 0; i < LANES; i++)
+		{
+			bool restart = !active[i];
+			
+			// a band pass that blew up is set back as NoiseFilter does, from the sample it did
+			for (size_t s = 0; s < n && !restart; s++)
+			{
+				restart = isnan(out[s * LANES + i]);
+			}
+			
+			if (!restart)
+			{
+				continue;
+			}
+			
+			seed[i] = startSeed[i];
+			for (uint8_t k = 0; k < STAGES; k++)
+			{
+				low[k][i] = startLow[k][i];
+				band[k][i] = startBand[k][i];
+			}
+			
+			if (active[i])
+			{
+				RenderLane(i, level, out, n);
+			}
+			else
+			{
+				seed[i] = (int32_t)((uint32_t)seed[i] * skip);
+			}
+		}
+	}
+	
+private:
+	// the Svf of stage k for slot i is freq[k][i], damp[k][i], ...
+	alignas(32) float freq[STAGES][LANES];
+	alignas(32) float damp[STAGES][LANES];
+	alignas(32) float drive[STAGES][LANES];
+	alignas(32) float low[STAGES][LANES];
+	alignas(32) float band[STAGES][LANES];
+	alignas(32) float gain[LANES];
+	alignas(32) float amp[LANES];
+	alignas(32) int32_t seed[LANES];
+	bool active[LANES];
+	
+	// the setter side of each Svf, the coefficients above are derived from these
+	float fc[STAGES][LANES];
+	float res[STAGES][LANES];
+	float preDrive[STAGES][LANES];
+	
+	float sampleRate;
+	float fcMax;
+	
+	static constexpr float NOISE_SCALE = 4.6566129e-010f; // MyWhiteNoise's, to +-1
+	
+	// as Svf::Init
+	void ResetStage(uint8_t k, uint8_t i)
+	{
+		fc[k][i] = 200.0f;
+		res[k][i] = 0.5f;
+		preDrive[k][i] = 0.5f;
+		drive[k][i] = 0.5f;
+		freq[k][i] = 0.25f;
+		damp[k][i] = 0.0f;
+		low[k][i] = 0.0f;
+		band[k][i] = 0.0f;
+	}
+	
+	// as Svf::SetFreq
+	void SetStageFreq(uint8_t k, uint8_t i, float f)
+	{
+		fc[k][i] = fclamp(f, 1.0e-6f, fcMax);
+		freq[k][i] = 2.0f * MathSin(PI_F * daisysp::fmin(0.25f, fc[k][i] / (sampleRate * 2.0f)));
+		damp[k][i] = daisysp::fmin(2.0f * (1.0f - MathPow(res[k][i], 0.25f)), daisysp::fmin(2.0f, 2.0f / freq[k][i] - freq[k][i] * 0.5f));
+	}
+	
+	// as Svf::SetRes
+	void SetRes(uint8_t k, uint8_t i, float r)
+	{
+		res[k][i] = fclamp(r, 0.f, 1.f);
+		damp[k][i] = daisysp::fmin(2.0f * (1.0f - MathPow(res[k][i], 0.25f)), daisysp::fmin(2.0f, 2.0f / freq[k][i] - freq[k][i] * 0.5f));
+		drive[k][i] = preDrive[k][i] * res[k][i];
+	}
+	
+	// one pass of Svf::Process, it runs two a sample
+	static inline void Pass(float in, float f, float d, float dr, float &lo, float &bp, float &hp)
+	{
+		float notch = in - d * bp;
+		lo = lo + f * bp;
+		hp = notch - lo;
+		bp = f * hp + bp - dr * bp * bp * bp;
+	}
+	
+	// every lane n samples on, inactive lanes are put back by Render()
+	void RenderLanes(const float *level, float *out, size_t n);
+	
+	// a vector of lanes with none active is not run at all
+	bool AnyActive(uint8_t l, uint8_t width)
+	{
+		for (uint8_t k = 0; k < width; k++)
+		{
+			if (active[l + k])
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+	
+	// slot i a sample at a time through its whole chain, the NaN check and all, as NoiseFilter::Process
+	void RenderLane(uint8_t i, const float *level, float *out, size_t n)
+	{
+		for (size_t s = 0; s < n; s++)
+		{
+			seed[i] *= 16807;
+			float w = (seed[i] * NOISE_SCALE) * amp[i];
+			
+			float hp, hpOut;
+			Pass(w * gain[i], freq[0][i], damp[0][i], drive[0][i], low[0][i], band[0][i], hp);
+			hpOut = 0.5f * hp;
+			Pass(w * gain[i], freq[0][i], damp[0][i], drive[0][i], low[0][i], band[0][i], hp);
+			hpOut += 0.5f * hp;
+			
+			float o = level != NULL ? hpOut * level[s * LANES + i] : hpOut;
+			
+			for (uint8_t k = 1; k < STAGES; k++)
+			{
+				float in = o;
+				Pass(in, freq[k][i], damp[k][i], drive[k][i], low[k][i], band[k][i], hp);
+				o = 0.5f * band[k][i];
+				Pass(in, freq[k][i], damp[k][i], drive[k][i], low[k][i], band[k][i], hp);
+				o += 0.5f * band[k][i];
+			}
+			
+			if (isnan(o))
+			{
+				for (uint8_t k = 1; k < STAGES; k++)
+				{
+					ResetStage(k, i);
+				}
+				o = 0.0f;
+			}
+			
+			out[s * LANES + i] = o;
+		}
+	}
+};
+
+// A cheaper resonant noise for A/B against NoiseFilterBank, selected with NOISE_FILTER_MODEL or
+// the noise voice's CC function 4. Each slot's white noise runs through two band pass biquads
+// (RBJ, 0 dB peak) at the note, with a cubic soft clip between them for the drive. The
+// coefficients come from a table per MIDI note, worked out again only when the resonance
+// changes, so a note on is a table lookup. No high pass, the band passes roll the rumble off,
+// and no NaN check, a biquad with its poles inside the unit circle does not blow up.
+template<uint8_t N>
+class NoiseBiquadBank
+{
+public:
+	static constexpr uint8_t LANES = (N + 7) & ~7;
+	
+	void Init(float SR)
+	{
+		// the resonance only moves the bandwidth, so the note's sin and cos are worked out once
+		for (uint8_t k = 0; k < 128; k++)
+		{
+			float w0 = TWOPI_F * daisysp::fmin(MathMtof(k), SR * 0.45f) / SR;
+			sinW0[k] = MathSin(w0);
+			cosW0[k] = MathCos(w0);
+		}
+		
+		for (uint8_t i = 0; i < LANES; i++)
+		{
+			seed[i] = 1;
+			amp[i] = 1.0f;
+			note[i] = 69;
+			active[i] = false;
+			
+			for (uint8_t k = 0; k < STAGES; k++)
+			{
+				z1[k][i] = 0.0f;
+				z2[k][i] = 0.0f;
+			}
+		}
+		
+		resonance = -1.0f;
+		SetResonance(0.8f);
+		SetDrive(0.5f);
+	}
+	
+	void SetSeed(uint8_t i, int32_t s) { seed[i] = s; }
+	void SetAmp(uint8_t i, float a) { amp[i] = a; }
+	void SetActive(uint8_t i, bool a) { active[i] = a; }
+	
+	// as NoiseFilterBank::Skip()
+	void Skip(size_t n)
+	{
+		uint32_t m = NoiseSkip(n);
+		
+		for (uint8_t i = 0; i < LANES; i++)
+		{
+			seed[i] = (int32_t)((uint32_t)seed[i] * m);
+		}
+	}
+	
+	void SetNote(uint8_t i, uint8_t n)
+	{
+		note[i] = n & 127;
+		b0[i] = tableB0[note[i]];
+		a1[i] = tableA1[note[i]];
+		a2[i] = tableA2[note[i]];
+	}
+	
+	// the Q follows the Svf's damping for the same resonance, capped at 50
+	void SetResonance(float res)
+	{
+		float r = fclamp(res, 0.3, 1.0);
+		if (r == resonance)
+		{
+			return;
+		}
+		resonance = r;
+		
+		float q = 1.0f / daisysp::fmax(2.0f * (1.0f - MathPow(r, 0.25f)), 0.02f);
+		
+		// the band gets narrower as the resonance goes up, the gain keeps the first band pass's level
+		gain = 2.0f * sqrtf(q) / r;
+		
+		for (uint8_t k = 0; k < 128; k++)
+		{
+			float alpha = sinW0[k] / (2.0f * q);
+			float a0Recip = 1.0f / (1.0f + alpha);
+			tableB0[k] = alpha * a0Recip;
+			tableA1[k] = -2.0f * cosW0[k] * a0Recip;
+			tableA2[k] = (1.0f - alpha) * a0Recip;
+		}
+		
+		for (uint8_t i = 0; i < LANES; i++)
+		{
+			SetNote(i, note[i]);
+		}
+	}
+	
+	// 0 to 1, how hard the first band pass drives the soft clip. After it the gain is 4 for small
+	// signals, which puts the level about that of NoiseFilter at the voice's default resonance and drive
+	void SetDrive(float d)
+	{
+		driveGain = 0.25f + 2.0f * fclamp(d, 0.f, 1.f);
+		driveRecip = 4.0f / (1.5f * driveGain);
+	}
+	
+	// as NoiseFilterBank::Render()
+	void Render(const float *level, float *out, size_t n)
+	{
+		alignas(32) float startZ1[STAGES][LANES];
+		alignas(32) float startZ2[STAGES][LANES];
+		int32_t startSeed[LANES];
+		
+		for (uint8_t i = 0; i < LANES; i++)
+		{
+			startSeed[i] = seed[i];
+			
+			for (uint8_t k = 0; k < STAGES; k++)
+			{
+				startZ1[k][i] = z1[k][i];
+				startZ2[k][i] = z2[k][i];
+			}
+		}
+		
+		RenderLanes(level, out, n);
+		
+		uint32_t skip = NoiseSkip(n);
+		
+		for (uint8_t i = 0; i < LANES; i++)
+		{
+			if (active[i])
+			{
+				continue;
+			}
+			
+			seed[i] = (int32_t)((uint32_t)startSeed[i] * skip);
+			for (uint8_t k = 0; k < STAGES; k++)
+			{
+				z1[k][i] = startZ1[k][i];
+				z2[k][i] = startZ2[k][i];
+			}
+		}
+	}
+	
+private:
+	static constexpr uint8_t STAGES = 2;
+	static constexpr float NOISE_SCALE = 4.6566129e-010f; // MyWhiteNoise's, to +-1
+	
+	// b1 is 0 and b2 is -b0 for a band pass, transposed direct form II
+	alignas(32) float b0[LANES];
+	alignas(32) float a1[LANES];
+	alignas(32) float a2[LANES];
+	alignas(32) float z1[STAGES][LANES];
+	alignas(32) float z2[STAGES][LANES];
+	alignas(32) float amp[LANES];
+	alignas(32) int32_t seed[LANES];
+	uint8_t note[LANES];
+	bool active[LANES];
+	
+	float tableB0[128];
+	float tableA1[128];
+	float tableA2[128];
+	float sinW0[128];
+	float cosW0[128];
+	
+	float resonance;
+	float gain;
+	float driveGain;
+	float driveRecip;
+	
+	void RenderLanes(const float *level, float *out, size_t n);
+	
+	bool AnyActive(uint8_t l, uint8_t width)
+	{
+		for (uint8_t k = 0; k < width; k++)
+		{
+			if (active[l + k])
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+	
+	// slot i a sample at a time through its whole chain
+	void RenderLane(uint8_t i, const float *level, float *out, size_t n)
+	{
+		for (size_t s = 0; s < n; s++)
+		{
+			seed[i] *= 16807;
+			float x = ((seed[i] * NOISE_SCALE) * amp[i]) * gain;
+			if (level != NULL)
+			{
+				x *= level[s * LANES + i];
+			}
+			
+			for (uint8_t k = 0; k < STAGES; k++)
+			{
+				float bx = b0[i] * x;
+				float y = bx + z1[k][i];
+				z1[k][i] = z2[k][i] - a1[i] * y;
+				z2[k][i] = -bx - a2[i] * y;
+				x = y;
+				
+				if (k == 0)
+				{
+					x = fclamp(x * driveGain, -1.0f, 1.0f);
+					x = x * (1.5f - 0.5f * x * x) * driveRecip;
+				}
+			}
+			
+			out[s * LANES + i] = x;
+		}
+	}
+};
+
+
+
+#if defined(__AVX2__)
+
+template<uint8_t N>
+void NoiseFilterBank<N>::RenderLanes(const float *level, float *out, size_t n)
+{
+	const __m256i mult = _mm256_set1_epi32(16807);
+	const __m256 scale = _mm256_set1_ps(NOISE_SCALE);
+	const __m256 half = _mm256_set1_ps(0.5f);
+	
+	for (uint8_t l = 0; l < LANES; l += 8)
+	{
+		if (!AnyActive(l, 8))
+		{
+			continue;
+		}
+		
+		for (uint8_t k = 0; k < STAGES; k++)
+		{
+			__m256 f = _mm256_load_ps(freq[k] + l);
+			__m256 d = _mm256_load_ps(damp[k] + l);
+			__m256 dr = _mm256_load_ps(drive[k] + l);
+			__m256 lo = _mm256_load_ps(low[k] + l);
+			__m256 bp = _mm256_load_ps(band[k] + l);
+			
+			__m256i r = _mm256_load_si256((const __m256i *)(seed + l));
+			__m256 a = _mm256_load_ps(amp + l);
+			__m256 g = _mm256_load_ps(gain + l);
+			
+			for (size_t s = 0; s < n; s++)
+			{
+				float *o = out + s * LANES + l;
+				__m256 in;
+				
+				if (k == 0)
+				{
+					r = _mm256_mullo_epi32(r, mult);
+					in = _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(r), scale), a), g);
+				}
+				else
+				{
+					in = _mm256_loadu_ps(o);
+				}
+				
+				__m256 sum = _mm256_setzero_ps();
+				for (uint8_t pass = 0; pass < 2; pass++)
+				{
+					__m256 notch = _mm256_sub_ps(in, _mm256_mul_ps(d, bp));
+					lo = _mm256_add_ps(lo, _mm256_mul_ps(f, bp));
+					__m256 hp = _mm256_sub_ps(notch, lo);
+					__m256 cube = _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(dr, bp), bp), bp);
+					bp = _mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(f, hp), bp), cube);
+					
+					__m256 y = _mm256_mul_ps(half, k == 0 ? hp : bp);
+					sum = pass == 0 ? y : _mm256_add_ps(sum, y);
+				}
+				
+				if (k == 0 && level != NULL)
+				{
+					sum = _mm256_mul_ps(sum, _mm256_loadu_ps(level + s * LANES + l));
+				}
+				_mm256_storeu_ps(o, sum);
+			}
+			
+			_mm256_store_ps(low[k] + l, lo);
+			_mm256_store_ps(band[k] + l, bp);
+			if (k == 0)
+			{
+				_mm256_store_si256((__m256i *)(seed + l), r);
+			}
+		}
+	}
+}
+
+template<uint8_t N>
+void NoiseBiquadBank<N>::RenderLanes(const float *level, float *out, size_t n)
+{
+	const __m256i mult = _mm256_set1_epi32(16807);
+	const __m256 scale = _mm256_set1_ps(NOISE_SCALE);
+	const __m256 g = _mm256_set1_ps(gain);
+	const __m256 dg = _mm256_set1_ps(driveGain);
+	const __m256 dr = _mm256_set1_ps(driveRecip);
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 minusOne = _mm256_set1_ps(-1.0f);
+	const __m256 oneHalf = _mm256_set1_ps(1.5f);
+	const __m256 half = _mm256_set1_ps(0.5f);
+	const __m256 zero = _mm256_setzero_ps();
+	
+	for (uint8_t l = 0; l < LANES; l += 8)
+	{
+		if (!AnyActive(l, 8))
+		{
+			continue;
+		}
+		
+		__m256 c0 = _mm256_load_ps(b0 + l);
+		__m256 c1 = _mm256_load_ps(a1 + l);
+		__m256 c2 = _mm256_load_ps(a2 + l);
+		
+		for (uint8_t k = 0; k < STAGES; k++)
+		{
+			__m256 s1 = _mm256_load_ps(z1[k] + l);
+			__m256 s2 = _mm256_load_ps(z2[k] + l);
+			__m256i r = _mm256_load_si256((const __m256i *)(seed + l));
+			__m256 a = _mm256_load_ps(amp + l);
+			
+			for (size_t s = 0; s < n; s++)
+			{
+				float *o = out + s * LANES + l;
+				__m256 x;
+				
+				if (k == 0)
+				{
+					r = _mm256_mullo_epi32(r, mult);
+					x = _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(r), scale), a), g);
+					if (level != NULL)
+					{
+						x = _mm256_mul_ps(x, _mm256_loadu_ps(level + s * LANES + l));
+					}
+				}
+				else
+				{
+					x = _mm256_loadu_ps(o);
+				}
+				
+				__m256 bx = _mm256_mul_ps(c0, x);
+				__m256 y = _mm256_add_ps(bx, s1);
+				s1 = _mm256_sub_ps(s2, _mm256_mul_ps(c1, y));
+				s2 = _mm256_sub_ps(_mm256_sub_ps(zero, bx), _mm256_mul_ps(c2, y));
+				
+				if (k == 0)
+				{
+					y = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(y, dg), minusOne), one);
+					y = _mm256_mul_ps(_mm256_mul_ps(y, _mm256_sub_ps(oneHalf, _mm256_mul_ps(_mm256_mul_ps(half, y), y))), dr);
+				}
+				_mm256_storeu_ps(o, y);
+			}
+			
+			_mm256_store_ps(z1[k] + l, s1);
+			_mm256_store_ps(z2[k] + l, s2);
+			if (k == 0)
+			{
+				_mm256_store_si256((__m256i *)(seed + l), r);
+			}
+		}
+	}
+}
+
+#elif defined(__SSE2__)
+
+// the low 32 bits of each product, SSE2 only multiplies the even lanes to 64 bits
+static inline __m128i NoiseMulLo(__m128i a, __m128i b)
+{
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+template<uint8_t N>
+void NoiseFilterBank<N>::RenderLanes(const float *level, float *out, size_t n)
+{
+	const __m128i mult = _mm_set1_epi32(16807);
+	const __m128 scale = _mm_set1_ps(NOISE_SCALE);
+	const __m128 half = _mm_set1_ps(0.5f);
+	
+	for (uint8_t l = 0; l < LANES; l += 4)
+	{
+		if (!AnyActive(l, 4))
+		{
+			continue;
+		}
+		
+		for (uint8_t k = 0; k < STAGES; k++)
+		{
+			__m128 f = _mm_load_ps(freq[k] + l);
+			__m128 d = _mm_load_ps(damp[k] + l);
+			__m128 dr = _mm_load_ps(drive[k] + l);
+			__m128 lo = _mm_load_ps(low[k] + l);
+			__m128 bp = _mm_load_ps(band[k] + l);
+			
+			__m128i r = _mm_load_si128((const __m128i *)(seed + l));
+			__m128 a = _mm_load_ps(amp + l);
+			__m128 g = _mm_load_ps(gain + l);
+			
+			for (size_t s = 0; s < n; s++)
+			{
+				float *o = out + s * LANES + l;
+				__m128 in;
+				
+				if (k == 0)
+				{
+					r = NoiseMulLo(r, mult);
+					in = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(_mm_cvtepi32_ps(r), scale), a), g);
+				}
+				else
+				{
+					in = _mm_loadu_ps(o);
+				}
+				
+				__m128 sum = _mm_setzero_ps();
+				for (uint8_t pass = 0; pass < 2; pass++)
+				{
+					__m128 notch = _mm_sub_ps(in, _mm_mul_ps(d, bp));
+					lo = _mm_add_ps(lo, _mm_mul_ps(f, bp));
+					__m128 hp = _mm_sub_ps(notch, lo);
+					__m128 cube = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(dr, bp), bp), bp);
+					bp = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(f, hp), bp), cube);
+					
+					__m128 y = _mm_mul_ps(half, k == 0 ? hp : bp);
+					sum = pass == 0 ? y : _mm_add_ps(sum, y);
+				}
+				
+				if (k == 0 && level != NULL)
+				{
+					sum = _mm_mul_ps(sum, _mm_loadu_ps(level + s * LANES + l));
+				}
+				_mm_storeu_ps(o, sum);
+			}
+			
+			_mm_store_ps(low[k] + l, lo);
+			_mm_store_ps(band[k] + l, bp);
+			if (k == 0)
+			{
+				_mm_store_si128((__m128i *)(seed + l), r);
+			}
+		}
+	}
+}
+
+template<uint8_t N>
+void NoiseBiquadBank<N>::RenderLanes(const float *level, float *out, size_t n)
+{
+	const __m128i mult = _mm_set1_epi32(16807);
+	const __m128 scale = _mm_set1_ps(NOISE_SCALE);
+	const __m128 g = _mm_set1_ps(gain);
+	const __m128 dg = _mm_set1_ps(driveGain);
+	const __m128 dr = _mm_set1_ps(driveRecip);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 minusOne = _mm_set1_ps(-1.0f);
+	const __m128 oneHalf = _mm_set1_ps(1.5f);
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 zero = _mm_setzero_ps();
+	
+	for (uint8_t l = 0; l < LANES; l += 4)
+	{
+		if (!AnyActive(l, 4))
+		{
+			continue;
+		}
+		
+		__m128 c0 = _mm_load_ps(b0 + l);
+		__m128 c1 = _mm_load_ps(a1 + l);
+		__m128 c2 = _mm_load_ps(a2 + l);
+		
+		for (uint8_t k = 0; k < STAGES; k++)
+		{
+			__m128 s1 = _mm_load_ps(z1[k] + l);
+			__m128 s2 = _mm_load_ps(z2[k] + l);
+			__m128i r = _mm_load_si128((const __m128i *)(seed + l));
+			__m128 a = _mm_load_ps(amp + l);
+			
+			for (size_t s = 0; s < n; s++)
+			{
+				float *o = out + s * LANES + l;
+				__m128 x;
+				
+				if (k == 0)
+				{
+					r = NoiseMulLo(r, mult);
+					x = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(_mm_cvtepi32_ps(r), scale), a), g);
+					if (level != NULL)
+					{
+						x = _mm_mul_ps(x, _mm_loadu_ps(level + s * LANES + l));
+					}
+				}
+				else
+				{
+					x = _mm_loadu_ps(o);
+				}
+				
+				__m128 bx = _mm_mul_ps(c0, x);
+				__m128 y = _mm_add_ps(bx, s1);
+				s1 = _mm_sub_ps(s2, _mm_mul_ps(c1, y));
+				s2 = _mm_sub_ps(_mm_sub_ps(zero, bx), _mm_mul_ps(c2, y));
+				
+				if (k == 0)
+				{
+					y = _mm_min_ps(_mm_max_ps(_mm_mul_ps(y, dg), minusOne), one);
+					y = _mm_mul_ps(_mm_mul_ps(y, _mm_sub_ps(oneHalf, _mm_mul_ps(_mm_mul_ps(half, y), y))), dr);
+				}
+				_mm_storeu_ps(o, y);
+			}
+			
+			_mm_store_ps(z1[k] + l, s1);
+			_mm_store_ps(z2[k] + l, s2);
+			if (k == 0)
+			{
+				_mm_store_si128((__m128i *)(seed + l), r);
+			}
+		}
+	}
+}
+
+#else
+
+template<uint8_t N>
+void NoiseFilterBank<N>::RenderLanes(const float *level, float *out, size_t n)
+{
+	// the FPU has no lanes to fill, so only the active slots are run, each through its whole chain
+	for (uint8_t i = 0; i < LANES; i++)
+	{
+		if (active[i])
+		{
+			RenderLane(i, level, out, n);
+		}
+	}
+}
+
+template<uint8_t N>
+void NoiseBiquadBank<N>::RenderLanes(const float *level, float *out, size_t n)
+{
+	for (uint8_t i = 0; i < LANES; i++)
+	{
+		if (active[i])
+		{
+			RenderLane(i, level, out, n);
+		}
+	}
+}
+
+#endif
@@ -25,10 +25,19 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include "utilities.h"
 #include "voice.h"
+#include "fastmath.h"
 
 using namespace daisy;
 using namespace daisysp;
 
+// the pot mappings, see InitPots()
+template<uint8_t N> Parameter NoiseVoice<N>::ADSRAttackPotParm;
+template<uint8_t N> Parameter NoiseVoice<N>::ADSRDecayPotParm;
+template<uint8_t N> Parameter NoiseVoice<N>::ADSRSustainPotParm;
+template<uint8_t N> Parameter NoiseVoice<N>::ADSRReleasePotParm;
+template<uint8_t N> Parameter NoiseVoice<N>::ResonancePotParm;
+template<uint8_t N> Parameter NoiseVoice<N>::DrivePotParm;
+
 
 void NoiseFilter::Init(float SR, int32_t seed)
 {
@@ -98,137 +107,258 @@ void NoiseFilter::SetDrive(float drive)
 
 
 
-void NoiseVoice::Init(DaisyPod *phw, float SR) 
+template<uint8_t N>
+void NoiseVoice<N>::Init(DaisyPod *phw, float SR) 
 {
 	NullVoice::Init(phw, SR);
-	polyphony = NOISE_VOICE_POLYPHONY;
+	InitPolyphony(NOISE_VOICE_POLYPHONY, N, slots);
 	ADSROn = true;
 	ADSRAttack = ADSR_ATTACK_DEFAULT;
 	ADSRDecay = ADSR_DECAY_DEFAULT;
 	ADSRSustain = 1.0;
 	ADSRRelease = ADSR_RELEASE_DEFAULT;
 	
+	env.Init(sampleRate);
+	env.SetAttackTime(ADSRAttack);
+	env.SetDecayTime(ADSRDecay);
+	env.SetSustainLevel(ADSRSustain);
+	env.SetReleaseTime(ADSRRelease);
+	
 	resonance = 0.8;
 	drive = 0.5;
 	
+	noiseModel = NOISE_FILTER_MODEL;
+	noise.Init(SR);
+	biquad.Init(SR);
+	
 	int32_t seed = 7;
-	for (uint8_t i = 0; i < polyphony; i++)
+	for (uint8_t i = 0; i < maxPolyphony; i++)
 	{
-		noise[i].Init(SR, seed + (i * seed)); // i is seed
-		noise[i].SetAmp(0);
-		noise[i].SetDrive(drive);
-		noise[i].SetResonance(resonance);
-		
-		adsr[i].Init(sampleRate);
-		adsr[i].SetAttackTime(ADSRAttack);
-		adsr[i].SetDecayTime(ADSRDecay);
-		adsr[i].SetSustainLevel(ADSRSustain);
-		adsr[i].SetReleaseTime(ADSRRelease);
+		noise.SetSeed(i, seed + (i * seed)); // i is seed
+		noise.SetAmp(i, 0);
+		biquad.SetSeed(i, seed + (i * seed));
+		biquad.SetAmp(i, 0);
 	}	
+	noise.SetDrive(drive);
+	noise.SetResonance(resonance);
+	biquad.SetDrive(drive);
+	biquad.SetResonance(resonance);
 	
-	// See controlmap
-	ADSRAttackPotParm.Init(hw->knob1, ADSR_ATTACK_MIN, ADSR_ATTACK_MAX, Parameter::LINEAR);
-	ADSRDecayPotParm.Init(hw->knob2, ADSR_DECAY_MIN, ADSR_DECAY_MAX, Parameter::LINEAR);
-	ADSRSustainPotParm.Init(hw->knob1, ADSR_SUSTAIN_MIN, ADSR_SUSTAIN_MAX, Parameter::LINEAR);
-	ADSRReleasePotParm.Init(hw->knob2, ADSR_RELEASE_MIN, ADSR_RELEASE_MAX, Parameter::LINEAR);
-	ResonancePotParm.Init(hw->knob1, 0.0, 1.0, Parameter::LINEAR);
-	DrivePotParm.Init(hw->knob2, 0.0, 1.0, Parameter::LINEAR);
-
 	Panic();
 }
 
-void NoiseVoice::Panic() 
+template<uint8_t N>
+void NoiseVoice<N>::Panic() 
 {
 	NullVoice::Panic();
 	
-	for (uint8_t i = 0; i < polyphony; i++)
+	for (uint8_t i = 0; i < maxPolyphony; i++)
 	{
-		noise[i].SetAmp(0);
-		adsr[i].Process(false);	
+		noise.SetAmp(i, 0);
+		biquad.SetAmp(i, 0);
+		env.Process(i, false);
 	}
 }
 
-void NoiseVoice::StartNote(uint8_t i, NoteOnEvent *p)
+template<uint8_t N>
+void NoiseVoice<N>::StartNote(uint8_t i, NoteOnEvent *p)
 {
 	//log("n: %d, m: %d", i, p->note);
+	WakeSlot(i);
 	notes[i].midiNote = p->note;
 	notes[i].amplitude = (float)p->velocity / 127.0f;
 			
-	noise[i].SetFreq(mtof(p->note));
-	noise[i].SetAmp(notes[i].amplitude);
-	adsr[i].Retrigger(false); // set attack mode
+	// only the bank in use, the other is brought up to date if the model is switched
+	if (noiseModel == NOISE_FILTER_BIQUAD)
+	{
+		biquad.SetNote(i, p->note);
+		biquad.SetAmp(i, notes[i].amplitude);
+	}
+	else
+	{
+		noise.SetFreq(i, MathMtof(p->note));
+		noise.SetAmp(i, notes[i].amplitude);
+	}
+	env.Retrigger(i); // set attack mode
 	
 }
 
 
-void NoiseVoice::NoteOn(NoteOnEvent *p)
+template<uint8_t N>
+void NoiseVoice<N>::NoteOff(NoteOffEvent *p)
 {
-	for (uint8_t i = 0; i < polyphony; i++)
+	int8_t i = allocator.NoteOff(p->note);
+	
+	if (i >= 0 && ADSROn == false)
 	{
-		if (notes[i].midiNote == p->note)
+		noise.SetAmp(i, 0.0);
+		biquad.SetAmp(i, 0.0);
+	}
+}
+
+
+template<uint8_t N>
+void NoiseVoice<N>::SetFreq(float f)
+{
+	
+}
+
+
+template<uint8_t N>
+float NoiseVoice<N>::Process(void) 
+{
+	float level[NoiseFilterBank<N>::LANES];
+	
+	for (uint8_t i = 0; i < NoiseFilterBank<N>::LANES; i++)
+	{
+		level[i] = 0.0;
+		noise.SetActive(i, i < maxPolyphony && notes[i].parked == false);
+		biquad.SetActive(i, i < maxPolyphony && notes[i].parked == false);
+		
+		if (i >= maxPolyphony || notes[i].parked == true)
 		{
-			// if we are playing the same note
-			StartNote(i, p);
-			return;
+			continue;
 		}
 		
-		// start new note if unused and adsr is done 
-		if (notes[i].midiNote == 0 && adsr[i].IsRunning() == false)
+		bool attack = true;
+		if (notes[i].midiNote == 0)
+		{
+			attack = false; // release
+		}
+				
+		level[i] = 1.0;
+		if (ADSROn == true)
+		{
+			level[i] = env.Process(i, attack);
+		}
+	}
+	
+	// adsr level as we apply it to the noise before the filter to excite the filter. 
+	if (noiseModel == NOISE_FILTER_BIQUAD)
+	{
+		biquad.Render(level, noiseOut, 1);
+	}
+	else
+	{
+		noise.Render(level, noiseOut, 1);
+	}
+	
+	float sig = 0.0;
+	for (uint8_t i = 0; i < maxPolyphony; i++)
+	{
+		if (notes[i].parked == false)
 		{
-			StartNote(i, p);
-			return;	
+			sig += noiseOut[i];
 		}
 	}
+	
+	return sig / mixDivisor;
 }
 
+// the envelopes and noise filters of every slot at once, RenderSlot() reads its column
+// the noise seeds move on as if rendered (see NoiseSkip), the filters keep their state
+template<uint8_t N>
+void NoiseVoice<N>::SkipBank(size_t n)
+{
+	if (noiseModel == NOISE_FILTER_BIQUAD)
+	{
+		biquad.Skip(n);
+	}
+	else
+	{
+		noise.Skip(n);
+	}
+}
 
-void NoiseVoice::NoteOff(NoteOffEvent *p)
+template<uint8_t N>
+void NoiseVoice<N>::RenderBank(size_t n)
 {
-	for (uint8_t i = 0; i < polyphony; i++)
+	// nothing to render, only the noise moves on
+	if (IsIdle())
+	{
+		SkipBank(n);
+		return;
+	}
+	
+	const float *level = NULL;
+	if (ADSROn == true)
 	{
-		if (notes[i].midiNote == p->note)
+		for (uint8_t i = 0; i < maxPolyphony; i++)
 		{
-			notes[i].midiNote = 0;	
-			
-			if (ADSROn == false)
-			{
-				noise[i].SetAmp(0.0);
-			}
+			env.SetGate(i, notes[i].midiNote != 0); // released when 0
 		}
+		env.Render(envOut, n);
+		level = envOut;
+	}
+	
+	// only the slots the mixing loop will read, the parked and idle ones keep their filter state
+	for (uint8_t i = 0; i < NoiseFilterBank<N>::LANES; i++)
+	{
+		bool active = i < maxPolyphony && notes[i].parked == false && notes[i].idle == false;
+		noise.SetActive(i, active);
+		biquad.SetActive(i, active);
+	}
+	
+	// adsr level as we apply it to the noise before the filter to excite the filter. 
+	if (noiseModel == NOISE_FILTER_BIQUAD)
+	{
+		biquad.Render(level, noiseOut, n);
+	}
+	else
+	{
+		noise.Render(level, noiseOut, n);
 	}
 }
 
-
-void NoiseVoice::SetFreq(float f)
+template<uint8_t N>
+void NoiseVoice<N>::RenderSlot(uint8_t i, float *buf, size_t n)
 {
+	const float *o = noiseOut + i;
+	const uint8_t stride = NoiseFilterBank<N>::LANES;
 	
+	for (size_t s = 0; s < n; s++)
+	{
+		buf[s] = o[s * stride];
+	}
 }
 
+// the resonant filters ring on after the envelope has finished, so the slot is idle once that has
+// died away too, the energy tail
+template<uint8_t N>
+bool NoiseVoice<N>::SlotIdle(uint8_t i)
+{
+	if (ADSROn == true && env.IsRunning(i))
+	{
+		return false;
+	}
+	
+	return NullVoice::SlotIdle(i);
+}
 
-float NoiseVoice::Process(void) 
+// a slot is taken again once its envelope has finished, as before the allocator, its filters'
+// ring is cut by the next note
+template<uint8_t N>
+bool NoiseVoice<N>::SlotEnded(uint8_t i)
 {
-	float sig = 0.0;
-	for (uint8_t i = 0; i < polyphony; i++)
+	if (ADSROn == true)
 	{
-		bool attack = true;
-		if (notes[i].midiNote == 0)
-		{
-			attack = false; // release
-		}
-				
-		float ADSRLevel = 1.0;
-		if (ADSROn == true)
-		{
-			ADSRLevel = adsr[i].Process(attack);
-		}
-		sig += noise[i].Process(ADSRLevel); // pass adsr level as we apply it to the noise before the filter to excite the filter. 
+		return env.IsRunning(i) == false;
 	}
 	
-	return sig / polyphony;
+	return notes[i].idle;
 }
 
+template<uint8_t N>
+void NoiseVoice<N>::ParkSlot(uint8_t i)
+{
+	NullVoice::ParkSlot(i);
+	noise.SetAmp(i, 0);
+	biquad.SetAmp(i, 0);
+}
 
-void NoiseVoice::SetResonance(float v)
+
+template<uint8_t N>
+void NoiseVoice<N>::SetResonance(float v)
 {
 	//float a = GetCCMinMax(value, 0.0, 1.0);
 	if (v == resonance)
@@ -238,14 +368,13 @@ void NoiseVoice::SetResonance(float v)
 	
 	resonance = v;
 	
-	for (uint8_t i = 0; i < polyphony; i++)
-	{
-		noise[i].SetResonance(resonance); 
-	}
+	noise.SetResonance(resonance);
+	biquad.SetResonance(resonance); // the biquads' note table is worked out again here
 }
 
 
-void NoiseVoice::SetDrive(float v)
+template<uint8_t N>
+void NoiseVoice<N>::SetDrive(float v)
 {
 	//float a = GetCCMinMax(value, 0.0, 1.0);
 	if (v == drive)
@@ -255,41 +384,113 @@ void NoiseVoice::SetDrive(float v)
 	
 	drive = v;
 	
-	for (uint8_t i = 0; i < polyphony; i++)
-	{
-		noise[i].SetDrive(drive); 
-	}
+	noise.SetDrive(drive);
+	biquad.SetDrive(drive);
 }
 
 
-void NoiseVoice::ProcessParm4()
+template<uint8_t N>
+void NoiseVoice<N>::InitPots(DaisyPod *phw)
 {
-	SetResonance(ResonancePotParm.Process());
+	// See controlmap
+	ADSRAttackPotParm.Init(phw->knob1, ADSR_ATTACK_MIN, ADSR_ATTACK_MAX, Parameter::LINEAR);
+	ADSRDecayPotParm.Init(phw->knob2, ADSR_DECAY_MIN, ADSR_DECAY_MAX, Parameter::LINEAR);
+	ADSRSustainPotParm.Init(phw->knob1, ADSR_SUSTAIN_MIN, ADSR_SUSTAIN_MAX, Parameter::LINEAR);
+	ADSRReleasePotParm.Init(phw->knob2, ADSR_RELEASE_MIN, ADSR_RELEASE_MAX, Parameter::LINEAR);
+	ResonancePotParm.Init(phw->knob1, 0.0, 1.0, Parameter::LINEAR);
+	DrivePotParm.Init(phw->knob2, 0.0, 1.0, Parameter::LINEAR);
 }
 
 
-void NoiseVoice::ProcessParm5()
+template<uint8_t N>
+float NoiseVoice<N>::ReadParm(uint8_t n)
 {
-	SetDrive(DrivePotParm.Process());
+	switch (n)
+	{
+	case 0:
+		return ADSRAttackPotParm.Process();
+		
+	case 1:
+		return ADSRDecayPotParm.Process();
+		
+	case 2:
+		return ADSRSustainPotParm.Process();
+		
+	case 3:
+		return ADSRReleasePotParm.Process();
+		
+	case 4:
+		return ResonancePotParm.Process();
+		
+	case 5:
+		return DrivePotParm.Process();
+		
+	default:
+		return 0.0;
+	}
 }
 
 
-void NoiseVoice::SetCC0(uint8_t value)
+template<uint8_t N>
+void NoiseVoice<N>::ApplyParm(uint8_t n, float value)
+{
+	switch (n)
+	{
+	case 0:
+		SetADSRAttack(value);
+		break;
+		
+	case 1:
+		SetADSRDecay(value);
+		break;
+		
+	case 2:
+		SetADSRSustain(value);
+		break;
+		
+	case 3:
+		SetADSRRelease(value);
+		break;
+		
+	case 4:
+		SetResonance(value);
+		break;
+		
+	case 5:
+		SetDrive(value);
+		break;
+		
+	default:
+		break;
+	}
+}
+
+
+template<uint8_t N>
+void NoiseVoice<N>::SetCC0(uint8_t value)
 {
 	SetADSRAttack(GetCCMinMax(value, ADSR_ATTACK_MIN, ADSR_ATTACK_MAX));
 }
 
-void NoiseVoice::SetCC1(uint8_t value)
+template<uint8_t N>
+void NoiseVoice<N>::SetCC1(uint8_t value)
 {
 	SetADSRDecay(GetCCMinMax(value, ADSR_DECAY_MIN, ADSR_DECAY_MAX));
 }
 
-void NoiseVoice::SetCC2(uint8_t value)
+template<uint8_t N>
+void NoiseVoice<N>::SetCC2(uint8_t value)
 {
 	if (value == 127)
 	{
 		ADSROn = false;
 		log("ADSR off");
+		
+		// every slot's noise sounds without the ADSR
+		for (uint8_t i = 0; i < maxPolyphony; i++)
+		{
+			WakeSlot(i);
+		}
 	}
 	else
 	{
@@ -299,13 +500,54 @@ void NoiseVoice::SetCC2(uint8_t value)
 	SetADSRSustain(value / 127.0);
 }
 
-void NoiseVoice::SetCC3(uint8_t value)
+template<uint8_t N>
+void NoiseVoice<N>::SetCC3(uint8_t value)
 {
 	SetADSRRelease(GetCCMinMax(value, ADSR_RELEASE_MIN, ADSR_RELEASE_MAX));
 }
 
+// A/B of the filters, below 64 NoiseFilter's Svfs, from 64 the biquads
+template<uint8_t N>
+void NoiseVoice<N>::SetCC4(uint8_t value)
+{
+	SetNoiseModel(value < 64 ? NOISE_FILTER_SVF : NOISE_FILTER_BIQUAD);
+}
+
+template<uint8_t N>
+void NoiseVoice<N>::SetNoiseModel(uint8_t m)
+{
+	if (m == noiseModel)
+	{
+		return;
+	}
+	noiseModel = m;
+	log("Noise filter: %s", m == NOISE_FILTER_BIQUAD ? "biquad" : "svf");
+	
+	// the sounding notes carry on in the filters switched to
+	for (uint8_t i = 0; i < maxPolyphony; i++)
+	{
+		float amp = notes[i].amplitude;
+		if (notes[i].parked == true || (ADSROn == false && notes[i].midiNote == 0))
+		{
+			amp = 0.0;
+		}
+		
+		if (m == NOISE_FILTER_BIQUAD)
+		{
+			biquad.SetNote(i, notes[i].lastNote);
+			biquad.SetAmp(i, amp);
+		}
+		else
+		{
+			noise.SetFreq(i, MathMtof(notes[i].lastNote));
+			noise.SetAmp(i, amp);
+		}
+	}
+}
+
 
-void NoiseVoice::SetADSRAttack(float a)
+template<uint8_t N>
+void NoiseVoice<N>::SetADSRAttack(float a)
 {
 	if (a == ADSRAttack)
 	{
@@ -315,14 +557,12 @@ void NoiseVoice::SetADSRAttack(float a)
 	ADSRAttack = a;
 	//log("Attack: %d msec", (uint32_t)(ADSRAttack * 1000));
 	
-	for (uint8_t i = 0; i < polyphony; i++)
-	{
-		adsr[i].SetAttackTime(ADSRAttack); 
-	}
+	env.SetAttackTime(ADSRAttack);
 }
 	
 
-void NoiseVoice::SetADSRDecay(float v)
+template<uint8_t N>
+void NoiseVoice<N>::SetADSRDecay(float v)
 {
 	if (v == ADSRDecay)
 	{
@@ -331,14 +571,12 @@ void NoiseVoice::SetADSRDecay(float v)
 	ADSRDecay = v;
 	//log("Decay: %d", (uint32_t)(ADSRDecay * 1000));
 	
-	for (uint8_t i = 0; i < polyphony; i++)
-	{
-		adsr[i].SetDecayTime(ADSRDecay); 
-	}
+	env.SetDecayTime(ADSRDecay);
 }
 
 
-void NoiseVoice::SetADSRSustain(float v)
+template<uint8_t N>
+void NoiseVoice<N>::SetADSRSustain(float v)
 {	
 	if (v == ADSRSustain)
 	{
@@ -347,13 +585,11 @@ void NoiseVoice::SetADSRSustain(float v)
 	ADSRSustain = v;
 	//log("Sustain: %d", (uint32_t)(ADSRSustain * 1000));
 
-	for (uint8_t i = 0; i < polyphony; i++)
-	{
-		adsr[i].SetSustainLevel(ADSRSustain); 
-	}
+	env.SetSustainLevel(ADSRSustain);
 }
 
-void NoiseVoice::SetADSRRelease(float v)
+template<uint8_t N>
+void NoiseVoice<N>::SetADSRRelease(float v)
 {
 	if (v == ADSRRelease)
 	{
@@ -362,30 +598,7 @@ void NoiseVoice::SetADSRRelease(float v)
 	ADSRRelease = v;
 	//log("Release: %d", (uint32_t)(ADSRRelease * 1000));
 
-	for (uint8_t i = 0; i < polyphony; i++)
-	{
-		adsr[i].SetReleaseTime(ADSRRelease); 
-	}
-}
-
-void NoiseVoice::ProcessParm0()
-{
-	SetADSRAttack(ADSRAttackPotParm.Process());
+	env.SetReleaseTime(ADSRRelease);
 }
 
-void NoiseVoice::ProcessParm1()
-{
-	SetADSRDecay(ADSRDecayPotParm.Process());
-}
-
-void NoiseVoice::ProcessParm2()
-{
-	SetADSRSustain(ADSRSustainPotParm.Process());
-}
-
-void NoiseVoice::ProcessParm3()
-{
-	SetADSRRelease(ADSRReleasePotParm.Process());
-}
-
-
+template class NoiseVoice<NOISE_VOICE_MAX_POLYPHONY>;
@@ -0,0 +1,245 @@
+/*
+ This file is part of Virtual Robot's Pine Synthesizer. 
+
+Copyright <2022> <Brian Gunnison>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+software and associated documentation files (the "Software"), to deal in the Software 
+without restriction, including without limitation the rights to use, copy, modify, 
+merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+permit persons to whom the Software is furnished to do so, subject to the following 
+conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// N polyBLEP saw oscillators kept as structure of arrays, phase, increment and amplitude of every
+// voice side by side, so one instruction advances several voices. AVX2 renders 8 voices at a time
+// and SSE2 4 on a host build, the Cortex-M7 runs an FPU loop unrolled over 4 voices.
+// Matches DaisySP's Oscillator WAVE_POLYBLEP_SAW except that the blep divides by the increment
+// through its reciprocal, within 1e-6 of it.
+template<uint8_t N>
+class SawBank
+{
+public:
+	// voices rounded up to a multiple of 8, the widest vector (AVX2), so every path steps whole
+	// vectors with no remainder loop and the arrays stay 32 byte aligned. The spare lanes run
+	// silent. The other banks (envbank.h, noisebank.h) are laid out the same way
+	static constexpr uint8_t LANES = (N + 7) & ~7;
+	
+	void Init(float sampleRate)
+	{
+		sampleRateRecip = 1.0f / sampleRate;
+		
+		for (uint8_t i = 0; i < LANES; i++)
+		{
+			phase[i] = 0.0f;
+			inc[i] = 0.0f;
+			incRecip[i] = 0.0f;
+			amp[i] = 0.0f;
+		}
+		
+		for (uint8_t i = 0; i < N; i++)
+		{
+			SetFreq(i, 100.0f);
+			SetAmp(i, 0.5f);
+		}
+	}
+	
+	void SetFreq(uint8_t i, float f)
+	{
+		inc[i] = f * sampleRateRecip;
+		incRecip[i] = 1.0f / inc[i];
+	}
+	
+	void SetAmp(uint8_t i, float a) { amp[i] = a; }
+	
+	// n samples of every voice into out, sample major: out[s * LANES + i] is voice i at sample s
+	void Render(float *out, size_t n);
+	
+	// n samples of phase without the output, the same additions as Render() so the phases stay
+	// where rendering would have left them
+	void Skip(size_t n)
+	{
+		for (uint8_t i = 0; i < N; i++)
+		{
+			float t = phase[i];
+			
+			for (size_t s = 0; s < n; s++)
+			{
+				t += inc[i];
+				if (t > 1.0f)
+				{
+					t -= 1.0f;
+				}
+			}
+			
+			phase[i] = t;
+		}
+	}
+	
+private:
+	alignas(32) float phase[LANES];
+	alignas(32) float inc[LANES];
+	alignas(32) float incRecip[LANES];
+	alignas(32) float amp[LANES];
+	float sampleRateRecip;
+};
+
+
+#if defined(__AVX2__)
+
+template<uint8_t N>
+void SawBank<N>::Render(float *out, size_t n)
+{
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 two = _mm256_set1_ps(2.0f);
+	const __m256 zero = _mm256_setzero_ps();
+	
+	for (uint8_t l = 0; l < LANES; l += 8)
+	{
+		__m256 t = _mm256_load_ps(phase + l);
+		__m256 dt = _mm256_load_ps(inc + l);
+		__m256 rdt = _mm256_load_ps(incRecip + l);
+		__m256 a = _mm256_load_ps(amp + l);
+		__m256 top = _mm256_sub_ps(one, dt);
+		
+		for (size_t s = 0; s < n; s++)
+		{
+			__m256 saw = _mm256_sub_ps(_mm256_mul_ps(two, t), one);
+			
+			// the blep at the start of the cycle, t < dt, and at its end, t > 1 - dt
+			__m256 x0 = _mm256_mul_ps(t, rdt);
+			__m256 b0 = _mm256_sub_ps(_mm256_sub_ps(_mm256_add_ps(x0, x0), _mm256_mul_ps(x0, x0)), one);
+			__m256 x1 = _mm256_mul_ps(_mm256_sub_ps(t, one), rdt);
+			__m256 b1 = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x1, x1), x1), x1), one);
+			
+			__m256 blep = _mm256_blendv_ps(zero, b1, _mm256_cmp_ps(t, top, _CMP_GT_OQ));
+			blep = _mm256_blendv_ps(blep, b0, _mm256_cmp_ps(t, dt, _CMP_LT_OQ));
+			
+			// DaisySP inverts the saw, -(saw - blep)
+			_mm256_storeu_ps(out + s * LANES + l, _mm256_mul_ps(_mm256_sub_ps(blep, saw), a));
+			
+			t = _mm256_add_ps(t, dt);
+			t = _mm256_sub_ps(t, _mm256_and_ps(_mm256_cmp_ps(t, one, _CMP_GT_OQ), one));
+		}
+		
+		_mm256_store_ps(phase + l, t);
+	}
+}
+
+#elif defined(__SSE2__)
+
+template<uint8_t N>
+void SawBank<N>::Render(float *out, size_t n)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 two = _mm_set1_ps(2.0f);
+	
+	for (uint8_t l = 0; l < LANES; l += 4)
+	{
+		__m128 t = _mm_load_ps(phase + l);
+		__m128 dt = _mm_load_ps(inc + l);
+		__m128 rdt = _mm_load_ps(incRecip + l);
+		__m128 a = _mm_load_ps(amp + l);
+		__m128 top = _mm_sub_ps(one, dt);
+		
+		for (size_t s = 0; s < n; s++)
+		{
+			__m128 saw = _mm_sub_ps(_mm_mul_ps(two, t), one);
+			
+			// the blep at the start of the cycle, t < dt, and at its end, t > 1 - dt
+			__m128 x0 = _mm_mul_ps(t, rdt);
+			__m128 b0 = _mm_sub_ps(_mm_sub_ps(_mm_add_ps(x0, x0), _mm_mul_ps(x0, x0)), one);
+			__m128 x1 = _mm_mul_ps(_mm_sub_ps(t, one), rdt);
+			__m128 b1 = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x1, x1), x1), x1), one);
+			
+			// SSE2 has no blend, select with and / andnot
+			__m128 m0 = _mm_cmplt_ps(t, dt);
+			__m128 m1 = _mm_andnot_ps(m0, _mm_cmpgt_ps(t, top));
+			__m128 blep = _mm_or_ps(_mm_and_ps(m0, b0), _mm_and_ps(m1, b1));
+			
+			// DaisySP inverts the saw, -(saw - blep)
+			_mm_storeu_ps(out + s * LANES + l, _mm_mul_ps(_mm_sub_ps(blep, saw), a));
+			
+			t = _mm_add_ps(t, dt);
+			t = _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, one), one));
+		}
+		
+		_mm_store_ps(phase + l, t);
+	}
+}
+
+#else
+
+template<uint8_t N>
+void SawBank<N>::Render(float *out, size_t n)
+{
+	// 4 voices interleaved: the M7 issues in order, so while one voice's result is still in the
+	// FPU pipeline the next voice's independent operation can go. envbank.h's scalar loop does
+	// the same
+	for (uint8_t l = 0; l < LANES; l += 4)
+	{
+		float t[4], dt[4], rdt[4], a[4];
+		
+		for (uint8_t k = 0; k < 4; k++)
+		{
+			t[k] = phase[l + k];
+			dt[k] = inc[l + k];
+			rdt[k] = incRecip[l + k];
+			a[k] = amp[l + k];
+		}
+		
+		for (size_t s = 0; s < n; s++)
+		{
+#pragma GCC unroll 4
+			for (uint8_t k = 0; k < 4; k++)
+			{
+				float saw = 2.0f * t[k] - 1.0f;
+				float blep = 0.0f;
+				
+				if (t[k] < dt[k])
+				{
+					float x = t[k] * rdt[k];
+					blep = x + x - x * x - 1.0f;
+				}
+				else if (t[k] > 1.0f - dt[k])
+				{
+					float x = (t[k] - 1.0f) * rdt[k];
+					blep = x * x + x + x + 1.0f;
+				}
+				
+				out[s * LANES + l + k] = (blep - saw) * a[k];
+				
+				t[k] += dt[k];
+				if (t[k] > 1.0f)
+				{
+					t[k] -= 1.0f;
+				}
+			}
+		}
+		
+		for (uint8_t k = 0; k < 4; k++)
+		{
+			phase[l + k] = t[k];
+		}
+	}
+}
+
+#endif
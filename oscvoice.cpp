@@ -25,117 +25,105 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include "utilities.h"
 #include "voice.h"
+#include "fastmath.h"
 
 using namespace daisy;
 using namespace daisysp;
 
+// the pot mappings, see InitPots()
+template<uint8_t N> Parameter OscVoice<N>::ADSRAttackPotParm;
+template<uint8_t N> Parameter OscVoice<N>::ADSRDecayPotParm;
+template<uint8_t N> Parameter OscVoice<N>::ADSRSustainPotParm;
+template<uint8_t N> Parameter OscVoice<N>::ADSRReleasePotParm;
 
-void OscVoice::Init(DaisyPod *phw, float SR) 
+
+template<uint8_t N>
+void OscVoice<N>::Init(DaisyPod *phw, float SR) 
 {
 	NullVoice::Init(phw, SR);
-	polyphony = OSC_VOICE_POLYPHONY;
+	InitPolyphony(OSC_VOICE_POLYPHONY, N, slots);
 	ADSROn = true;
 	ADSRAttack = ADSR_ATTACK_DEFAULT;
 	ADSRDecay = ADSR_DECAY_DEFAULT;
 	ADSRSustain = 1.0;
 	ADSRRelease = ADSR_RELEASE_DEFAULT;
 	
-	for (uint8_t i = 0; i < polyphony; i++)
+	env.Init(sampleRate);
+	env.SetAttackTime(ADSRAttack);
+	env.SetDecayTime(ADSRDecay);
+	env.SetSustainLevel(ADSRSustain);
+	env.SetReleaseTime(ADSRRelease);
+	
+	synth.Init(sampleRate);
+	
+	for (uint8_t i = 0; i < maxPolyphony; i++)
 	{
-		synth[i].Init(sampleRate);
-		synth[i].SetWaveform(Oscillator::WAVE_POLYBLEP_SAW);
-		synth[i].SetAmp(0);
-		
-		adsr[i].Init(sampleRate);
-		adsr[i].SetAttackTime(ADSRAttack);
-		adsr[i].SetDecayTime(ADSRDecay);
-		adsr[i].SetSustainLevel(ADSRSustain);
-		adsr[i].SetReleaseTime(ADSRRelease);
+		synth.SetAmp(i, 0);
 	}
 	
-	// See controlmap
-	ADSRAttackPotParm.Init(hw->knob1, ADSR_ATTACK_MIN, ADSR_ATTACK_MAX, Parameter::LINEAR);
-	ADSRDecayPotParm.Init(hw->knob2, ADSR_DECAY_MIN, ADSR_DECAY_MAX, Parameter::LINEAR);
-	ADSRSustainPotParm.Init(hw->knob1, ADSR_SUSTAIN_MIN, ADSR_SUSTAIN_MAX, Parameter::LINEAR);
-	ADSRReleasePotParm.Init(hw->knob2, ADSR_RELEASE_MIN, ADSR_RELEASE_MAX, Parameter::LINEAR);
-
 	Panic();
 }
 
-void OscVoice::Panic() 
+template<uint8_t N>
+void OscVoice<N>::Panic() 
 {
 	NullVoice::Panic();
 	
-	for (uint8_t i = 0; i < polyphony; i++)
+	for (uint8_t i = 0; i < maxPolyphony; i++)
 	{
-		synth[i].SetAmp(0);
-		adsr[i].Process(false);	
+		synth.SetAmp(i, 0);
+		env.Process(i, false);
 	}
 }
 
-void OscVoice::StartNote(uint8_t i, NoteOnEvent *p)
+template<uint8_t N>
+void OscVoice<N>::StartNote(uint8_t i, NoteOnEvent *p)
 {
 	//log("n: %d, m: %d", i, p->note);
+	WakeSlot(i);
 	notes[i].midiNote = p->note;
 	notes[i].amplitude = (float)p->velocity / 127.0f;
 			
-	synth[i].SetFreq(mtof(p->note));
-	synth[i].SetAmp(notes[i].amplitude);
-	adsr[i].Retrigger(false); // set attack mode
+	synth.SetFreq(i, MathMtof(p->note));
+	synth.SetAmp(i, notes[i].amplitude);
+	env.Retrigger(i); // set attack mode
 	
 }
 
 
-void OscVoice::NoteOn(NoteOnEvent *p)
-{
-	for (uint8_t i = 0; i < polyphony; i++)
-	{
-		if (notes[i].midiNote == p->note)
-		{
-			// if we are playing the same note
-			StartNote(i, p);
-			return;
-		}
-		
-		// start new note if unused and adsr is done 
-		if (notes[i].midiNote == 0 && adsr[i].IsRunning() == false)
-		{
-			StartNote(i, p);
-			return;	
-		}
-	}
-}
-
-
-void OscVoice::NoteOff(NoteOffEvent *p)
+template<uint8_t N>
+void OscVoice<N>::NoteOff(NoteOffEvent *p)
 {
-	for (uint8_t i = 0; i < polyphony; i++)
+	int8_t i = allocator.NoteOff(p->note);
+	
+	if (i >= 0 && ADSROn == false)
 	{
-		if (notes[i].midiNote == p->note)
-		{
-			notes[i].midiNote = 0;	
-			
-			if (ADSROn == false)
-			{
-				synth[i].SetAmp(0.0);
-			}
-		}
+		synth.SetAmp(i, 0.0);
 	}
 }
 
 
-void OscVoice::SetFreq(float f)
+template<uint8_t N>
+void OscVoice<N>::SetFreq(float f)
 {
-	//synth[0].SetFreq(f);
-	//synth[0].SetAmp(1);
+	//synth.SetFreq(0, f);
+	//synth.SetAmp(0, 1);
 }
 
 
-float OscVoice::Process(void) 
+template<uint8_t N>
+float OscVoice<N>::Process(void) 
 {
 	float sig = 0.0;
-	for (uint8_t i = 0; i < polyphony; i++)
+	synth.Render(synthOut, 1);
+	
+	for (uint8_t i = 0; i < maxPolyphony; i++)
 	{
+		if (notes[i].parked == true)
+		{
+			continue;
+		}
+		
 		bool attack = true;
 		if (notes[i].midiNote == 0)
 		{
@@ -145,30 +133,101 @@ float OscVoice::Process(void)
 		float ADSRLevel = 1.0;
 		if (ADSROn == true)
 		{
-			ADSRLevel = adsr[i].Process(attack);
+			ADSRLevel = env.Process(i, attack);
 		}
-		sig += synth[i].Process() * ADSRLevel;
+		sig += synthOut[i] * ADSRLevel;
+	}
+	
+	return sig / mixDivisor;
+}
+
+// the saws and envelopes of every slot at once, the vector units run them side by side
+template<uint8_t N>
+void OscVoice<N>::RenderBank(size_t n)
+{
+	// nothing to render, only the phases move on
+	if (IsIdle())
+	{
+		SkipBank(n);
+		return;
+	}
+	
+	synth.Render(synthOut, n);
+	
+	if (ADSROn == false)
+	{
+		return;
 	}
 	
-	return sig / polyphony;
+	for (uint8_t i = 0; i < maxPolyphony; i++)
+	{
+		env.SetGate(i, notes[i].midiNote != 0); // released when 0
+	}
+	env.Render(envOut, n);
+	
+	// same layout, so one flat loop applies every slot's envelope
+	for (size_t k = 0; k < n * SawBank<N>::LANES; k++)
+	{
+		synthOut[k] *= envOut[k];
+	}
 }
 
-void OscVoice::SetCC0(uint8_t value)
+template<uint8_t N>
+void OscVoice<N>::RenderSlot(uint8_t i, float *buf, size_t n)
+{
+	const float *saw = synthOut + i;
+	const uint8_t stride = SawBank<N>::LANES;
+	
+	for (size_t s = 0; s < n; s++)
+	{
+		buf[s] = saw[s * stride];
+	}
+}
+
+// a finished envelope is silent to the sample, the energy tail only without one
+template<uint8_t N>
+bool OscVoice<N>::SlotIdle(uint8_t i)
+{
+	if (ADSROn == false)
+	{
+		return NullVoice::SlotIdle(i);
+	}
+	
+	return env.IsRunning(i) == false;
+}
+
+template<uint8_t N>
+void OscVoice<N>::ParkSlot(uint8_t i)
+{
+	NullVoice::ParkSlot(i);
+	synth.SetAmp(i, 0);
+}
+
+template<uint8_t N>
+void OscVoice<N>::SetCC0(uint8_t value)
 {
 	SetADSRAttack(GetCCMinMax(value, ADSR_ATTACK_MIN, ADSR_ATTACK_MAX));
 }
 
-void OscVoice::SetCC1(uint8_t value)
+template<uint8_t N>
+void OscVoice<N>::SetCC1(uint8_t value)
 {
 	SetADSRDecay(GetCCMinMax(value, ADSR_DECAY_MIN, ADSR_DECAY_MAX));
 }
 
-void OscVoice::SetCC2(uint8_t value)
+template<uint8_t N>
+void OscVoice<N>::SetCC2(uint8_t value)
 {
 	if (value == 127)
 	{
 		ADSROn = false;
 		log("ADSR off");
+		
+		// every slot's oscillator drones without the ADSR
+		for (uint8_t i = 0; i < maxPolyphony; i++)
+		{
+			WakeSlot(i);
+		}
 	}
 	else
 	{
@@ -178,13 +237,15 @@ void OscVoice::SetCC2(uint8_t value)
 	SetADSRSustain(value / 127.0);
 }
 
-void OscVoice::SetCC3(uint8_t value)
+template<uint8_t N>
+void OscVoice<N>::SetCC3(uint8_t value)
 {
 	SetADSRRelease(GetCCMinMax(value, ADSR_RELEASE_MIN, ADSR_RELEASE_MAX));
 }
 
 
-void OscVoice::SetADSRAttack(float a)
+template<uint8_t N>
+void OscVoice<N>::SetADSRAttack(float a)
 {
 	if (a == ADSRAttack)
 	{
@@ -194,14 +255,12 @@ void OscVoice::SetADSRAttack(float a)
 	ADSRAttack = a;
 	//log("Attack: %d msec", (uint32_t)(ADSRAttack * 1000));
 	
-	for (uint8_t i = 0; i < polyphony; i++)
-	{
-		adsr[i].SetAttackTime(ADSRAttack); 
-	}
+	env.SetAttackTime(ADSRAttack);
 }
 	
 
-void OscVoice::SetADSRDecay(float v)
+template<uint8_t N>
+void OscVoice<N>::SetADSRDecay(float v)
 {
 	if (v == ADSRDecay)
 	{
@@ -210,14 +269,12 @@ void OscVoice::SetADSRDecay(float v)
 	ADSRDecay = v;
 	//log("Decay: %d", (uint32_t)(ADSRDecay * 1000));
 	
-	for (uint8_t i = 0; i < polyphony; i++)
-	{
-		adsr[i].SetDecayTime(ADSRDecay); 
-	}
+	env.SetDecayTime(ADSRDecay);
 }
 
 
-void OscVoice::SetADSRSustain(float v)
+template<uint8_t N>
+void OscVoice<N>::SetADSRSustain(float v)
 {	
 	if (v == ADSRSustain)
 	{
@@ -226,13 +283,11 @@ void OscVoice::SetADSRSustain(float v)
 	ADSRSustain = v;
 	//log("Sustain: %d", (uint32_t)(ADSRSustain * 1000));
 
-	for (uint8_t i = 0; i < polyphony; i++)
-	{
-		adsr[i].SetSustainLevel(ADSRSustain); 
-	}
+	env.SetSustainLevel(ADSRSustain);
 }
 
-void OscVoice::SetADSRRelease(float v)
+template<uint8_t N>
+void OscVoice<N>::SetADSRRelease(float v)
 {
 	if (v == ADSRRelease)
 	{
@@ -241,34 +296,67 @@ void OscVoice::SetADSRRelease(float v)
 	ADSRRelease = v;
 	//log("Release: %d", (uint32_t)(ADSRRelease * 1000));
 
-	for (uint8_t i = 0; i < polyphony; i++)
-	{
-		adsr[i].SetReleaseTime(ADSRRelease); 
-	}
-}
-
-void OscVoice::ProcessParm0()
-{
-	SetADSRAttack(ADSRAttackPotParm.Process());
+	env.SetReleaseTime(ADSRRelease);
 }
 
-
-void OscVoice::ProcessParm1()
+template<uint8_t N>
+void OscVoice<N>::InitPots(DaisyPod *phw)
 {
-	SetADSRDecay(ADSRDecayPotParm.Process());
+	// See controlmap
+	ADSRAttackPotParm.Init(phw->knob1, ADSR_ATTACK_MIN, ADSR_ATTACK_MAX, Parameter::LINEAR);
+	ADSRDecayPotParm.Init(phw->knob2, ADSR_DECAY_MIN, ADSR_DECAY_MAX, Parameter::LINEAR);
+	ADSRSustainPotParm.Init(phw->knob1, ADSR_SUSTAIN_MIN, ADSR_SUSTAIN_MAX, Parameter::LINEAR);
+	ADSRReleasePotParm.Init(phw->knob2, ADSR_RELEASE_MIN, ADSR_RELEASE_MAX, Parameter::LINEAR);
 }
 
 
-void OscVoice::ProcessParm2()
+template<uint8_t N>
+float OscVoice<N>::ReadParm(uint8_t n)
 {
-	SetADSRSustain(ADSRSustainPotParm.Process());
+	switch (n)
+	{
+	case 0:
+		return ADSRAttackPotParm.Process();
+		
+	case 1:
+		return ADSRDecayPotParm.Process();
+		
+	case 2:
+		return ADSRSustainPotParm.Process();
+		
+	case 3:
+		return ADSRReleasePotParm.Process();
+		
+	default:
+		return 0.0;
+	}
 }
 
 
-void OscVoice::ProcessParm3()
+template<uint8_t N>
+void OscVoice<N>::ApplyParm(uint8_t n, float value)
 {
-	SetADSRRelease(ADSRReleasePotParm.Process());
+	switch (n)
+	{
+	case 0:
+		SetADSRAttack(value);
+		break;
+		
+	case 1:
+		SetADSRDecay(value);
+		break;
+		
+	case 2:
+		SetADSRSustain(value);
+		break;
+		
+	case 3:
+		SetADSRRelease(value);
+		break;
+		
+	default:
+		break;
+	}
 }
 
-
-
+template class OscVoice<OSC_VOICE_MAX_POLYPHONY>;
@@ -0,0 +1,164 @@
+/*
+ This file is part of Virtual Robot's Pine Synthesizer. 
+
+Copyright <2022> <Brian Gunnison>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+software and associated documentation files (the "Software"), to deal in the Software 
+without restriction, including without limitation the rights to use, copy, modify, 
+merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+permit persons to whom the Software is furnished to do so, subject to the following 
+conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include <string.h>
+#include "daisy_pod.h"
+
+#include "utilities.h"
+#include "cyclecounter.h"
+#include "profiler.h"
+
+using namespace daisy;
+
+
+const char *Profiler::GetStageName(uint8_t stage)
+{
+#define VOICE_STAGE_NAME(type, engine, slots, member, name, r, g, b, shortName, ...) shortName,
+	const char *names[NUM_PROF_STAGES] = { "control", "events", "switch", VOICE_ENGINES(VOICE_STAGE_NAME) 
+										   "filter", "output", "callback" };
+#undef VOICE_STAGE_NAME
+	
+	if (stage >= NUM_PROF_STAGES)
+	{
+		return "?";
+	}
+	
+	return names[stage];
+}
+
+
+void Profiler::Init(float sampleRate, size_t blockSize)
+{
+	CycleCounterInit();
+	blockBudget = CyclesPerSecond() * blockSize / sampleRate;
+	
+	enabled = true;
+	touched = 0;
+	reportRequested = false;
+	reportReady = false;
+	
+	for (uint8_t i = 0; i < NUM_PROF_STAGES; i++)
+	{
+		blockCycles[i] = 0;
+	}
+	
+	Clear(stats);
+}
+
+
+void Profiler::Clear(Stats *s)
+{
+	for (uint8_t i = 0; i < NUM_PROF_STAGES; i++)
+	{
+		s[i].blocks = 0;
+		s[i].min = 0xFFFFFFFF;
+		s[i].max = 0;
+		s[i].sum = 0;
+		
+		for (uint8_t b = 0; b < PROF_HIST_BUCKETS; b++)
+		{
+			s[i].hist[b] = 0;
+		}
+	}
+}
+
+
+void Profiler::EndBlock()
+{
+	while (touched != 0)
+	{
+		uint8_t i = __builtin_ctz(touched);
+		touched &= touched - 1;
+		
+		uint32_t c = blockCycles[i];
+		blockCycles[i] = 0;
+		
+		Stats &s = stats[i];
+		s.blocks++;
+		s.sum += c;
+		if (c < s.min)
+		{
+			s.min = c;
+		}
+		if (c > s.max)
+		{
+			s.max = c;
+		}
+		
+		// bucket b holds 2^(b + PROF_HIST_SHIFT - 1) to 2^(b + PROF_HIST_SHIFT) cycles
+		int8_t b = (c == 0) ? 0 : 32 - __builtin_clz(c) - PROF_HIST_SHIFT;
+		if (b < 0)
+		{
+			b = 0;
+		}
+		if (b > PROF_HIST_BUCKETS - 1)
+		{
+			b = PROF_HIST_BUCKETS - 1;
+		}
+		s.hist[b]++;
+	}
+	
+	// the copy is made here so the main loop never reads stats the callback is writing
+	if (reportRequested && !reportReady)
+	{
+		memcpy(report, stats, sizeof(report));
+		Clear(stats);
+		reportRequested = false;
+		reportReady = true;
+	}
+}
+
+
+void Profiler::Report()
+{
+	if (!reportReady)
+	{
+		return;
+	}
+	
+	log("Profile: %u cycles per block, histogram buckets <256 then doubling", (uint32_t)blockBudget);
+	
+	for (uint8_t i = 0; i < NUM_PROF_STAGES; i++)
+	{
+		Stats &s = report[i];
+		if (s.blocks == 0)
+		{
+			continue;
+		}
+		
+		uint32_t avg = (uint32_t)(s.sum / s.blocks);
+		uint32_t maxPercent = (uint32_t)(s.max * 10000.0f / blockBudget); // % x 100
+		
+		log("%s: %u blocks min %u avg %u max %u (%u.%02u%%)", 
+			GetStageName(i), 
+			s.blocks, 
+			s.min, 
+			avg, 
+			s.max, 
+			maxPercent / 100, 
+			maxPercent % 100);
+		log("  <256-8K: %u %u %u %u %u %u", s.hist[0], s.hist[1], s.hist[2], s.hist[3], s.hist[4], s.hist[5]);
+		log("  16K->=256K: %u %u %u %u %u %u", s.hist[6], s.hist[7], s.hist[8], s.hist[9], s.hist[10], s.hist[11]);
+	}
+	
+	reportReady = false;
+}
@@ -0,0 +1,108 @@
+/*
+ This file is part of Virtual Robot's Pine Synthesizer. 
+
+Copyright <2022> <Brian Gunnison>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+software and associated documentation files (the "Software"), to deal in the Software 
+without restriction, including without limitation the rights to use, copy, modify, 
+merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+permit persons to whom the Software is furnished to do so, subject to the following 
+conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cyclecounter.h"
+#include "voice.h"
+
+#define PROF_HIST_BUCKETS	12	// power of two buckets, <256 cycles up to >= 256K cycles
+#define PROF_HIST_SHIFT		8	// log2 of the first bucket's upper bound
+
+// stages of the audio callback, the voice stage is split by engine
+typedef enum
+{
+	PROF_CONTROL,		// ControlMap::Apply
+	PROF_EVENTS,		// queued MIDI events applied
+	PROF_SWITCH,		// a voice engine rebuilt in the arena, see Voices::BeginBlock()
+	// the voice engines, one stage each in Voices::VOICE_TYPE order
+#define VOICE_PROF_STAGE(type, ...) PROF_##type,
+	VOICE_ENGINES(VOICE_PROF_STAGE)
+#undef VOICE_PROF_STAGE
+	PROF_FILTER,		// the current filter
+	PROF_OUTPUT,		// gain, interleave and clip check
+	PROF_CALLBACK,		// the whole callback
+	NUM_PROF_STAGES
+}PROF_STAGE;
+
+// the current voice's stage is PROF_VOICE + its selector
+#define PROF_VOICE (PROF_FILTER - NUM_VOICES)
+
+static_assert(NUM_PROF_STAGES <= 32, "Profiler::touched has a bit per stage");
+
+
+// Times each stage of the audio callback with the cycle counter (cyclecounter.h) and keeps
+// min, average, max and a histogram per stage. A stage may be timed in several pieces per block,
+// the pieces are summed and recorded once by EndBlock(). Costs a few tens of cycles per stage.
+class Profiler
+{
+public:
+	typedef struct
+	{
+		uint32_t blocks;	// blocks the stage ran in
+		uint32_t min;		// cycles
+		uint32_t max;
+		uint64_t sum;
+		uint32_t hist[PROF_HIST_BUCKETS];
+	}Stats;
+	
+	void Init(float sampleRate, size_t blockSize);
+	void SetEnabled(bool e) { enabled = e; }
+	
+	// audio callback, Start() returns the time that Add() measures from
+	uint32_t Start() { return enabled ? CycleCount() : 0; }
+	void Add(uint8_t stage, uint32_t start)
+	{
+		if (enabled)
+		{
+			blockCycles[stage] += CycleCount() - start;
+			touched |= 1 << stage;
+		}
+	}
+	
+	// audio callback, records this block's stages
+	void EndBlock();
+	
+	// main loop, asks the audio callback for a copy of the stats, which then start over
+	void RequestReport() { reportRequested = true; }
+	
+	// main loop, logs the copy once the audio callback has made it
+	void Report();
+	
+	static const char *GetStageName(uint8_t stage);
+	
+private:
+	bool enabled;
+	float blockBudget;	// cycles per block
+	
+	uint32_t blockCycles[NUM_PROF_STAGES];
+	uint32_t touched;	// bit per stage timed this block
+	Stats stats[NUM_PROF_STAGES];
+	
+	Stats report[NUM_PROF_STAGES];
+	volatile bool reportRequested;
+	volatile bool reportReady;
+	
+	void Clear(Stats *s);
+};
@@ -23,7 +23,9 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
 Monitors COM port for messages from USB serial port
+Decodes the binary log frames of logger.h back into text, plain text lines are printed as they are
 """
+import re
 import time
 
 
@@ -37,6 +39,16 @@ except:
 SERIAL_PORT_NAME = 'COM5' 
 SERIAL_PORT_SPEED = 115200   
 
+# frames from logger.h
+LOG_FRAME_FORMAT = 0x01    # 0x01 id len format[len]
+LOG_FRAME_RECORD = 0x02    # 0x02 id len payload[len]
+
+# a printf conversion, flags width precision length conversion
+C_SPEC = re.compile(r'%([-+ #0]*)(\d*)(?:\.(\d+))?(hh|h|ll|l|z|j|t)?([a-zA-Z%])')
+
+# format id -> format string, filled by format frames
+log_formats = {}
+
 
 def fatal_exit(msg):
     print(f'Error - {msg}')
@@ -95,27 +107,103 @@ def open_serial_port(port_name=SERIAL_PORT_NAME, port_speed=SERIAL_PORT_SPEED):
 
 
 
+def read_bytes(port, n):
+    """
+    reads exactly n bytes, None if the port went away
+    """
+    data = b''
+    while len(data) < n:
+        try:
+            c = port.read(n - len(data))
+        except:
+            return None
+        data += c
+    return data
+
+
+def decode_record(format_id, payload):
+    """
+    formats a record's arguments with its format string the way the device's printf would
+    """
+    fmt = log_formats.get(format_id)
+    if fmt is None:
+        return f'<record for unknown format {format_id}>'
+
+    offset = 0
+    out = ''
+    last = 0
+    for spec in C_SPEC.finditer(fmt):
+        out += fmt[last:spec.start()]
+        last = spec.end()
+        flags, width, precision, length, conv = spec.groups()
+        if conv == '%':
+            out += '%'
+            continue
+
+        if conv == 's':
+            if offset >= len(payload):
+                out += '?'
+                continue
+            n = payload[offset]
+            value = payload[offset + 1:offset + 1 + n].decode('utf-8', 'replace')
+            offset += 1 + n
+        else:
+            if offset + 4 > len(payload):
+                out += '?'
+                continue
+            value = int.from_bytes(payload[offset:offset + 4], 'little', signed=(conv in 'di'))
+            offset += 4
+            if conv == 'c':
+                value = chr(value & 0xFF)
+            elif conv not in 'xXo':
+                conv = 'd'
+
+        py_spec = '%' + flags + width + (('.' + precision) if precision else '') + conv
+        try:
+            out += py_spec % value
+        except (TypeError, ValueError):
+            out += str(value)
+
+    return out + fmt[last:]
+
+
 def get_response(port):
     """
-    reads a message and prints the results
+    reads a message, binary log frame or text line, and prints the results
     """
     if port is None or port.is_open == False:
         fatal_exit('Port is not opened?')
 
-    # we read a character at a time and end when we receive the '\n' (0x0A)
+    # text is read a character at a time and ends when we receive the '\n' (0x0A)
     response = ''
     while True:
-        # Read bytes till we get a '\n'
-        try:
-            c = port.read()
-            # if we get a non ascii character (unlikely) this will convert it
-            # to something we can deal with
-            c = c.decode('utf-8','ignore')  
-        except:
+        c = read_bytes(port, 1)
+        if c is None:
             return None
 
-        if c == '':
-            continue   
+        if c[0] == LOG_FRAME_FORMAT and response == '':
+            header = read_bytes(port, 2)
+            if header is None:
+                return None
+            fmt = read_bytes(port, header[1])
+            if fmt is None:
+                return None
+            log_formats[header[0]] = fmt.decode('utf-8', 'replace')
+            continue
+
+        if c[0] == LOG_FRAME_RECORD and response == '':
+            header = read_bytes(port, 2)
+            if header is None:
+                return None
+            payload = read_bytes(port, header[1])
+            if payload is None:
+                return None
+            response = decode_record(header[0], payload)
+            break
+
+        # if we get a non ascii character (unlikely) this will convert it
+        # to something we can deal with
+        c = c.decode('utf-8','ignore')  
             
         if c == '\n':   # indicates end of response
             break
@@ -128,6 +216,16 @@ def get_response(port):
     log(f'MSG>> {response}')
     return response
 
+
+def request_formats(port):
+    """
+    asks the device to send its log formats again, they went out before we connected
+    """
+    try:
+        port.write(b'logdefs\n')
+    except:
+        log('Could not request the log formats')
+
    
 def run_monitor():
 
@@ -138,12 +236,14 @@ def run_monitor():
     port = open_serial_port()
     if port is None:
        fatal_exit('Failed opening port')
+    request_formats(port)
 
     while True:
         msg = get_response(port)
         if msg is None:
             port.close()
             port = open_serial_port()  
+            request_formats(port)
         time.sleep(0.1)
     
 
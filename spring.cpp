@@ -31,6 +31,13 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "filter.h"
 #include "midimap.h"
 #include "controlmap.h"
+#include "governor.h"
+#include "calibrate.h"
+#include "fastmath.h"
+#include "blockrender.h"
+#include "logger.h"
+#include "profiler.h"
+#include "xrun.h"
 
 using namespace daisy;
 using namespace daisysp;
@@ -59,6 +66,74 @@ uint32_t outClipIndicator = 0;
 uint8_t currentCpuLoad = 0;
 #endif
 
+// 1 renders voice and filter a block at a time, 0 falls back to the per sample path
+#define BLOCK_RENDER 1
+#if BLOCK_RENDER
+float block[AUDIO_BLOCK_SIZE];
+#endif
+
+// 1 lets the CPU load of each block raise or lower the active voice's polyphony
+#define POLY_GOVERNOR 1
+#if POLY_GOVERNOR
+#if !BLOCK_RENDER
+#error "The polyphony governor retires slots at block boundaries, it needs BLOCK_RENDER"
+#endif
+PolyphonyGovernor governor;
+#endif
+
+// 1 measures every voice engine and filter before audio starts and logs the safe polyphony
+// of each voice and filter, the governor then never goes over it
+#define CALIBRATE_AT_BOOT 1
+#if CALIBRATE_AT_BOOT
+CostCalibrator calibrator;
+#endif
+
+// 1 checks the fastmath.h approximations against libm before audio starts and logs their error
+// and cycles per call next to libm's, FAST_MATH there switches the voices and filters to them
+#define FAST_MATH_CHECK_AT_BOOT 1
+
+// 1 stops rendering once every voice slot is idle and the filter has rung out, the callback
+// then zero fills the output until the next event arrives (see BlockRenderer::Silent)
+#define SILENCE_BYPASS 1
+#if SILENCE_BYPASS && !BLOCK_RENDER
+#error "The silence bypass skips the block renderer, it needs BLOCK_RENDER"
+#endif
+
+// notes and CCs go from the main loop to the audio callback through the renderer's queue so only
+// the audio callback touches voice and filter state, and each lands on the sample it arrived at
+BlockRenderer renderer;
+
+// 1 times each stage of the audio callback, type "prof" on the USB serial link for a report
+#define PROFILE_AUDIO 1
+Profiler profiler;
+
+void ReportProfile()
+{
+	profiler.RequestReport();
+}
+
+// counts callbacks that overrun the block deadline, type "xrun" on the USB serial link for a report
+// of them and of the event queue
+// 1 also lights the seed LED for XRUN_LED_MSEC after an overrun, as for clipping
+#define XRUN_LED 1
+#define XRUN_LED_MSEC 500
+XrunDetector xrun;
+
+void ReportXruns()
+{
+	xrun.Log();
+	renderer.LogCounters();
+}
+
+// type "stats" on the USB serial link for the voice switch, voice allocator and polyphony governor counters
+void ReportStats()
+{
+	voice.LogCounters();
+#if POLY_GOVERNOR
+	governor.LogCounters();
+#endif
+}
+
 void logMidiEvent(MidiEvent *m)
 {	
 	if (m->type == NoteOn)
@@ -94,6 +169,12 @@ void logMidiEvent(MidiEvent *m)
 
 
 
+// control task, runs from the main loop every CONTROL_PERIOD_MS and publishes a snapshot that
+// the audio callback applies, so pot scanning, the control state machine, LEDs and their log
+// messages stay out of the audio deadline
+// 1 msec matches the block rate the pod's knob smoothing and switch debouncing were set up for
+#define CONTROL_PERIOD_MS 1
+
 void UpdateControls()
 {
 	hw.ProcessAnalogControls();
@@ -105,17 +186,65 @@ void UpdateControls()
 
 void AudioCallback(AudioHandle::InterleavingInputBuffer  in, AudioHandle::InterleavingOutputBuffer out, size_t size)
 {
+	uint32_t xrunStart = xrun.Start();
 	float sig = 0;
+	uint32_t callbackStart = profiler.Start();
 	
-#if LOG_CPU_LOAD
+#if LOG_CPU_LOAD || POLY_GOVERNOR
 	loadMeter.OnBlockStart();
 #endif
 
-	UpdateControls();
+	uint32_t t = profiler.Start();
+	standAloneController.Apply();
+	profiler.Add(PROF_CONTROL, t);
 
+#if BLOCK_RENDER
+	size_t frames = size / 2;
+	
+#if SILENCE_BYPASS
+	bool silent = renderer.Silent();
+#else
+	bool silent = false;
+#endif
+	
+	if (silent)
+	{
+		for (size_t i = 0; i < size; i++)
+		{
+			out[i] = 0.0;
+		}
+		renderer.Skip(block, frames);
+	}
+	else
+	{
+		renderer.Render(block, frames);
+		
+		t = profiler.Start();
+		for (size_t i = 0; i < frames; i++)
+		{
+			sig = block[i];
+			
+			out[2 * i] = sig * finalGainLeft;
+			out[2 * i + 1] = sig * finalGainRight;
+			
+			if (out[2 * i] > 1.0 || out[2 * i + 1] > 1.0)
+			{
+				outClipIndicator++;
+			}
+		}
+		profiler.Add(PROF_OUTPUT, t);
+	}
+#else
+	// a voice switch mutes the block and holds the events back, see BlockRenderer::Render()
+	bool switching = voice.BeginBlock();
+	if (!switching)
+	{
+		renderer.ApplyEvents(); // events land on the block boundary
+	}
+	
 	for (size_t i = 0; i < size; i += 2)
 	{
-		sig = filt.Process(voice.Process());
+		sig = filt.Process(switching ? 0.0f : voice.Process());
 		
 		out[i] = sig * finalGainLeft;
 	    out[i + 1] = sig * finalGainRight;
@@ -125,64 +254,51 @@ void AudioCallback(AudioHandle::InterleavingInputBuffer  in, AudioHandle::Interl
 			outClipIndicator++;
 		}
 	}
+#endif
 	
-#if LOG_CPU_LOAD
+#if LOG_CPU_LOAD || POLY_GOVERNOR
 	loadMeter.OnBlockEnd();	
+#endif
+
+#if POLY_GOVERNOR
+	governor.Update(); // reads and resets the meter every block
+#elif LOG_CPU_LOAD
 	currentCpuLoad = (uint8_t)(loadMeter.GetAvgCpuLoad() * 100);
 #endif
 
+	profiler.Add(PROF_CALLBACK, callbackStart);
+	profiler.EndBlock();
+	
+	xrun.End(xrunStart);
 }
 
+// main loop side, maps the message and queues it for the audio callback
 void HandleMidiMessage(MidiEvent m)
 {
+	SynthEvent e;
+	
 	//logMidiEvent(&m);
 	//if (m.channel != MIDI_CHANNEL)
 	//{
 	//	return;
 	//}
 	
-	switch (m.type)
+	if (m.type == NoteOn)
 	{
-	case NoteOn:
-		{
-			NoteOnEvent p = m.AsNoteOn();
-			BlinkLEDs(50, LED_OFF, LED_OFF);
-			p = m.AsNoteOn();
-			//log("Note in: %s", GetMidiNoteName(p.note));	
-			p.note = noteMap.Process(p.note, true);
-			log("Note out: %s", GetMidiNoteName(p.note));	
-			if (p.note > 127)
-			{
-				break; // so we can use notes as control
-			}
-
-			voice.NoteOn(&p); 					
-		}
-		break;
-
-	case NoteOff:
-		{
-			NoteOffEvent p = m.AsNoteOff();
-			p.note = noteMap.Process(p.note, false);
-			if (p.note > 127)
-			{
-				break; // so we can use notes as control
-			}
-			
-			voice.NoteOff(&p);
-		}
-		break;
-
-	case ControlChange:
-		{
-			ControlChangeEvent p = m.AsControlChange();
-			ccmap.Change(p.control_number, p.value);
-			noteMap.Change(p.control_number, p.value);		
-		}
-		break;
-		
-	default: 
-		break;
+		BlinkLEDs(50, LED_OFF, LED_OFF);
+	}
+	
+	if (!MapMidiMessage(&m, &noteMap, &e))
+	{
+		return;
+	}
+	
+	// stamped before the log, which would otherwise delay it
+	renderer.Post(e);
+	
+	if (e.type == SYNTH_EVENT_NOTE_ON)
+	{
+		log("Note out: %s", GetMidiNoteName(e.data0));	
 	}
 }
 
@@ -203,10 +319,33 @@ int main(void)
 	
 	sampleRate = hw.AudioSampleRate();
 	voice.Init(&hw, sampleRate);
+	voice.LogSizes();
 	
 	filt.Init(&hw, sampleRate);
 	
 	loadMeter.Init(sampleRate, AUDIO_BLOCK_SIZE);
+#if POLY_GOVERNOR
+	governor.Init(&voice, &filt, &loadMeter);
+#endif
+
+#if CALIBRATE_AT_BOOT
+	calibrator.Init(&voice, sampleRate);
+	calibrator.Run();
+	calibrator.Log();
+#if POLY_GOVERNOR
+	for (uint8_t v = 0; v < NUM_VOICES; v++)
+	{
+		for (uint8_t f = 0; f < NUM_FILTERS; f++)
+		{
+			governor.SetCeiling(v, f, calibrator.GetSafePolyphony(v, f));
+		}
+	}
+#endif
+#endif
+
+#if FAST_MATH_CHECK_AT_BOOT
+	FastMathLog();
+#endif
 	
 	ccmap.Init();
 	pcmap.Init();
@@ -226,36 +365,74 @@ int main(void)
 		
 	log("Init end");
 
+	renderer.Init(&voice, &filt, &ccmap, sampleRate, AUDIO_BLOCK_SIZE);
+	
+	profiler.Init(sampleRate, AUDIO_BLOCK_SIZE);
+	profiler.SetEnabled(PROFILE_AUDIO);
+#if PROFILE_AUDIO
+	renderer.SetProfiler(&profiler);
+#endif
+	AddCommand("prof", ReportProfile);
+	
+	xrun.Init(&voice, &filt, sampleRate, AUDIO_BLOCK_SIZE);
+	AddCommand("xrun", ReportXruns);
+	AddCommand("stats", ReportStats);
+	
 	// Start stuff.
 	hw.StartAdc();
 	hw.StartAudio(AudioCallback);
 	hw.midi.StartReceive();
 
-#if LOG_CPU_LOAD
+#if LOG_CPU_LOAD && !POLY_GOVERNOR
 	uint8_t cpuLoad = 0;
 #endif
 	
+#if LOG_CPU_LOAD
 	uint32_t now = 0;
+#endif
+	uint32_t lastControl = 0;
+	uint32_t lastOverruns = 0;
+	uint32_t xrunLedUntil = 0;
 	for (;;)
 	{
+		if (System::GetNow() - lastControl >= CONTROL_PERIOD_MS)
+		{
+			lastControl = System::GetNow();
+			UpdateControls();
+		}
+
 #if LOG_CPU_LOAD		
 		uint32_t tp = System::GetNow() - now;
 		if (tp > 5000)
 		{
 			now = System::GetNow();
+			renderer.LogCounters();
+			ReportStats();
+#if !POLY_GOVERNOR
 			loadMeter.Reset();
 			cpuLoad = currentCpuLoad;
 			log("Ave CPU load Peak: %d", cpuLoad);
+#endif
 		}
 #endif
 
 		hw.midi.Listen();
-		// Handle MIDI Events
+		// Handle MIDI Events, each is stamped now rather than when its bytes came in (see BlockRenderer::Post)
 		while (hw.midi.HasEvents())
 		{
 			HandleMidiMessage(hw.midi.PopEvent());
 		}
 				
+		bool xrunLed = false;
+#if XRUN_LED
+		if (xrun.GetCounters().overruns != lastOverruns)
+		{
+			lastOverruns = xrun.GetCounters().overruns;
+			xrunLedUntil = System::GetNow() + XRUN_LED_MSEC;
+		}
+		xrunLed = (int32_t)(xrunLedUntil - System::GetNow()) > 0;
+#endif
+		
 		//voice.UpdateBackGround();
 		if (outClipIndicator > 0)
 		{
@@ -264,9 +441,13 @@ int main(void)
 		}
 		else
 		{
-			hw.seed.SetLed(false);
+			hw.seed.SetLed(xrunLed);
 		}
 		
 		ResetLEDs();
+		
+		PollCommands();
+		profiler.Report();
+		LogFlush();
 	}
 }
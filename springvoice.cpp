@@ -25,103 +25,94 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include "utilities.h"
 #include "voice.h"
+#include "fastmath.h"
 
 using namespace daisy;
 using namespace daisysp;
 
-void SpringVoice::Init(DaisyPod *phw, float SR) 
+// the pot mappings, see InitPots()
+template<uint8_t N> Parameter SpringVoice<N>::DampingPotParm;
+template<uint8_t N> Parameter SpringVoice<N>::StructurePotParm;
+template<uint8_t N> Parameter SpringVoice<N>::BrightnessPotParm;
+template<uint8_t N> Parameter SpringVoice<N>::AccentPotParm;
+
+template<uint8_t N>
+void SpringVoice<N>::Init(DaisyPod *phw, float SR) 
 {
 	NullVoice::Init(phw, SR);
-	polyphony = SPRING_VOICE_POLYPHONY;
+	InitPolyphony(SPRING_VOICE_POLYPHONY, N, slots);
+	allocator.SetReuseTails(true);
 	
-	for (uint8_t i = 0; i < polyphony; i++)
+	for (uint8_t i = 0; i < maxPolyphony; i++)
 	{
 		spring[i].Init(sampleRate);
 	}	
 	
-	DampingPotParm.Init(hw->knob1, 0, 1, Parameter::LINEAR);
-	StructurePotParm.Init(hw->knob2, 0, 1, Parameter::LINEAR); // sets range and plot 
-	BrightnessPotParm.Init(hw->knob1, 0, 1, Parameter::LINEAR); // sets range and plot 
-	AccentPotParm.Init(hw->knob2, 0, 1, Parameter::LINEAR); // sets range and plot 
-
 	Panic();
 }
 
-void SpringVoice::Panic() 
+template<uint8_t N>
+void SpringVoice<N>::Panic() 
 {
 	NullVoice::Panic();
 	
-	for (uint8_t i = 0; i < polyphony; i++)
+	for (uint8_t i = 0; i < maxPolyphony; i++)
 	{
 		spring[i].Reset();
 	}
 }
 
 
-void SpringVoice::StartNote(uint8_t i, NoteOnEvent *p)
+template<uint8_t N>
+void SpringVoice<N>::StartNote(uint8_t i, NoteOnEvent *p)
 {
 	//log("n: %d, m: %d", i, p->note);
+	WakeSlot(i);
 	notes[i].midiNote = p->note;
 	notes[i].amplitude = (float)p->velocity / 127.0f;
 			
-	spring[i].SetFreq(mtof(p->note));
+	spring[i].SetFreq(MathMtof(p->note));
 	spring[i].Trig();
 	
 }
 
-void SpringVoice::NoteOn(NoteOnEvent *p)
+template<uint8_t N>
+float SpringVoice<N>::Process(void) 
 {
-	for (uint8_t i = 0; i < polyphony; i++)
+	float sig = 0.0;
+	for (uint8_t i = 0; i < maxPolyphony; i++)
 	{
-		
-		if (notes[i].midiNote == p->note)
+		if (notes[i].parked == true)
 		{
-			// if we are playing the same note
-			StartNote(i, p);
-			return;
+			continue;
 		}
 		
-		// start new note if unused and (todo) adsr is done 
-		if (notes[i].midiNote == 0 )
-		{
-			StartNote(i, p);
-			return;	
-		}
+		sig += spring[i].Process() * notes[i].amplitude;
 	}
+	
+	return sig / mixDivisor;
 }
 
-
-void SpringVoice::NoteOff(NoteOffEvent *p)
+template<uint8_t N>
+void SpringVoice<N>::RenderSlot(uint8_t i, float *buf, size_t n)
 {
-	for (uint8_t i = 0; i < polyphony; i++)
+	float amplitude = notes[i].amplitude;
+	for (size_t s = 0; s < n; s++)
 	{
-		if (notes[i].midiNote == p->note)
-		{
-			notes[i].midiNote = 0;	
-		}
+		buf[s] = spring[i].Process() * amplitude;
 	}
 }
 
 
-float SpringVoice::Process(void) 
+template<uint8_t N>
+void SpringVoice<N>::SetFreq(float f)
 {
-	float sig = 0.0;
-	for (uint8_t i = 0; i < polyphony; i++)
-	{
-		sig += spring[i].Process() * notes[i].amplitude;
-	}
 	
-	return sig / polyphony;
 }
 
 
-void SpringVoice::SetFreq(float f)
-{
-	
-}
-
-
-void SpringVoice::SetDamping(float v)
+template<uint8_t N>
+void SpringVoice<N>::SetDamping(float v)
 {
 	if (v == damping)
 	{
@@ -129,14 +120,15 @@ void SpringVoice::SetDamping(float v)
 	}
 	
 	damping = v;
-	for (uint8_t i = 0; i < polyphony; i++)
+	for (uint8_t i = 0; i < maxPolyphony; i++)
 	{
 		spring[i].SetDamping(damping);
 	}
 }
 
 
-void SpringVoice::SetStructure(float v)
+template<uint8_t N>
+void SpringVoice<N>::SetStructure(float v)
 {
 	if (v == structure)
 	{
@@ -144,14 +136,15 @@ void SpringVoice::SetStructure(float v)
 	}
 	
 	structure = v;
-	for (uint8_t i = 0; i < polyphony; i++)
+	for (uint8_t i = 0; i < maxPolyphony; i++)
 	{
 		spring[i].SetStructure(structure);
 	}
 }
 
 
-void SpringVoice::SetBrightness(float v)
+template<uint8_t N>
+void SpringVoice<N>::SetBrightness(float v)
 {
 	if (v == brightness)
 	{
@@ -159,14 +152,15 @@ void SpringVoice::SetBrightness(float v)
 	}
 	
 	brightness = v;
-	for (uint8_t i = 0; i < polyphony; i++)
+	for (uint8_t i = 0; i < maxPolyphony; i++)
 	{
 		spring[i].SetBrightness(brightness);
 	}
 }
 
 
-void SpringVoice::SetAccent(float v)
+template<uint8_t N>
+void SpringVoice<N>::SetAccent(float v)
 {
 	if (v == accent)
 	{
@@ -174,52 +168,97 @@ void SpringVoice::SetAccent(float v)
 	}
 	
 	accent = v;
-	for (uint8_t i = 0; i < polyphony; i++)
+	for (uint8_t i = 0; i < maxPolyphony; i++)
 	{
 		spring[i].SetAccent(accent);
 	}
 }
 
 
-void SpringVoice::ProcessParm0()
+template<uint8_t N>
+void SpringVoice<N>::InitPots(DaisyPod *phw)
 {
-	SetDamping(DampingPotParm.Process());
+	// See controlmap
+	DampingPotParm.Init(phw->knob1, 0, 1, Parameter::LINEAR);
+	StructurePotParm.Init(phw->knob2, 0, 1, Parameter::LINEAR); // sets range and plot 
+	BrightnessPotParm.Init(phw->knob1, 0, 1, Parameter::LINEAR); // sets range and plot 
+	AccentPotParm.Init(phw->knob2, 0, 1, Parameter::LINEAR); // sets range and plot 
 }
 
 
-void SpringVoice::ProcessParm1()
+template<uint8_t N>
+float SpringVoice<N>::ReadParm(uint8_t n)
 {
-	SetStructure(StructurePotParm.Process());
+	switch (n)
+	{
+	case 0:
+		return DampingPotParm.Process();
+		
+	case 1:
+		return StructurePotParm.Process();
+		
+	case 2:
+		return BrightnessPotParm.Process();
+		
+	case 3:
+		return AccentPotParm.Process();
+		
+	default:
+		return 0.0;
+	}
 }
 
-void SpringVoice::ProcessParm2()
-{
-	SetBrightness(BrightnessPotParm.Process());
-}
 
-void SpringVoice::ProcessParm3()
+template<uint8_t N>
+void SpringVoice<N>::ApplyParm(uint8_t n, float value)
 {
-	SetAccent(AccentPotParm.Process());
+	switch (n)
+	{
+	case 0:
+		SetDamping(value);
+		break;
+		
+	case 1:
+		SetStructure(value);
+		break;
+		
+	case 2:
+		SetBrightness(value);
+		break;
+		
+	case 3:
+		SetAccent(value);
+		break;
+		
+	default:
+		break;
+	}
 }
 
+
 	
-void SpringVoice::SetCC0(uint8_t value)
+template<uint8_t N>
+void SpringVoice<N>::SetCC0(uint8_t value)
 {
 	SetDamping(value / 127.0);
 }
 
-void SpringVoice::SetCC1(uint8_t value)
+template<uint8_t N>
+void SpringVoice<N>::SetCC1(uint8_t value)
 {
 	SetStructure(value / 127.0);
 }
 
-void SpringVoice::SetCC2(uint8_t value)
+template<uint8_t N>
+void SpringVoice<N>::SetCC2(uint8_t value)
 {
 	SetBrightness(value / 127.0);
 }
 
-void SpringVoice::SetCC3(uint8_t value)
+template<uint8_t N>
+void SpringVoice<N>::SetCC3(uint8_t value)
 {
 	SetAccent(value / 127.0);
 }
 
+template class SpringVoice<SPRING_VOICE_MAX_POLYPHONY>;
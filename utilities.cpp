@@ -26,6 +26,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <stdio.h>
 #include <string.h>
 #include "utilities.h"
+#include "logger.h"
 
 using namespace daisy;
 using namespace daisysp;
@@ -33,20 +34,6 @@ using namespace daisysp;
 extern DaisyPod   hw;
 
 
-void log(const char* format, ...)
-{
-	char  buff[512];
-	va_list va;
-	
-	va_start(va, format);
-	vsnprintf(buff, 510, format, va);
-	va_end(va);
-	
-	strncat(buff, "\n", 512);
-	
-	hw.seed.usb_handle.TransmitInternal((uint8_t *)buff, strlen(buff));
-}
-
 const char *GetNoteName(uint8_t n)
 {	
 	const char *names[12] = { "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" };
@@ -72,38 +59,87 @@ char * GetMidiNoteName(uint8_t n)
 	return str;
 }
 
-// todo class up and implement midi map parser as well as commands such as get current settings etc. 
-// UsbHandle::ReceiveCallback
-void echo_rx_callback(uint8_t* buf, uint32_t* len)
+// commands typed into the USB serial link, run from the main loop by PollCommands()
+#define MAX_COMMANDS 8
+#define MAX_COMMAND_LENGTH 32
+
+typedef struct
 {
-	// do nothing
-	char inBuf[32];
+	const char *name;
+	CommandFunc func;
+}Command;
+
+static Command commands[MAX_COMMANDS];
+static uint8_t numCommands = 0;
+
+// one line waits here between the USB interrupt and the main loop
+static char pendingCommand[MAX_COMMAND_LENGTH];
+static volatile bool commandPending = false;
+
+void AddCommand(const char *name, CommandFunc func)
+{
+	if (numCommands == MAX_COMMANDS)
+	{
+		return;
+	}
 	
-	if (len == NULL || buf == NULL)
+	commands[numCommands].name = name;
+	commands[numCommands].func = func;
+	numCommands++;
+}
+
+void PollCommands()
+{
+	if (!commandPending)
 	{
 		return;
 	}
 	
-	uint32_t l = *len;
-	uint8_t i = 0;
-	for ( i < l; i++;)
+	for (uint8_t i = 0; i < numCommands; i++)
 	{
-		inBuf[i] = buf[i];
-		if (i == 32)
+		if (strcmp(pendingCommand, commands[i].name) == 0)
 		{
-			break;
+			commands[i].func();
+			commandPending = false;
+			return;
 		}
 	}
 	
-	inBuf[i - 1] = 0;
-		
-	log(inBuf);
+	log("%s", pendingCommand);
+	commandPending = false;
+}
+
+// todo class up and implement midi map parser as well as commands such as get current settings etc. 
+// UsbHandle::ReceiveCallback
+void echo_rx_callback(uint8_t* buf, uint32_t* len)
+{
+	if (len == NULL || buf == NULL || commandPending)
+	{
+		return;
+	}
 	
+	uint32_t l = *len;
+	if (l > MAX_COMMAND_LENGTH - 1)
+	{
+		l = MAX_COMMAND_LENGTH - 1;
+	}
+	
+	// drop the line ending
+	while (l > 0 && (buf[l - 1] == '\n' || buf[l - 1] == '\r'))
+	{
+		l--;
+	}
 	
+	memcpy(pendingCommand, buf, l);
+	pendingCommand[l] = 0;
+	commandPending = true;
 }
 
 void ComInit(DaisyPod *hw)
 {
+	LogInit(hw);
+	// serial_monitor.py asks for the log formats when it connects
+	AddCommand("logdefs", LogResendFormats);
 	hw->seed.usb_handle.Init(UsbHandle::FS_INTERNAL);
 	System::Delay(250);
 	hw->seed.usb_handle.SetReceiveCallback( echo_rx_callback, UsbHandle::FS_INTERNAL);
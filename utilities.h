@@ -27,7 +27,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 using namespace daisy;
 
 
-void log(const char* format, ...);
+void log(const char* format, ...); // deferred, sent by LogFlush(), see logger.h
 const char *GetNoteName(uint8_t n);
 char * GetMidiNoteName(uint8_t n);
 
@@ -52,5 +52,10 @@ void ResetLEDs();
 float GetCCMinMax(uint8_t CCValue, float min, float max);
 void ComInit(DaisyPod *hw);
 
+// a line received on the USB serial link runs the command of that name, others are echoed to the log
+typedef void(*CommandFunc)(void);
+void AddCommand(const char *name, CommandFunc func);
+void PollCommands(); // main loop
+
 
 
@@ -20,10 +20,14 @@ HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTIO
 OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
 SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
+#include <new>
+#include <type_traits>
+
 #include "daisy_pod.h"
 #include "daisysp.h"
 
 #include "utilities.h"
+#include "cyclecounter.h"
 #include "voice.h"
 
 using namespace daisy;
@@ -33,19 +37,160 @@ void NullVoice::Init(DaisyPod *phw, float SR)
 {
 	sampleRate = SR;
 	polyphony = 0;
+	maxPolyphony = 0;
+	notes = NULL;
+	mixDivisor = 1.0;
+	idleSamples = SLOT_IDLE_MS * SR / 1000;
 	hw = phw;
+	allocator.Init(NULL, 0);
 	Panic();
 }
 
+void NullVoice::InitPolyphony(uint8_t p, uint8_t pmax, Note *slots)
+{
+	if (p > pmax)
+	{
+		p = pmax;
+	}
+	
+	notes = slots;
+	maxPolyphony = pmax;
+	polyphony = p;
+	mixDivisor = p;
+	
+	for (uint8_t i = 0; i < maxPolyphony; i++)
+	{
+		notes[i].parked = i >= p;
+		notes[i].retiring = false;
+		notes[i].peak = 0.0;
+		notes[i].idle = true;
+		notes[i].ended = true;
+		notes[i].quiet = idleSamples;
+	}
+	
+	allocator.Init(notes, maxPolyphony);
+}
+
+uint8_t NullVoice::GetActiveNotes()
+{
+	uint8_t n = 0;
+	
+	for (uint8_t i = 0; i < maxPolyphony; i++)
+	{
+		if (!notes[i].parked && notes[i].midiNote > 0)
+		{
+			n++;
+		}
+	}
+	
+	return n;
+}
+
+bool NullVoice::IsIdle()
+{
+	for (uint8_t i = 0; i < maxPolyphony; i++)
+	{
+		if (!notes[i].parked && !notes[i].idle)
+		{
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+void NullVoice::SetPolyphony(uint8_t p)
+{
+	if (p < 1)
+	{
+		p = 1;
+	}
+	
+	if (p > maxPolyphony)
+	{
+		p = maxPolyphony;
+	}
+	
+	while (polyphony > p)
+	{
+		// retire the quietest slot still in service
+		int8_t q = -1;
+		for (uint8_t i = 0; i < maxPolyphony; i++)
+		{
+			if (notes[i].parked == true || notes[i].retiring == true)
+			{
+				continue;
+			}
+			
+			if (q < 0 || notes[i].peak < notes[q].peak)
+			{
+				q = i;
+			}
+		}
+		
+		if (q < 0)
+		{
+			break;
+		}
+		
+		notes[q].retiring = true;
+		allocator.Release(q); // releases adsr voices, and NoteOff no longer finds it
+		polyphony--;
+	}
+	
+	while (polyphony < p)
+	{
+		// a retiring slot is still sounding, take it back before a parked one
+		int8_t r = -1;
+		for (uint8_t i = 0; i < maxPolyphony; i++)
+		{
+			if (notes[i].retiring == true)
+			{
+				r = i;
+				break;
+			}
+			
+			if (r < 0 && notes[i].parked == true)
+			{
+				r = i;
+			}
+		}
+		
+		if (r < 0)
+		{
+			break;
+		}
+		
+		notes[r].retiring = false;
+		notes[r].parked = false;
+		polyphony++;
+	}
+}
+
 void NullVoice::Panic()
 {
 	//log("Null voice Panic");
 	
-	for (uint8_t i = 0; i < MAX_POLYPHONY; i++)
+	for (uint8_t i = 0; i < maxPolyphony; i++)
 	{
 		notes[i].amplitude = 0.0;
 		notes[i].midiNote = 0;
 	}
+	
+	allocator.Reset();
+}
+
+void NullVoice::RenderSlot(uint8_t i, float *buf, size_t n)
+{
+	for (size_t s = 0; s < n; s++)
+	{
+		buf[s] = 0.0;
+	}
+}
+
+void NullVoice::ParkSlot(uint8_t i)
+{
+	notes[i].amplitude = 0.0;
 }
 
 
@@ -54,62 +199,237 @@ void Voices::Init(DaisyPod *pod, float SR)
 	phw = pod; 
 	sampleRate = SR; 
 	currentVoiceSelector = 0; 
-	oscVoice.Init(phw, sampleRate);
-	springVoice.Init(phw, sampleRate);
-	malletVoice.Init(phw, sampleRate);
-	formantVoice.Init(phw, sampleRate);
-	noiseVoice.Init(phw, sampleRate);
+	pendingVoiceSelector = 0;
+	building = false;
 	
-	pvoice = &oscVoice;
+	switchCounters.switches = 0;
+	switchCounters.lastCycles = 0;
+	switchCounters.maxCycles = 0;
+	
+	stealPolicy = VOICE_STEAL_POLICY;
+	
+	for (uint8_t v = 0; v < NUM_VOICES; v++)
+	{
+		settings[v].set = 0;
+		settings[v].fromCC = 0;
+	}
+	
+#define VOICE_POTS(type, engine, slots, ...) engine<slots>::InitPots(phw);
+	VOICE_ENGINES(VOICE_POTS)
+#undef VOICE_POTS
+	
+	Construct(currentVoiceSelector);
+}
+
+void Voices::Construct(uint8_t sel)
+{
+	Build(sel);
+	Setup(sel);
+}
+
+void Voices::Build(uint8_t sel)
+{
+	switch (sel)
+	{
+#define VOICE_BUILD(type, engine, slots, member, ...) case type: new (&arena.member) engine<slots>(); pvoice = &arena.member; break;
+	VOICE_ENGINES(VOICE_BUILD)
+#undef VOICE_BUILD
+		
+	default:
+		break;
+	}
+}
+
+void Voices::Setup(uint8_t sel)
+{
+	Dispatch(sel, [&](auto &v) { v.Init(phw, sampleRate); });
+	pvoice->SetStealPolicy(stealPolicy);
+	Restore();
+}
+
+void Voices::KeepCC(uint8_t n, uint8_t value)
+{
+	VoiceSettings &k = settings[currentVoiceSelector];
+	
+	k.cc[n] = value;
+	k.set |= 1 << n;
+	k.fromCC |= 1 << n;
+}
+
+void Voices::KeepParm(uint8_t n, float value)
+{
+	if (n >= 4)
+	{
+		return;
+	}
+	
+	VoiceSettings &k = settings[currentVoiceSelector];
+	
+	k.parm[n] = value;
+	k.set |= 1 << n;
+	k.fromCC &= ~(1 << n);
+}
+
+// through the same calls the CCs and pots make, which keep the values again unchanged
+void Voices::Restore(void)
+{
+	const VoiceSettings &k = settings[currentVoiceSelector];
+	
+	for (uint8_t n = 0; n < 6; n++)
+	{
+		if (!(k.set & (1 << n)))
+		{
+			continue;
+		}
+		
+		if (k.fromCC & (1 << n))
+		{
+			CCProcess(n, k.cc[n]);
+		}
+		else
+		{
+			ApplyParm(n, k.parm[n]);
+		}
+	}
+}
+
+// kept for the voices built later
+void Voices::SetStealPolicy(uint8_t p)
+{
+	if (p >= VoiceAllocator::NUM_STEAL_POLICIES)
+	{
+		return;
+	}
+	
+	stealPolicy = p;
+	pvoice->SetStealPolicy(p);
+	log("Steal %s", VoiceAllocator::GetPolicyName(p));
 }
 
 void Voices::Panic(void)
 {
-	pvoice->Panic();
+	Dispatch(currentVoiceSelector, [](auto &v) { v.Panic(); });
 }
 
+// CC or Select, the engine is swapped by BeginBlock() so it never changes under a block being rendered
 void Voices::ChangeVoice(uint8_t sel)
 {
+	if (sel >= NUM_VOICES)
+	{
+		log("Unused voice");
+		return;
+	}
+	
+	pendingVoiceSelector = sel;
+}	
+
+bool Voices::BeginBlock(void)
+{
+	uint8_t sel = pendingVoiceSelector;
 	
-	if (sel != currentVoiceSelector)
+	if (!building && sel == currentVoiceSelector)
 	{
-		Panic();
+		return false;
 	}
 	
-	currentVoiceSelector = sel;
+	uint32_t start = CycleCount();
 	
-	switch (sel)
+	if (building)
 	{
-	case SYNTH_VOICE:
-		log("Synth voice");
-		pvoice = &oscVoice;
-		break;
-		
-	case SPRING_VOICE:
-		log("Spring voice");
-		pvoice = &springVoice;
-		break;
-		
-	case MALLET_VOICE:
-		log("Mallet voice");
-		pvoice = &malletVoice;
-		break;
-		
-	case FORMANT_VOICE:
-		log("Formant voice");
-		pvoice = &formantVoice;
-		break;
+		// second block, the engine built last block is set up, Restore() reaches it again
+		building = false;
+		Setup(currentVoiceSelector);
+	}
+	else
+	{
+		// first block, the old engine's notes go with it
+		Dispatch(currentVoiceSelector, [](auto &v) { typedef std::decay_t<decltype(v)> T; v.~T(); });
 		
-	case NOISE_VOICE:
-		log("Noise voice");
-		pvoice = &noiseVoice;
-		break;
+		currentVoiceSelector = sel;
+		Build(sel);
+		building = true;
+		switchCounters.switches++;
+	}
+	
+	uint32_t cycles = CycleCount() - start;
+	
+	switchCounters.lastCycles = cycles;
+	if (cycles > switchCounters.maxCycles)
+	{
+		switchCounters.maxCycles = cycles;
+	}
+	
+	if (building)
+	{
+		return true;
+	}
+	
+	switch (currentVoiceSelector)
+	{
+#define VOICE_CHANGE(type, engine, slots, member, name, ...) case type: log(name " voice"); break;
+	VOICE_ENGINES(VOICE_CHANGE)
+#undef VOICE_CHANGE
 		
 	default:
-		log("Unused voice");
 		break;
 	}
-}	
+	
+	return true;
+}
+
+float Voices::Measure(uint8_t sel, int16_t cc4, uint32_t samples)
+{
+	uint8_t current = currentVoiceSelector;
+	float out[MAX_BLOCK_SIZE];
+	
+	Dispatch(currentVoiceSelector, [](auto &v) { typedef std::decay_t<decltype(v)> T; v.~T(); });
+	currentVoiceSelector = sel;
+	Construct(sel);
+	
+	// straight to the engine, so the setting is not kept for Restore()
+	if (cc4 >= 0)
+	{
+		Dispatch(sel, [&](auto &v) { v.SetCC4(cc4); });
+	}
+	
+	uint8_t slots = pvoice->GetMaxPolyphony();
+	pvoice->SetPolyphony(slots);
+	
+	for (uint8_t i = 0; i < slots; i++)
+	{
+		NoteOnEvent p;
+		p.channel = 0;
+		p.note = 57 + 2 * i;
+		p.velocity = 100;
+		NoteOn(&p);
+	}
+	
+	uint32_t rendered = 0;
+	uint32_t start = CycleCount();
+	while (rendered < samples)
+	{
+		ProcessBlock(out, MAX_BLOCK_SIZE);
+		rendered += MAX_BLOCK_SIZE;
+	}
+	uint32_t cycles = CycleCount() - start;
+	
+	Dispatch(sel, [](auto &v) { typedef std::decay_t<decltype(v)> T; v.~T(); });
+	currentVoiceSelector = current;
+	Construct(current);
+	
+	return (float)cycles / rendered / slots;
+}
+
+void Voices::LogCounters(void)
+{
+	log("Voice switches: %u last: %u max: %u cycles", 
+		switchCounters.switches, 
+		switchCounters.lastCycles, 
+		switchCounters.maxCycles);
+	
+	const VoiceAllocator::Counters &a = pvoice->GetAllocatorCounters();
+	log("Notes: %u steals: %u drops: %u", a.notes, a.steals, a.drops);
+}
 
 // button or knob selector
 void Voices::Select(int8_t sel)
@@ -119,7 +439,8 @@ void Voices::Select(int8_t sel)
 		return;
 	}
 	
-	int8_t s = currentVoiceSelector;
+	// from the pending voice, so steps taken before the next block add up
+	int8_t s = pendingVoiceSelector;
 	
 	s += sel;
 	if (s < 0)
@@ -132,39 +453,16 @@ void Voices::Select(int8_t sel)
 		s = 0;
 	}
 	
-	if (s != currentVoiceSelector)
-	{
-		Panic();
-	}
-	
-	currentVoiceSelector = s;
-	
-	ChangeVoice(currentVoiceSelector);
+	ChangeVoice(s);
 }
 
 void Voices::UpdateBackGround(void)
 {
 	switch (currentVoiceSelector)
 	{
-	case SYNTH_VOICE:
-		phw->led1.Set(0.0, 1.0, 0.0);
-		break;
-			
-	case SPRING_VOICE:
-		phw->led1.Set(0.0, 0.0, 1.0);
-		break;
-			
-	case MALLET_VOICE:
-		phw->led1.Set(1.0, 0.0, 0.0);
-		break;
-		
-	case FORMANT_VOICE:
-		phw->led1.Set(1.0, 1.0, 0.0);
-		break;
-		
-	case NOISE_VOICE:
-		phw->led1.Set(0.0, 1.0, 1.0);
-		break;
+#define VOICE_LED(type, engine, slots, member, name, r, g, b, ...) case type: phw->led1.Set(r, g, b); break;
+	VOICE_ENGINES(VOICE_LED)
+#undef VOICE_LED
 	
 	default:
 		phw->led1.Set(0.0, 0.0, 0.0);
@@ -174,120 +472,163 @@ void Voices::UpdateBackGround(void)
 	phw->UpdateLeds();
 }
 
+void Voices::LogSizes(void)
+{
+	uint32_t total = 0;
+	uint32_t totalMax = 0;
+	
+#define VOICE_SIZE(type, engine, slots, member, name, ...) \
+	log("%s: %u slots %u bytes, %u bytes at %u slots", name, slots, (uint32_t)sizeof(engine<slots>), (uint32_t)sizeof(engine<MAX_POLYPHONY>), MAX_POLYPHONY); \
+	total += sizeof(engine<slots>); \
+	totalMax += sizeof(engine<MAX_POLYPHONY>);
+	VOICE_ENGINES(VOICE_SIZE)
+#undef VOICE_SIZE
+	
+	log("Voices: %u bytes, %u saved", total, totalMax - total);
+	log("Voice arena: %u bytes, %u saved by sharing", (uint32_t)sizeof(VoiceArena), total - (uint32_t)sizeof(VoiceArena));
+}
+
 float Voices::Process(void)
 {	
-	return pvoice->Process();
+	float sig = 0.0;
+	Dispatch(currentVoiceSelector, [&](auto &v) { sig = v.Process(); });
+	return sig;
+}
+
+void Voices::ProcessBlock(float *out, size_t n)
+{	
+	Dispatch(currentVoiceSelector, [&](auto &v) { v.ProcessBlock(out, n); });
+}
+
+void Voices::SkipBlock(size_t n)
+{
+	Dispatch(currentVoiceSelector, [&](auto &v) { v.SkipBlock(n); });
 }
 
 
 void Voices::NoteOn(NoteOnEvent *p)
 {
-	pvoice->NoteOn(p);
+	Dispatch(currentVoiceSelector, [&](auto &v) { v.NoteOn(p); });
 }
 
 void Voices::NoteOff(NoteOffEvent *p)
 {
-	pvoice->NoteOff(p);
+	Dispatch(currentVoiceSelector, [&](auto &v) { v.NoteOff(p); });
 }
 
 void Voices::SetFreq(float f)
 {
-	pvoice->SetFreq(f);
+	Dispatch(currentVoiceSelector, [&](auto &v) { v.SetFreq(f); });
 }
 	
 void Voices::SetCC0(uint8_t value)
 {	
-	pvoice->SetCC0(value);
+	KeepCC(0, value);
+	if (!building)
+	{
+		Dispatch(currentVoiceSelector, [&](auto &v) { v.SetCC0(value); });
+	}
 }
 
 
 void Voices::SetCC1(uint8_t value)
 {	
-	pvoice->SetCC1(value);
+	KeepCC(1, value);
+	if (!building)
+	{
+		Dispatch(currentVoiceSelector, [&](auto &v) { v.SetCC1(value); });
+	}
 }
 
 
 void Voices::SetCC2(uint8_t value)
 {	
-	pvoice->SetCC2(value);	
+	KeepCC(2, value);
+	if (!building)
+	{
+		Dispatch(currentVoiceSelector, [&](auto &v) { v.SetCC2(value); });
+	}
 }
 
 
 void Voices::SetCC3(uint8_t value)
 {	
-	pvoice->SetCC3(value);
+	KeepCC(3, value);
+	if (!building)
+	{
+		Dispatch(currentVoiceSelector, [&](auto &v) { v.SetCC3(value); });
+	}
 }
 
 
-// CCMIDIMap map parms or selector
+// CCMIDIMap map parms or selector, 6 the steal policy, 10 + VOICE_TYPE selects a voice
 void Voices::CCProcess(uint8_t ccFuncNumber, uint8_t value)
 {
 	switch (ccFuncNumber)
 	{
 	case 0:
-		pvoice->SetCC0(value);
+		SetCC0(value);
 		break;
 		
 	case 1:
-		pvoice->SetCC1(value);
+		SetCC1(value);
 		break;
 		
 	case 2:
-		pvoice->SetCC2(value);
+		SetCC2(value);
 		break;
 	case 3:
-		pvoice->SetCC3(value);
+		SetCC3(value);
 		break;
 	case 4:
-		pvoice->SetCC4(value);
+		KeepCC(4, value);
+		if (!building)
+		{
+			Dispatch(currentVoiceSelector, [&](auto &v) { v.SetCC4(value); });
+		}
 		break;
 	case 5:
-		pvoice->SetCC5(value);
-		break;
-		
-	case 10:
-		ChangeVoice(SYNTH_VOICE);
+		KeepCC(5, value);
+		if (!building)
+		{
+			Dispatch(currentVoiceSelector, [&](auto &v) { v.SetCC5(value); });
+		}
 		break;
-		
-	case 11:
-		ChangeVoice(SPRING_VOICE);
-		break;
-		
-	case 12:
-		ChangeVoice(MALLET_VOICE);
+	case 6:
+		SetStealPolicy(value * VoiceAllocator::NUM_STEAL_POLICIES / 128);
 		break;
 		
-	case 13:
-		ChangeVoice(FORMANT_VOICE);
-		break;
-
-	case 14:
-		ChangeVoice(NOISE_VOICE);
-		break;
-
 	default:
+		if (ccFuncNumber >= 10 && ccFuncNumber < 10 + NUM_VOICES)
+		{
+			ChangeVoice(ccFuncNumber - 10);
+		}
 		break;
 		
 	}
 }
 
-void Voices::ProcessParm0()
-{
-	pvoice->ProcessParm0();
-}
-
-void Voices::ProcessParm1()
-{
-	pvoice->ProcessParm1();
-}
-
-void Voices::ProcessParm2()
+// the pots are static, so this reads them without the voice being in the arena
+float Voices::ReadParm(uint8_t voice, uint8_t n)
 {
-	pvoice->ProcessParm2();
+	switch (voice)
+	{
+#define VOICE_PARM(type, engine, slots, ...) case type: return engine<slots>::ReadParm(n);
+	VOICE_ENGINES(VOICE_PARM)
+#undef VOICE_PARM
+		
+	default:
+		break;
+	}
+	
+	return 0.0;
 }
 
-void Voices::ProcessParm3()
+void Voices::ApplyParm(uint8_t n, float value)
 {
-	pvoice->ProcessParm3();
+	KeepParm(n, value);
+	if (!building)
+	{
+		Dispatch(currentVoiceSelector, [&](auto &v) { v.ApplyParm(n, value); });
+	}
 }
-
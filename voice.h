@@ -26,19 +26,50 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "daisysp.h"
 
 #include "midimap.h"
+#include "voiceallocator.h"
+#include "oscbank.h"
+#include "envbank.h"
+#include "noisebank.h"
 
 
 using namespace daisy;
 using namespace daisysp;
-// springvoice is 92% CPU usage constant with moog filter, overload (no midi) if set to 5. 
+// boot polyphony, also sets the mix level. The governor (governor.h) moves it at runtime.
+// the safe polyphony of each voice and filter is measured at boot, see the calibration log (calibrate.h)
 #define SPRING_VOICE_POLYPHONY	4
-#define MALLET_VOICE_POLYPHONY	2 // 98% with moog filter
-#define OSC_VOICE_POLYPHONY		8 // 18% cpu usage with moog filter
+#define MALLET_VOICE_POLYPHONY	2
+#define OSC_VOICE_POLYPHONY		8
 #define HIHAT_VOICE_POLYPHONY   2
 #define FORMANT_VOICE_POLYPHONY 8
 #define NOISE_VOICE_POLYPHONY	8
-// we have to instantiate max
-#define MAX_POLYPHONY			OSC_VOICE_POLYPHONY
+
+// ceiling the governor may raise each voice to, each engine is a template with this many slots
+#define SPRING_VOICE_MAX_POLYPHONY	6
+#define MALLET_VOICE_MAX_POLYPHONY	4
+#define OSC_VOICE_MAX_POLYPHONY		8
+#define HIHAT_VOICE_MAX_POLYPHONY   2
+#define FORMANT_VOICE_MAX_POLYPHONY 8
+#define NOISE_VOICE_MAX_POLYPHONY	8
+// the largest of them
+#define MAX_POLYPHONY			OSC_VOICE_MAX_POLYPHONY
+
+// what a note on does when every slot holds a note, see VoiceAllocator
+#define VOICE_STEAL_POLICY		VoiceAllocator::STEAL_OLDEST
+
+// the noise voice's filters, NOISE_FILTER_SVF NoiseFilter's Svfs (NoiseFilterBank) or
+// NOISE_FILTER_BIQUAD the cheaper biquads (NoiseBiquadBank). Voice CC function 4 switches them
+#define NOISE_FILTER_SVF		0
+#define NOISE_FILTER_BIQUAD		1
+#define NOISE_FILTER_MODEL		NOISE_FILTER_SVF
+
+// ProcessBlock renders in chunks of at most this many samples (the audio block size)
+#define MAX_BLOCK_SIZE			48
+
+// a slot quieter than this peak for SLOT_IDLE_MS is idle until its next note, it is no longer rendered
+// or mixed and its engine only moves its state on (AdvanceSlot). The time covers a low string's first
+// trip round its delay line, which is silent
+#define SLOT_IDLE_PEAK			1.0e-4f	// -80 dB
+#define SLOT_IDLE_MS			100
 
 
 // ADSR settings
@@ -55,78 +86,285 @@ using namespace daisysp;
 #define ADSR_RELEASE_DEFAULT	0.2f
 #define ADSR_RELEASE_MAX		1.0f
 
-
-
-typedef struct
-{	
-	uint8_t midiNote; // > 0 if playing
-	float amplitude; // start gain
-	
-}Note;
-
+// The common part of the voice engines: slots, polyphony and the block mixing loop.
+// Nothing is virtual. Voices calls the current engine as its own class (see VOICE_ENGINES),
+// an engine's methods hide these defaults, and the mixing loop is a template over the engine
+// so its RenderSlot() inlines into the loop.
 class NullVoice
 {
 public:
-	virtual void Init(DaisyPod *phw, float SR);
-	virtual float Process();
+	void Init(DaisyPod *phw, float SR);
+	float Process() { return 0.0; }
+	// renders n samples, each slot runs its engine over the whole block (see RenderSlot)
+	// matches n calls of Process() bit for bit unless the compiler fuses the per sample multiply-add
+	void ProcessBlock(float *out, size_t n) { MixBlock(this, out, n); }
+	// the renderer's silence bypass, every slot is idle so n samples only move their state on
+	void SkipBlock(size_t n) { AdvanceBlock(this, n); }
+	
+	void NoteOn(NoteOnEvent *p) {}
+	void NoteOff(NoteOffEvent *p) { allocator.NoteOff(p->note); }
+	void SetFreq(float freq) {}
+
+	void SetCC0(uint8_t value) {}
+	void SetCC1(uint8_t value) {}
+	void SetCC2(uint8_t value) {}
+	void SetCC3(uint8_t value) {}
+	void SetCC4(uint8_t value){}
+	void SetCC5(uint8_t value){}
+	
+	// control task side, the engine's pot mappings (static, see Voices)
+	static void InitPots(DaisyPod *phw) {}
+	// control task side, pot parameter n read and mapped to its range
+	static float ReadParm(uint8_t n) { return 0.0; }
+	// audio side, sets parameter n to a value from ReadParm()
+	void ApplyParm(uint8_t n, float value) {}
+	
+	void Panic();
+	
+	// slots in service, the governor moves this between 1 and GetMaxPolyphony()
+	uint8_t GetPolyphony() { return polyphony; }
+	uint8_t GetMaxPolyphony() { return maxPolyphony; }
+	// slots in service holding a note
+	uint8_t GetActiveNotes();
+	// every slot in service idle, see SlotIdle(), and nothing left to render
+	bool IsIdle();
+	// lowering retires the quietest slots with a one block fade, raising returns parked slots
+	void SetPolyphony(uint8_t p);
+	
+	// how a note on takes a slot when none is free, see VoiceAllocator
+	void SetStealPolicy(uint8_t p) { allocator.SetPolicy(p); }
+	uint8_t GetStealPolicy() { return allocator.GetPolicy(); }
+	const VoiceAllocator::Counters &GetAllocatorCounters() { return allocator.GetCounters(); }
+	
+	// mixing loop side, before the slots of each chunk, for engines that render every slot at once
+	void RenderBank(size_t n) {}
+	// n samples of a bank whose slots are all idle, its phases or noise seeds move on as in AdvanceSlot()
+	void SkipBank(size_t n) {}
+	// mixing loop side, one slot's output for n samples, already scaled by the note amplitude
+	void RenderSlot(uint8_t i, float *buf, size_t n);
+	// mixing loop side, n samples of an idle slot. An engine whose next note has to start from the
+	// state it would have had had the slot been rendered (a phase, a noise seed) moves it on here,
+	// buf is scratch. Nothing by default, a physical model's string or resonator stays frozen below
+	// SLOT_IDLE_PEAK until the next note strikes it again
+	void AdvanceSlot(uint8_t i, float *buf, size_t n) {}
+	// silences a slot as it is taken out of service
+	void ParkSlot(uint8_t i);
+	// after each block, true once slot i has nothing left to render. This default is the energy tail,
+	// quiet for SLOT_IDLE_MS, which suits the physical models. Enveloped engines ask their ADSR
+	bool SlotIdle(uint8_t i) { return notes[i].quiet >= idleSamples; }
+	// after SlotIdle(), true once slot i's note has ended and the allocator may start another in it.
+	// The same by default, the noise voice's note ends with its ADSR while its filters still ring
+	bool SlotEnded(uint8_t i) { return notes[i].idle; }
 	
-	virtual void NoteOn(NoteOnEvent *p);
-	virtual void NoteOff(NoteOffEvent *p);
-	virtual void SetFreq(float freq);
-
-	virtual void SetCC0(uint8_t value);
-	virtual void SetCC1(uint8_t value);
-	virtual void SetCC2(uint8_t value);
-	virtual void SetCC3(uint8_t value);
-	virtual void SetCC4(uint8_t value){}
-	virtual void SetCC5(uint8_t value){}
+protected:
+	// slots is the engine's own array of pmax notes
+	void InitPolyphony(uint8_t p, uint8_t pmax, Note *slots);
 	
-	virtual void ProcessParm0();
-	virtual void ProcessParm1();
-	virtual void ProcessParm2();
-	virtual void ProcessParm3();
-	virtual void ProcessParm4(){}
-	virtual void ProcessParm5(){}
+	// a note starts, or something else makes an idle slot sound again
+	void WakeSlot(uint8_t i) { notes[i].idle = false; notes[i].ended = false; notes[i].quiet = 0; }
 	
-	virtual void Panic();
+	// mixes every slot of engine v (this, as its own class) over the block
+	template<typename V>
+	void MixBlock(V *v, float *out, size_t n);
 	
-protected:
+	// moves every idle slot of engine v on over n samples without rendering anything
+	template<typename V>
+	void AdvanceBlock(V *v, size_t n);
+	
+	// the allocator picks the slot, engine v starts the note in it with its StartNote()
+	template<typename V>
+	void AllocateNote(V *v, NoteOnEvent *p);
+	
+	VoiceAllocator allocator;
 	
 	float sampleRate;
-	uint8_t polyphony;
-	Note notes[MAX_POLYPHONY];
+	uint8_t polyphony; // slots in service
+	uint8_t maxPolyphony; // slots initialised
+	float mixDivisor; // boot polyphony so the level does not jump when the governor acts
+	uint32_t idleSamples; // SLOT_IDLE_MS
+	Note *notes; // maxPolyphony of them, in the engine
 	DaisyPod *hw;
 };
 
 
+template<typename V>
+void NullVoice::AllocateNote(V *v, NoteOnEvent *p)
+{
+	int8_t i = allocator.NoteOn(p->note);
+	
+	if (i >= 0)
+	{
+		v->StartNote(i, p);
+	}
+}
+
+
+template<typename V>
+void NullVoice::MixBlock(V *v, float *out, size_t n)
+{
+	float buf[MAX_BLOCK_SIZE];
+	
+	while (n > 0)
+	{
+		size_t len = n < MAX_BLOCK_SIZE ? n : MAX_BLOCK_SIZE;
+		
+		for (size_t s = 0; s < len; s++)
+		{
+			out[s] = 0.0;
+		}
+		
+		v->RenderBank(len);
+		
+		for (uint8_t i = 0; i < maxPolyphony; i++)
+		{
+			if (notes[i].parked == true)
+			{
+				continue;
+			}
+			
+			// idle, the engine only moves the slot's state on
+			if (notes[i].idle == true)
+			{
+				if (notes[i].retiring == true)
+				{
+					notes[i].retiring = false;
+					notes[i].parked = true;
+					v->ParkSlot(i);
+				}
+				else
+				{
+					v->AdvanceSlot(i, buf, len);
+				}
+				notes[i].peak = 0.0;
+				continue;
+			}
+			
+			v->RenderSlot(i, buf, len);
+			
+			if (notes[i].retiring == true)
+			{
+				// fade to silence over this block then take the slot out of service
+				float step = 1.0f / len;
+				float gain = 1.0f;
+				for (size_t s = 0; s < len; s++)
+				{
+					gain -= step;
+					buf[s] *= gain;
+				}
+				
+				notes[i].retiring = false;
+				notes[i].parked = true;
+				v->ParkSlot(i);
+			}
+			
+			float peak = 0.0;
+			for (size_t s = 0; s < len; s++)
+			{
+				out[s] += buf[s];
+				peak = fmaxf(peak, fabsf(buf[s]));
+			}
+			notes[i].peak = peak;
+			
+			if (peak < SLOT_IDLE_PEAK && notes[i].quiet < idleSamples)
+			{
+				notes[i].quiet += len;
+			}
+			else if (peak >= SLOT_IDLE_PEAK)
+			{
+				notes[i].quiet = 0;
+			}
+			notes[i].idle = v->SlotIdle(i);
+			notes[i].ended = v->SlotEnded(i);
+		}
+		
+		for (size_t s = 0; s < len; s++)
+		{
+			out[s] = out[s] / mixDivisor;
+		}
+		
+		out += len;
+		n -= len;
+	}
+}
+
+
+template<typename V>
+void NullVoice::AdvanceBlock(V *v, size_t n)
+{
+	float buf[MAX_BLOCK_SIZE];
+	
+	while (n > 0)
+	{
+		size_t len = n < MAX_BLOCK_SIZE ? n : MAX_BLOCK_SIZE;
+		
+		v->SkipBank(len);
+		
+		for (uint8_t i = 0; i < maxPolyphony; i++)
+		{
+			if (notes[i].parked == true)
+			{
+				continue;
+			}
+			
+			if (notes[i].retiring == true)
+			{
+				notes[i].retiring = false;
+				notes[i].parked = true;
+				v->ParkSlot(i);
+				continue;
+			}
+			
+			v->AdvanceSlot(i, buf, len);
+		}
+		
+		n -= len;
+	}
+}
+
+
+template<uint8_t N>
 class OscVoice : public NullVoice
 {
 public:
-	void Init(DaisyPod *phw, float SR) override;
-	float Process() override;
+	void Init(DaisyPod *phw, float SR);
+	float Process();
 	
-	void NoteOn(NoteOnEvent *p) override;
-	void NoteOff(NoteOffEvent *p) override;
-	void SetFreq(float freq) override;
+	void NoteOn(NoteOnEvent *p) { AllocateNote(this, p); }
+	void NoteOff(NoteOffEvent *p);
+	void SetFreq(float freq);
 	
-	void SetCC0(uint8_t value) override;
-	void SetCC1(uint8_t value) override;
-	void SetCC2(uint8_t value) override;
-	void SetCC3(uint8_t value) override;
+	void SetCC0(uint8_t value);
+	void SetCC1(uint8_t value);
+	void SetCC2(uint8_t value);
+	void SetCC3(uint8_t value);
 	
-	void ProcessParm0() override;
-	void ProcessParm1() override;
-	void ProcessParm2() override;
-	void ProcessParm3() override;
+	// the pot mappings are shared by every instance and set up once, so the control task can
+	// read them while the engine is not the one in the arena (see Voices)
+	static void InitPots(DaisyPod *phw);
+	static float ReadParm(uint8_t n);
+	void ApplyParm(uint8_t n, float value);
 
-	void Panic() override;
+	void Panic();
+	
+	// allocator side, starts note p in slot i, see NullVoice::AllocateNote
+	void StartNote(uint8_t i, NoteOnEvent *p);
+	
+	// mixing loop side, see NullVoice::MixBlock
+	void ProcessBlock(float *out, size_t n) { MixBlock(this, out, n); }
+	void SkipBlock(size_t n) { AdvanceBlock(this, n); }
+	void RenderBank(size_t n);
+	void SkipBank(size_t n) { synth.Skip(n); }
+	void RenderSlot(uint8_t i, float *buf, size_t n);
+	void ParkSlot(uint8_t i);
+	bool SlotIdle(uint8_t i);
 	
 private:
-	Oscillator synth[MAX_POLYPHONY];
-	Adsr adsr[MAX_POLYPHONY]; 
+	Note slots[N]; // NullVoice::notes
+	SawBank<N> synth; // every slot's saw, rendered together by RenderBank()
+	float synthOut[MAX_BLOCK_SIZE * SawBank<N>::LANES]; // the last chunk, synthOut[s * LANES + i] is slot i
+	EnvelopeBank<N> env; // every slot's ADSR, rendered together by RenderBank()
+	float envOut[MAX_BLOCK_SIZE * EnvelopeBank<N>::LANES]; // the last chunk, same layout as synthOut
 	
-	void StartNote(uint8_t i, NoteOnEvent *p);
-
 	bool ADSROn;
 	
 	void SetADSRAttack(float v);
@@ -138,41 +376,49 @@ private:
 	void SetADSRRelease(float v);
 	float ADSRRelease;
 	
-	Parameter ADSRAttackPotParm; // sets range and plot 
-	Parameter ADSRDecayPotParm; // sets range and plot 
-	Parameter ADSRSustainPotParm; // sets range and plot 
-	Parameter ADSRReleasePotParm; // sets range and plot 
+	static Parameter ADSRAttackPotParm; // sets range and plot 
+	static Parameter ADSRDecayPotParm; // sets range and plot 
+	static Parameter ADSRSustainPotParm; // sets range and plot 
+	static Parameter ADSRReleasePotParm; // sets range and plot 
 	
 };
 
 
+template<uint8_t N>
 class SpringVoice : public NullVoice
 {
 public:
-	void Init(DaisyPod *phw, float SR) override;
-	float Process() override;
+	void Init(DaisyPod *phw, float SR);
+	float Process();
 	
-	void NoteOn(NoteOnEvent *p) override;
-	void NoteOff(NoteOffEvent *p) override;
-	void SetFreq(float freq) override;
+	void NoteOn(NoteOnEvent *p) { AllocateNote(this, p); }
+	void SetFreq(float freq);
 
-	void SetCC0(uint8_t value) override;
-	void SetCC1(uint8_t value) override;
-	void SetCC2(uint8_t value) override;
-	void SetCC3(uint8_t value) override;
+	void SetCC0(uint8_t value);
+	void SetCC1(uint8_t value);
+	void SetCC2(uint8_t value);
+	void SetCC3(uint8_t value);
 	
-	void ProcessParm0() override;
-	void ProcessParm1() override;
-	void ProcessParm2() override;
-	void ProcessParm3() override;
+	// the pot mappings are shared by every instance and set up once, so the control task can
+	// read them while the engine is not the one in the arena (see Voices)
+	static void InitPots(DaisyPod *phw);
+	static float ReadParm(uint8_t n);
+	void ApplyParm(uint8_t n, float value);
 	
-	void Panic() override;
+	void Panic();
 	
-private:
+	// allocator side, starts note p in slot i, see NullVoice::AllocateNote
+	void StartNote(uint8_t i, NoteOnEvent *p);
 	
-	StringVoice spring[MAX_POLYPHONY];
+	// mixing loop side, see NullVoice::MixBlock
+	void ProcessBlock(float *out, size_t n) { MixBlock(this, out, n); }
+	void SkipBlock(size_t n) { AdvanceBlock(this, n); }
+	void RenderSlot(uint8_t i, float *buf, size_t n);
 	
-	void StartNote(uint8_t i, NoteOnEvent *p);
+private:
+	Note slots[N]; // NullVoice::notes
+	
+	StringVoice spring[N];
 	
 	void SetDamping(float v);
 	float damping; 
@@ -184,41 +430,49 @@ private:
 	float accent; 
 
 	
-	Parameter DampingPotParm; // sets range and plot 
-	Parameter StructurePotParm; // sets range and plot 
-	Parameter BrightnessPotParm; // sets range and plot 
-	Parameter AccentPotParm; // sets range and plot 
+	static Parameter DampingPotParm; // sets range and plot 
+	static Parameter StructurePotParm; // sets range and plot 
+	static Parameter BrightnessPotParm; // sets range and plot 
+	static Parameter AccentPotParm; // sets range and plot 
 
 };
 
 
+template<uint8_t N>
 class MalletVoice : public NullVoice
 {
 public:
-	void Init(DaisyPod *phw, float SR) override;
-	float Process() override;
+	void Init(DaisyPod *phw, float SR);
+	float Process();
 	
-	virtual void NoteOn(NoteOnEvent *p) override;
-	virtual void NoteOff(NoteOffEvent *p) override;
-	virtual void SetFreq(float freq) override;
+	void NoteOn(NoteOnEvent *p) { AllocateNote(this, p); }
+	void SetFreq(float freq);
 
-	void SetCC0(uint8_t value) override;
-	void SetCC1(uint8_t value) override;
-	void SetCC2(uint8_t value) override;
-	void SetCC3(uint8_t value) override;
+	void SetCC0(uint8_t value);
+	void SetCC1(uint8_t value);
+	void SetCC2(uint8_t value);
+	void SetCC3(uint8_t value);
 	
-	void ProcessParm0() override;
-	void ProcessParm1() override;
-	void ProcessParm2() override;
-	void ProcessParm3() override;
+	// the pot mappings are shared by every instance and set up once, so the control task can
+	// read them while the engine is not the one in the arena (see Voices)
+	static void InitPots(DaisyPod *phw);
+	static float ReadParm(uint8_t n);
+	void ApplyParm(uint8_t n, float value);
 	
-	void Panic() override;
+	void Panic();
 	
-private:
+	// allocator side, starts note p in slot i, see NullVoice::AllocateNote
+	void StartNote(uint8_t i, NoteOnEvent *p);
 	
-	ModalVoice mallet[MAX_POLYPHONY];
+	// mixing loop side, see NullVoice::MixBlock
+	void ProcessBlock(float *out, size_t n) { MixBlock(this, out, n); }
+	void SkipBlock(size_t n) { AdvanceBlock(this, n); }
+	void RenderSlot(uint8_t i, float *buf, size_t n);
 	
-	void StartNote(uint8_t i, NoteOnEvent *p);
+private:
+	Note slots[N]; // NullVoice::notes
+	
+	ModalVoice mallet[N];
 	
 	void SetDamping(float v);
 	float damping; 
@@ -229,42 +483,47 @@ private:
 	void SetAccent(float v);
 	float accent; 
 	
-	Parameter DampingPotParm; // sets range and plot 
-	Parameter StructurePotParm; // sets range and plot 
-	Parameter BrightnessPotParm; // sets range and plot 
-	Parameter AccentPotParm; // sets range and plot 
+	static Parameter DampingPotParm; // sets range and plot 
+	static Parameter StructurePotParm; // sets range and plot 
+	static Parameter BrightnessPotParm; // sets range and plot 
+	static Parameter AccentPotParm; // sets range and plot 
 
 
 };
 
 
+template<uint8_t N>
 class HiHatVoice : public NullVoice
 {
 public:
-	void Init(DaisyPod *phw, float SR) override;
-	float Process() override;
+	void Init(DaisyPod *phw, float SR);
+	float Process();
 	
-	virtual void NoteOn(NoteOnEvent *p) override;
-	virtual void NoteOff(NoteOffEvent *p) override;
-	virtual void SetFreq(float freq) override;
+	void NoteOn(NoteOnEvent *p) { AllocateNote(this, p); }
+	void SetFreq(float freq);
 
-	void SetCC0(uint8_t value) override;
-	void SetCC1(uint8_t value) override;
-	void SetCC2(uint8_t value) override;
-	void SetCC3(uint8_t value) override;
+	void SetCC0(uint8_t value);
+	void SetCC1(uint8_t value);
+	void SetCC2(uint8_t value);
+	void SetCC3(uint8_t value);
 	
-	void ProcessParm0() override;
-	void ProcessParm1() override;
-	void ProcessParm2() override;
-	void ProcessParm3() override;
+	float ReadParm(uint8_t n);
+	void ApplyParm(uint8_t n, float value);
 	
-	void Panic() override;
+	void Panic();
+	
+	// allocator side, starts note p in slot i, see NullVoice::AllocateNote
+	void StartNote(uint8_t i, NoteOnEvent *p);
+	
+	// mixing loop side, see NullVoice::MixBlock
+	void ProcessBlock(float *out, size_t n) { MixBlock(this, out, n); }
+	void SkipBlock(size_t n) { AdvanceBlock(this, n); }
+	void RenderSlot(uint8_t i, float *buf, size_t n);
 	
 private:
+	Note slots[N]; // NullVoice::notes
 	// or <RingModNoise> - This is much more hihat, but much less tonal
-	HiHat<SquareNoise> hihat[MAX_POLYPHONY];
-	
-	void StartNote(uint8_t i, NoteOnEvent *p);
+	HiHat<SquareNoise> hihat[N];
 	
 	void SetAccentCC(uint8_t value);
 	float accent; 
@@ -280,36 +539,48 @@ private:
 };
 
 
+template<uint8_t N>
 class FormantVoice : public NullVoice
 {
 public:
-	void Init(DaisyPod *phw, float SR) override;
-	float Process() override;
+	void Init(DaisyPod *phw, float SR);
+	float Process();
 	
-	virtual void NoteOn(NoteOnEvent *p) override;
-	virtual void NoteOff(NoteOffEvent *p) override;
-	virtual void SetFreq(float freq) override;
+	void NoteOn(NoteOnEvent *p) { AllocateNote(this, p); }
+	void SetFreq(float freq);
 
-	void SetCC0(uint8_t value) override;
-	void SetCC1(uint8_t value) override;
-	void SetCC2(uint8_t value) override;
-	void SetCC3(uint8_t value) override;
-	void SetCC4(uint8_t value) override;
-	void SetCC5(uint8_t value) override;
+	void SetCC0(uint8_t value);
+	void SetCC1(uint8_t value);
+	void SetCC2(uint8_t value);
+	void SetCC3(uint8_t value);
+	void SetCC4(uint8_t value);
+	void SetCC5(uint8_t value);
 	
-	void ProcessParm0() override;
-	void ProcessParm1() override;
-	void ProcessParm2() override;
-	void ProcessParm3() override;
+	// the pot mappings are shared by every instance and set up once, so the control task can
+	// read them while the engine is not the one in the arena (see Voices)
+	static void InitPots(DaisyPod *phw);
+	static float ReadParm(uint8_t n);
+	void ApplyParm(uint8_t n, float value);
 	
-	void Panic() override;
+	void Panic();
 	
-private:
-	FormantOscillator formant[MAX_POLYPHONY];
-	Adsr adsr[MAX_POLYPHONY]; 
-
+	// allocator side, starts note p in slot i, see NullVoice::AllocateNote
 	void StartNote(uint8_t i, NoteOnEvent *p);
 	
+	// mixing loop side, see NullVoice::MixBlock
+	void ProcessBlock(float *out, size_t n) { MixBlock(this, out, n); }
+	void SkipBlock(size_t n) { AdvanceBlock(this, n); }
+	void RenderBank(size_t n);
+	void RenderSlot(uint8_t i, float *buf, size_t n);
+	void AdvanceSlot(uint8_t i, float *buf, size_t n);
+	bool SlotIdle(uint8_t i);
+	
+private:
+	Note slots[N]; // NullVoice::notes
+	FormantOscillator formant[N];
+	EnvelopeBank<N> env; // every slot's ADSR, rendered together by RenderBank()
+	float envOut[MAX_BLOCK_SIZE * EnvelopeBank<N>::LANES]; // the last chunk, envOut[s * LANES + i] is slot i
+
 	bool ADSROn;
 	
 	void SetADSRAttack(float v);
@@ -321,10 +592,10 @@ private:
 	void SetADSRRelease(float v);
 	float ADSRRelease;
 	
-	Parameter ADSRAttackPotParm; // sets range and plot 
-	Parameter ADSRDecayPotParm; // sets range and plot 
-	Parameter ADSRSustainPotParm; // sets range and plot 
-	Parameter ADSRReleasePotParm; // sets range and plot 
+	static Parameter ADSRAttackPotParm; // sets range and plot 
+	static Parameter ADSRDecayPotParm; // sets range and plot 
+	static Parameter ADSRSustainPotParm; // sets range and plot 
+	static Parameter ADSRReleasePotParm; // sets range and plot 
 
 	void SetFormantFreqCC(uint8_t value);
 	float formantFreq; 
@@ -385,37 +656,55 @@ private:
 	float	resGain; // as the resonance goes up the gain goes down
 };
 
+template<uint8_t N>
 class NoiseVoice : public NullVoice
 {
 public:
-	void Init(DaisyPod *phw, float SR) override;
-	float Process() override;
+	void Init(DaisyPod *phw, float SR);
+	float Process();
 	
-	void NoteOn(NoteOnEvent *p) override;
-	void NoteOff(NoteOffEvent *p) override;
-	void SetFreq(float freq) override;
+	void NoteOn(NoteOnEvent *p) { AllocateNote(this, p); }
+	void NoteOff(NoteOffEvent *p);
+	void SetFreq(float freq);
 
-	void SetCC0(uint8_t value) override;
-	void SetCC1(uint8_t value) override;
-	void SetCC2(uint8_t value) override;
-	void SetCC3(uint8_t value) override;
+	void SetCC0(uint8_t value);
+	void SetCC1(uint8_t value);
+	void SetCC2(uint8_t value);
+	void SetCC3(uint8_t value);
+	void SetCC4(uint8_t value);
 	
-	void ProcessParm0() override;
-	void ProcessParm1() override;
-	void ProcessParm2() override;
-	void ProcessParm3() override;
-	void ProcessParm4() override;
-	void ProcessParm5() override;
+	// the pot mappings are shared by every instance and set up once, so the control task can
+	// read them while the engine is not the one in the arena (see Voices)
+	static void InitPots(DaisyPod *phw);
+	static float ReadParm(uint8_t n);
+	void ApplyParm(uint8_t n, float value);
 
 	
-	void Panic() override;
-	
-private:
-	NoiseFilter noise[MAX_POLYPHONY];
-	Adsr adsr[MAX_POLYPHONY]; 
+	void Panic();
 	
+	// allocator side, starts note p in slot i, see NullVoice::AllocateNote
 	void StartNote(uint8_t i, NoteOnEvent *p);
 	
+	// mixing loop side, see NullVoice::MixBlock
+	void ProcessBlock(float *out, size_t n) { MixBlock(this, out, n); }
+	void SkipBlock(size_t n) { AdvanceBlock(this, n); }
+	void RenderBank(size_t n);
+	void SkipBank(size_t n);
+	void RenderSlot(uint8_t i, float *buf, size_t n);
+	void ParkSlot(uint8_t i);
+	bool SlotIdle(uint8_t i);
+	bool SlotEnded(uint8_t i);
+	
+private:
+	Note slots[N]; // NullVoice::notes
+	NoiseFilterBank<N> noise; // every slot's noise and filters, rendered together by RenderBank()
+	NoiseBiquadBank<N> biquad; // the same with the cheaper filters, see NOISE_FILTER_MODEL
+	uint8_t noiseModel;
+	void SetNoiseModel(uint8_t m);
+	float noiseOut[MAX_BLOCK_SIZE * NoiseFilterBank<N>::LANES]; // the last chunk, noiseOut[s * LANES + i] is slot i
+	EnvelopeBank<N> env; // every slot's ADSR, rendered together by RenderBank()
+	float envOut[MAX_BLOCK_SIZE * EnvelopeBank<N>::LANES]; // the last chunk, same layout as noiseOut
+	
 	void SetResonance(float v);
 	float resonance;
 	void SetDrive(float v);
@@ -432,34 +721,95 @@ private:
 	void SetADSRRelease(float v);
 	float ADSRRelease;
 	
-	Parameter ADSRAttackPotParm; // sets range and plot 
-	Parameter ADSRDecayPotParm; // sets range and plot 
-	Parameter ADSRSustainPotParm; // sets range and plot 
-	Parameter ADSRReleasePotParm; // sets range and plot 
-	Parameter ResonancePotParm; // sets range and plot 
-	Parameter DrivePotParm; // sets range and plot 
+	static Parameter ADSRAttackPotParm; // sets range and plot 
+	static Parameter ADSRDecayPotParm; // sets range and plot 
+	static Parameter ADSRSustainPotParm; // sets range and plot 
+	static Parameter ADSRReleasePotParm; // sets range and plot 
+	static Parameter ResonancePotParm; // sets range and plot 
+	static Parameter DrivePotParm; // sets range and plot 
 
 
 };
 
 
 
+// the voice engines in Voices::VOICE_TYPE order, adding a voice is a line here
+// X(selector, engine template, slots, member, name, LED red, green, blue, short name, cost).
+// The short name is the one the calibration log and the host tools use, cost names the voice's
+// CostCalibrator item (COST_ without the prefix)
+#define VOICE_ENGINES(X) \
+	X(SYNTH_VOICE,		OscVoice,		OSC_VOICE_MAX_POLYPHONY,		oscVoice,		"Synth",	0.0, 1.0, 0.0,	"synth",	OSC) \
+	X(SPRING_VOICE,		SpringVoice,	SPRING_VOICE_MAX_POLYPHONY,		springVoice,	"Spring",	0.0, 0.0, 1.0,	"spring",	STRING) \
+	X(MALLET_VOICE,		MalletVoice,	MALLET_VOICE_MAX_POLYPHONY,		malletVoice,	"Mallet",	1.0, 0.0, 0.0,	"mallet",	MODAL) \
+	X(FORMANT_VOICE,	FormantVoice,	FORMANT_VOICE_MAX_POLYPHONY,	formantVoice,	"Formant",	1.0, 1.0, 0.0,	"formant",	FORMANT) \
+	X(NOISE_VOICE,		NoiseVoice,		NOISE_VOICE_MAX_POLYPHONY,		noiseVoice,		"Noise",	0.0, 1.0, 1.0,	"noise",	NOISE)
+
+typedef struct
+{
+	uint32_t switches;
+	uint32_t lastCycles;	// cycles of the last BeginBlock() that did a step of a switch
+	uint32_t maxCycles;
+}VoiceSwitchCounters;
+
+// what the CCs and pots last set on a voice, replayed after BeginBlock() builds it so a voice
+// switch does not lose them. CC n and pot parameter n set the same thing, the later one is kept
+typedef struct
+{
+	uint8_t set;		// bit n, setting n has been made
+	uint8_t fromCC;		// bit n, by cc[n] rather than parm[n]
+	uint8_t cc[6];
+	float parm[4];
+}VoiceSettings;
+
 // a container for voices
 
 class Voices : public CCMIDIMapable
 {
 	public:
 	Voices() {}
+	
+	typedef enum
+	{
+#define VOICE_SELECTOR(sel, ...) sel,
+		VOICE_ENGINES(VOICE_SELECTOR)
+#undef VOICE_SELECTOR
+		NUM_VOICE_TYPES
+	}VOICE_TYPE;
+	
+	#define NUM_VOICES Voices::NUM_VOICE_TYPES
+	
+	uint8_t GetSelector(void) { return currentVoiceSelector; }
 		
 	void Init(DaisyPod *pod, float SR); 
 	
-	// 1/-1 rotates thru voices, 0 does nothing
+	// 1/-1 rotates thru voices, 0 does nothing. The change is made by the next BeginBlock()
 	void Select(int8_t sel);
 	
 	float Process(void);
+	void ProcessBlock(float *out, size_t n);
+	// the renderer's silence bypass, the current voice is idle, see NullVoice::SkipBlock
+	void SkipBlock(size_t n);
 	
 	void UpdateBackGround(void);
 	
+	// audio side at the start of a block, makes a voice change requested since the last one over two
+	// blocks: the first drops the old engine and builds the new one in the same RAM, the second
+	// initialises it. True for both, the block is then not rendered so neither step shares it with a render
+	bool BeginBlock(void);
+	
+	const VoiceSwitchCounters &GetSwitchCounters() { return switchCounters; }
+	
+	// main loop, the voice switch counters and the current voice's allocator counters
+	void LogCounters(void);
+	
+	// logs the RAM of each engine and what it would take with MAX_POLYPHONY slots
+	void LogSizes(void);
+	
+	// boot, before audio starts. Builds voice sel in the arena with a note in every slot, voice CC
+	// function 4 set to cc4 unless it is -1, and times samples of its ProcessBlock(). Cycles per
+	// sample of one slot, the current voice is built again after
+	float Measure(uint8_t sel, int16_t cc4, uint32_t samples);
+	
 	void NoteOn(NoteOnEvent *p);
 	void NoteOff(NoteOffEvent *p);
 	void SetFreq(float freq);
@@ -471,10 +821,23 @@ class Voices : public CCMIDIMapable
 	
 	void CCProcess(uint8_t ccFuncNumber, uint8_t value);
 
-	void ProcessParm0();
-	void ProcessParm1();
-	void ProcessParm2();
-	void ProcessParm3();
+	// control task side, parameter n of a voice (VOICE_TYPE), which need not be the current one
+	float ReadParm(uint8_t voice, uint8_t n);
+	// audio side, parameter n of the current voice
+	void ApplyParm(uint8_t n, float value);
+	
+	// polyphony of the current voice, see NullVoice
+	uint8_t GetPolyphony(void) { return pvoice->GetPolyphony(); }
+	uint8_t GetMaxPolyphony(void) { return pvoice->GetMaxPolyphony(); }
+	uint8_t GetActiveNotes(void) { return pvoice->GetActiveNotes(); }
+	
+	// every voice's, see VoiceAllocator::STEAL_POLICY. CC function 6 spreads the policies over 0 - 127
+	void SetStealPolicy(uint8_t p);
+	uint8_t GetStealPolicy(void) { return stealPolicy; }
+	// of the current voice, they restart when it is built
+	const VoiceAllocator::Counters &GetAllocatorCounters(void) { return pvoice->GetAllocatorCounters(); }
+	bool IsIdle(void) { return pvoice->IsIdle(); }
+	void SetPolyphony(uint8_t p) { pvoice->SetPolyphony(p); }
 
 	
 	private:
@@ -486,27 +849,60 @@ class Voices : public CCMIDIMapable
 	
 	uint8_t currentVoiceSelector;
 	
-	typedef enum
-	{
-		SYNTH_VOICE,
-		SPRING_VOICE,
-		MALLET_VOICE,
-		FORMANT_VOICE,
-		NOISE_VOICE
-	}VOICE_TYPE;
-	
-	#define NUM_VOICES 5
+	uint8_t pendingVoiceSelector; // the voice BeginBlock() switches to
+	bool building; // the current engine is built but not initialised, settings are only kept
+	uint8_t stealPolicy;
+	VoiceSwitchCounters switchCounters;
+	VoiceSettings settings[NUM_VOICE_TYPES];
 	
 	void ChangeVoice(uint8_t sel);
-
 	
-	OscVoice	oscVoice;
-	SpringVoice springVoice;
-	MalletVoice malletVoice;
-	FormantVoice  formantVoice;
-	NoiseVoice  noiseVoice;
+	// keeps CC n or pot parameter n of the current voice for Restore()
+	void KeepCC(uint8_t n, uint8_t value);
+	void KeepParm(uint8_t n, float value);
+	// sets the engine just built as the CCs and pots left it
+	void Restore(void);
+	
+	// builds voice sel in the arena and sets it up
+	void Construct(uint8_t sel);
+	// the two steps of Construct(), BeginBlock() takes a block for each
+	void Build(uint8_t sel);
+	void Setup(uint8_t sel);
+	
+	// calls f with voice sel as its own class, so the calls f makes are direct and inline
+	// only the current voice exists
+	template<typename F>
+	void Dispatch(uint8_t sel, F f);
+
+	// one voice is played at a time so the engines share their RAM, only the current one is built
+	union VoiceArena
+	{
+		VoiceArena() {}
+		~VoiceArena() {}
+		
+#define VOICE_MEMBER(type, engine, slots, member, ...) engine<slots> member;
+		VOICE_ENGINES(VOICE_MEMBER)
+#undef VOICE_MEMBER
+	};
+	
+	VoiceArena arena;
 	
-	NullVoice *pvoice;
+	NullVoice *pvoice; // the current voice's slots and polyphony, which are not engine specific
 	
 };
 
+
+template<typename F>
+void Voices::Dispatch(uint8_t sel, F f)
+{
+	switch (sel)
+	{
+#define VOICE_CASE(type, engine, slots, member, ...) case type: f(arena.member); break;
+	VOICE_ENGINES(VOICE_CASE)
+#undef VOICE_CASE
+		
+	default:
+		break;
+	}
+}
+
@@ -0,0 +1,250 @@
+/*
+ This file is part of Virtual Robot's Pine Synthesizer. 
+
+Copyright <2022> <Brian Gunnison>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+software and associated documentation files (the "Software"), to deal in the Software 
+without restriction, including without limitation the rights to use, copy, modify, 
+merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+permit persons to whom the Software is furnished to do so, subject to the following 
+conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "voiceallocator.h"
+
+
+void VoiceAllocator::Init(Note *slots, uint8_t n)
+{
+	notes = slots;
+	numSlots = n;
+	policy = STEAL_OLDEST;
+	reuseTails = false;
+	serial = 0;
+	
+	counters.notes = 0;
+	counters.steals = 0;
+	counters.drops = 0;
+	
+	for (uint8_t i = 0; i < numSlots; i++)
+	{
+		notes[i].lastNote = 0;
+		notes[i].started = 0;
+	}
+	
+	Reset();
+}
+
+
+void VoiceAllocator::SetPolicy(uint8_t p)
+{
+	if (p >= NUM_STEAL_POLICIES)
+	{
+		return;
+	}
+	
+	policy = p;
+}
+
+
+const char *VoiceAllocator::GetPolicyName(uint8_t p)
+{
+	const char *names[NUM_STEAL_POLICIES] = { "oldest", "quietest", "same note", "lowest priority", "none" };
+	
+	if (p >= NUM_STEAL_POLICIES)
+	{
+		return "?";
+	}
+	
+	return names[p];
+}
+
+
+int8_t VoiceAllocator::NoteOn(uint8_t note)
+{
+	note &= 0x7f;
+	
+	int8_t i = slotOf[note];
+	if (i < 0)
+	{
+		i = FindFree(note);
+	}
+	
+	if (i < 0)
+	{
+		i = FindVictim();
+		
+		if (i < 0)
+		{
+			counters.drops++;
+			return -1;
+		}
+		
+		counters.steals++;
+	}
+	
+	// the slot's last note no longer points at it
+	if (slotOf[notes[i].lastNote] == i)
+	{
+		slotOf[notes[i].lastNote] = -1;
+	}
+	
+	slotOf[note] = i;
+	notes[i].lastNote = note;
+	notes[i].started = ++serial;
+	counters.notes++;
+	
+	return i;
+}
+
+
+int8_t VoiceAllocator::NoteOff(uint8_t note)
+{
+	note &= 0x7f;
+	
+	int8_t i = slotOf[note];
+	if (i < 0)
+	{
+		return -1;
+	}
+	
+	slotOf[note] = -1;
+	notes[i].midiNote = 0;
+	
+	return i;
+}
+
+
+void VoiceAllocator::Release(uint8_t i)
+{
+	if (slotOf[notes[i].lastNote] == (int8_t)i)
+	{
+		slotOf[notes[i].lastNote] = -1;
+	}
+	
+	notes[i].midiNote = 0;
+}
+
+
+void VoiceAllocator::Reset()
+{
+	for (uint8_t n = 0; n < 128; n++)
+	{
+		slotOf[n] = -1;
+	}
+}
+
+
+// the first free slot in slot order, the one the engines took before the allocator: released and
+// ended, or any released slot for an engine that reuses tails. Else a held note that has gone
+// silent, then the released slot that has rung longest
+int8_t VoiceAllocator::FindFree(uint8_t note)
+{
+	int8_t first = -1;
+	int8_t silent = -1;
+	int8_t released = -1;
+	
+	for (uint8_t i = 0; i < numSlots; i++)
+	{
+		if (!InService(i))
+		{
+			continue;
+		}
+		
+		// a spring or mallet note held after it has died away
+		if (notes[i].midiNote != 0)
+		{
+			if (notes[i].idle && silent < 0)
+			{
+				silent = i;
+			}
+			continue;
+		}
+		
+		if (policy == STEAL_SAME_NOTE && notes[i].lastNote == note)
+		{
+			return i;
+		}
+		
+		if (notes[i].ended || reuseTails)
+		{
+			if (first < 0)
+			{
+				first = i;
+			}
+		}
+		else if (released < 0 || notes[i].started < notes[released].started)
+		{
+			released = i;
+		}
+	}
+	
+	if (first >= 0)
+	{
+		return first;
+	}
+	
+	return silent >= 0 ? silent : released;
+}
+
+
+// a held note to cut off, by the policy
+int8_t VoiceAllocator::FindVictim()
+{
+	int8_t v = -1;
+	
+	if (policy == STEAL_NONE)
+	{
+		return -1;
+	}
+	
+	for (uint8_t i = 0; i < numSlots; i++)
+	{
+		if (!InService(i))
+		{
+			continue;
+		}
+		
+		if (v < 0)
+		{
+			v = i;
+			continue;
+		}
+		
+		switch (policy)
+		{
+		case STEAL_QUIETEST:
+			if (notes[i].peak < notes[v].peak)
+			{
+				v = i;
+			}
+			break;
+			
+		case STEAL_LOWEST_PRIORITY:
+			if (notes[i].amplitude < notes[v].amplitude || 
+				(notes[i].amplitude == notes[v].amplitude && notes[i].started < notes[v].started))
+			{
+				v = i;
+			}
+			break;
+			
+		default:
+			if (notes[i].started < notes[v].started)
+			{
+				v = i;
+			}
+			break;
+		}
+	}
+	
+	return v;
+}
@@ -0,0 +1,106 @@
+/*
+ This file is part of Virtual Robot's Pine Synthesizer. 
+
+Copyright <2022> <Brian Gunnison>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+software and associated documentation files (the "Software"), to deal in the Software 
+without restriction, including without limitation the rights to use, copy, modify, 
+merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+permit persons to whom the Software is furnished to do so, subject to the following 
+conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <stdint.h>
+
+// one voice slot, the engines keep an array of them (see NullVoice)
+typedef struct
+{	
+	uint8_t midiNote; // > 0 if playing
+	float amplitude; // start gain
+	bool parked; // taken out of service by the polyphony governor
+	bool retiring; // fades out over the next block, then parked
+	float peak; // peak output of the last block, the governor retires the quietest
+	bool idle; // nothing left to render, MixBlock skips it until the next note
+	bool ended; // the note is over and the slot may be retaken, a filter may still ring (see SlotEnded)
+	uint32_t quiet; // samples the slot has been below SLOT_IDLE_PEAK
+	uint8_t lastNote; // the note the slot last started, kept after release
+	uint32_t started; // allocator serial of that note, lower is older
+	
+}Note;
+
+// picks the slot for each note on, shared by the voice engines.
+// A held note is retriggered in its own slot, else the first free slot in slot order is taken as
+// the engines did before the allocator, else a held note that has gone silent, else a released one
+// still sounding its tail (the oldest), else a held note is stolen by the policy.
+// The note to slot table makes finding a held note O(1), note off included
+class VoiceAllocator
+{
+public:
+	typedef enum
+	{
+		STEAL_OLDEST,			// the held note started longest ago
+		STEAL_QUIETEST,			// the held note with the lowest peak last block
+		STEAL_SAME_NOTE,		// as oldest, but a free slot that last played this note is taken first so a restruck string keeps its slot
+		STEAL_LOWEST_PRIORITY,	// the held note with the lowest velocity, the oldest of equals
+		STEAL_NONE,				// the note is dropped, as before the allocator
+		NUM_STEAL_POLICIES
+	}STEAL_POLICY;
+	
+	typedef struct
+	{
+		uint32_t notes;		// note ons given a slot
+		uint32_t steals;	// of them, held notes cut off
+		uint32_t drops;		// note ons that got no slot
+	}Counters;
+	
+	// slots is the engine's array of n notes
+	void Init(Note *slots, uint8_t n);
+	
+	// a released slot is free at once, its tail cut by the next note, rather than once idle.
+	// The physical models restrike their resonator, the enveloped engines wait for the ADSR
+	void SetReuseTails(bool r) { reuseTails = r; }
+	
+	void SetPolicy(uint8_t p);
+	uint8_t GetPolicy() { return policy; }
+	static const char *GetPolicyName(uint8_t p);
+	
+	// the slot to start note in, -1 if it is dropped. The slot is marked as the note's,
+	// the engine then starts it (StartNote sets midiNote and amplitude)
+	int8_t NoteOn(uint8_t note);
+	
+	// releases note, the slot it was in or -1
+	int8_t NoteOff(uint8_t note);
+	
+	// slot i lets go of its note without a note off, the governor retiring it
+	void Release(uint8_t i);
+	
+	// every note released, for Panic
+	void Reset();
+	
+	const Counters &GetCounters() { return counters; }
+	
+private:
+	Note *notes;
+	uint8_t numSlots;
+	uint8_t policy;
+	bool reuseTails;
+	uint32_t serial; // counts note ons, stamps Note::started
+	int8_t slotOf[128]; // the slot holding each note, -1 none
+	Counters counters;
+	
+	int8_t FindFree(uint8_t note);
+	int8_t FindVictim();
+	bool InService(uint8_t i) { return !notes[i].parked && !notes[i].retiring; }
+};
@@ -0,0 +1,125 @@
+/*
+ This file is part of Virtual Robot's Pine Synthesizer. 
+
+Copyright <2022> <Brian Gunnison>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+software and associated documentation files (the "Software"), to deal in the Software 
+without restriction, including without limitation the rights to use, copy, modify, 
+merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+permit persons to whom the Software is furnished to do so, subject to the following 
+conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "daisy_pod.h"
+
+#include "utilities.h"
+#include "voice.h"
+#include "filter.h"
+#include "cyclecounter.h"
+#include "xrun.h"
+
+using namespace daisy;
+
+
+void XrunDetector::Init(Voices *v, Filters *f, float sampleRate, size_t blockSize)
+{
+	voices = v;
+	filters = f;
+	
+	CycleCounterInit();
+	deadline = (uint32_t)(CyclesPerSecond() * blockSize / sampleRate);
+	nearMiss = (uint32_t)(deadline * XRUN_NEAR_MISS);
+	lateGap = (uint32_t)(deadline * XRUN_LATE);
+	started = false;
+	
+	counters.blocks = 0;
+	counters.overruns = 0;
+	counters.nearMisses = 0;
+	counters.late = 0;
+	counters.worst = 0;
+	numContexts = 0;
+}
+
+
+uint32_t XrunDetector::Start()
+{
+	uint32_t now = CycleCount();
+	
+	if (started && now - lastStart > lateGap)
+	{
+		counters.late++;
+	}
+	
+	started = true;
+	lastStart = now;
+	
+	return now;
+}
+
+
+void XrunDetector::End(uint32_t start)
+{
+	uint32_t cycles = CycleCount() - start;
+	
+	counters.blocks++;
+	if (cycles > counters.worst)
+	{
+		counters.worst = cycles;
+	}
+	
+	if (cycles <= nearMiss)
+	{
+		return;
+	}
+	
+	counters.nearMisses++;
+	
+	if (cycles <= deadline)
+	{
+		return;
+	}
+	
+	counters.overruns++;
+	
+	Context &c = contexts[numContexts % XRUN_CONTEXTS];
+	c.block = counters.blocks;
+	c.cycles = cycles;
+	c.voice = voices->GetSelector();
+	c.filter = filters->GetSelector();
+	c.polyphony = voices->GetPolyphony();
+	c.activeNotes = voices->GetActiveNotes();
+	numContexts++;
+}
+
+
+void XrunDetector::Log()
+{
+	log("Xrun: %u blocks overruns: %u near misses: %u late: %u", counters.blocks, counters.overruns, counters.nearMisses, counters.late);
+	log("Xrun: worst %u of %u cycles (%u%%)", counters.worst, deadline, (uint32_t)(100.0f * counters.worst / deadline));
+	
+	uint32_t n = numContexts;
+	uint32_t first = (n > XRUN_CONTEXTS) ? n - XRUN_CONTEXTS : 0;
+	
+	for (uint32_t i = first; i < n; i++)
+	{
+		// an overrun during this loop may overwrite the oldest entry, it is only a report
+		Context &c = contexts[i % XRUN_CONTEXTS];
+		log("Xrun block %u: %u cycles voice %d filter %d poly %d notes %d", 
+			c.block, 
+			c.cycles, 
+			c.voice, 
+			c.filter, 
+			c.polyphony, 
+			c.activeNotes);
+	}
+}
@@ -0,0 +1,89 @@
+/*
+ This file is part of Virtual Robot's Pine Synthesizer. 
+
+Copyright <2022> <Brian Gunnison>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+software and associated documentation files (the "Software"), to deal in the Software 
+without restriction, including without limitation the rights to use, copy, modify, 
+merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+permit persons to whom the Software is furnished to do so, subject to the following 
+conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "daisy_pod.h"
+#include "voice.h"
+#include "filter.h"
+#include "cyclecounter.h"
+
+using namespace daisy;
+
+#define XRUN_NEAR_MISS		0.90f	// a callback over this share of the block deadline is a near miss
+#define XRUN_LATE			1.5f	// callbacks further apart than this many blocks missed one
+#define XRUN_CONTEXTS		8		// the last overruns kept with what was playing
+
+
+// Measures each audio callback against the block deadline with the cycle counter, counts
+// overruns and near misses and keeps what the synth was doing for the last few overruns.
+class XrunDetector
+{
+public:
+	typedef struct
+	{
+		uint32_t blocks;		// callbacks seen
+		uint32_t overruns;		// callbacks longer than a block
+		uint32_t nearMisses;	// callbacks over XRUN_NEAR_MISS of a block, overruns included
+		uint32_t late;			// callbacks that started over XRUN_LATE blocks after the previous one
+		uint32_t worst;			// longest callback, cycles
+	}Counters;
+	
+	typedef struct
+	{
+		uint32_t block;			// callback number
+		uint32_t cycles;		// how long it took
+		uint8_t voice;			// Voices::VOICE_TYPE
+		uint8_t filter;			// Filters::FILTER_TYPE
+		uint8_t polyphony;		// slots in service
+		uint8_t activeNotes;	// slots holding a note
+	}Context;
+	
+	void Init(Voices *v, Filters *f, float sampleRate, size_t blockSize);
+	
+	// first thing in the audio callback, returns the start for End()
+	uint32_t Start();
+	
+	// last thing in the audio callback
+	void End(uint32_t start);
+	
+	const Counters &GetCounters() { return counters; }
+	
+	// main loop, counters and the captured overruns
+	void Log();
+	
+private:
+	Voices *voices;
+	Filters *filters;
+	
+	uint32_t deadline;		// cycles per block
+	uint32_t nearMiss;
+	uint32_t lateGap;
+	uint32_t lastStart;
+	bool started;
+	
+	Counters counters;
+	Context contexts[XRUN_CONTEXTS];
+	volatile uint32_t numContexts;	// captured so far, contexts[numContexts % XRUN_CONTEXTS] is next
+};